@@ -0,0 +1,305 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _BINFMT_H_
+#define _BINFMT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+// Layout of dwgrep --format=bin output, and a reader for it.  The
+// reader only needs this header, and works on any buffer holding the
+// output, typically a mmap'd file.
+//
+// Output starts with the eight bytes of MAGIC, the last of which is a
+// format version.  Records follow, each of which is:
+//
+//   u32 length		-- of the rest of the record
+//   u8  kind		-- a record_kind
+//   str file		-- empty unless filenames are shown, errors
+//			   always name the file
+//   ...		-- kind-specific payload:
+//
+//   record_kind::result: u32 n, followed by N values, top of stack
+//   first.
+//   record_kind::count:  u64 count.
+//   record_kind::error:  str message.
+//
+// Integers are little-endian.  A str is u32 length followed by that
+// many bytes, with no terminating NUL.  Each value starts with a u8
+// value_type, followed by:
+//
+//   cst:     u8 is_signed, u64 value, str domain name
+//   str:     str
+//   seq:     u32 n, N values
+//   dwarf:   str file name
+//   cu:      u64 offset
+//   die:     u64 offset, u32 tag, u32 n, N attribute payloads.  Only
+//            DIE's at the top of a result list their attributes,
+//            N is 0 for the others.
+//   attr:    u32 name, u32 form, u32 n, N values
+//   llelem:  u64 low, u64 high, u32 n, N llop payloads
+//   llop:    u64 offset, u8 atom, u64 number, u64 number2
+//   aset:    u32 n, N times u64 start and u64 length
+//   elfsym:  u32 index, u64 value, u64 size, u8 info, u8 other,
+//            str name
+//   unknown: nothing
+//
+// "Attribute payload" and "llop payload" are attr and llop values
+// without the leading value_type byte.
+
+namespace binfmt
+{
+  static char const magic[8] = {'D', 'W', 'G', 'R', 'E', 'P', 'B', 1};
+
+  enum class record_kind
+    : uint8_t
+    {
+      result = 1,
+      count = 2,
+      error = 3,
+    };
+
+  enum class value_type
+    : uint8_t
+    {
+      unknown = 0,
+      cst = 1,
+      str = 2,
+      seq = 3,
+      dwarf = 4,
+      cu = 5,
+      die = 6,
+      attr = 7,
+      llelem = 8,
+      llop = 9,
+      aset = 10,
+      elfsym = 11,
+    };
+
+  // Reads integers and strings from a range of bytes.  Reading past
+  // the end throws std::runtime_error.
+  class cursor
+  {
+    unsigned char const *m_ptr;
+    unsigned char const *m_end;
+
+    unsigned char const *
+    take (size_t n)
+    {
+      if (static_cast <size_t> (m_end - m_ptr) < n)
+	throw std::runtime_error ("binfmt: truncated data");
+      auto ret = m_ptr;
+      m_ptr += n;
+      return ret;
+    }
+
+    template <class T>
+    T
+    get_le ()
+    {
+      auto p = take (sizeof (T));
+      T ret = 0;
+      for (size_t i = 0; i < sizeof (T); ++i)
+	ret |= static_cast <T> (p[i]) << (8 * i);
+      return ret;
+    }
+
+  public:
+    cursor ()
+      : m_ptr {nullptr}
+      , m_end {nullptr}
+    {}
+
+    cursor (void const *buf, size_t len)
+      : m_ptr {static_cast <unsigned char const *> (buf)}
+      , m_end {m_ptr + len}
+    {}
+
+    bool at_end () const { return m_ptr == m_end; }
+
+    uint8_t u8 () { return get_le <uint8_t> (); }
+    uint32_t u32 () { return get_le <uint32_t> (); }
+    uint64_t u64 () { return get_le <uint64_t> (); }
+
+    // Return pointer to the string and its length.  The string
+    // points into the underlying buffer and isn't NUL-terminated.
+    std::pair <char const *, size_t>
+    str ()
+    {
+      uint32_t len = u32 ();
+      return {reinterpret_cast <char const *> (take (len)), len};
+    }
+
+    // Return a cursor over the next LEN bytes, and skip them.
+    cursor
+    sub (size_t len)
+    {
+      return cursor {take (len), len};
+    }
+  };
+
+  inline void skip_value (cursor &c);
+
+  inline void
+  skip_attr_payload (cursor &c)
+  {
+    c.u32 ();
+    c.u32 ();
+    for (uint32_t n = c.u32 (), i = 0; i < n; ++i)
+      skip_value (c);
+  }
+
+  inline void
+  skip_llop_payload (cursor &c)
+  {
+    c.u64 ();
+    c.u8 ();
+    c.u64 ();
+    c.u64 ();
+  }
+
+  // Skip over one value, including its leading value_type byte.
+  inline void
+  skip_value (cursor &c)
+  {
+    switch (static_cast <value_type> (c.u8 ()))
+      {
+      case value_type::unknown:
+	return;
+
+      case value_type::cst:
+	c.u8 ();
+	c.u64 ();
+	c.str ();
+	return;
+
+      case value_type::str:
+      case value_type::dwarf:
+	c.str ();
+	return;
+
+      case value_type::seq:
+	for (uint32_t n = c.u32 (), i = 0; i < n; ++i)
+	  skip_value (c);
+	return;
+
+      case value_type::cu:
+	c.u64 ();
+	return;
+
+      case value_type::die:
+	c.u64 ();
+	c.u32 ();
+	for (uint32_t n = c.u32 (), i = 0; i < n; ++i)
+	  skip_attr_payload (c);
+	return;
+
+      case value_type::attr:
+	skip_attr_payload (c);
+	return;
+
+      case value_type::llelem:
+	c.u64 ();
+	c.u64 ();
+	for (uint32_t n = c.u32 (), i = 0; i < n; ++i)
+	  skip_llop_payload (c);
+	return;
+
+      case value_type::llop:
+	skip_llop_payload (c);
+	return;
+
+      case value_type::aset:
+	for (uint32_t n = c.u32 (), i = 0; i < n; ++i)
+	  {
+	    c.u64 ();
+	    c.u64 ();
+	  }
+	return;
+
+      case value_type::elfsym:
+	c.u32 ();
+	c.u64 ();
+	c.u64 ();
+	c.u8 ();
+	c.u8 ();
+	c.str ();
+	return;
+      }
+
+    throw std::runtime_error ("binfmt: unknown value type");
+  }
+
+  struct record
+  {
+    record_kind kind;
+    std::pair <char const *, size_t> file;
+
+    // Positioned at the kind-specific payload.
+    cursor payload;
+  };
+
+  // Walks records of a buffer that holds the whole output.  Throws
+  // std::runtime_error if the buffer doesn't start with MAGIC.
+  class reader
+  {
+    cursor m_cur;
+
+  public:
+    reader (void const *buf, size_t len)
+      : m_cur {buf, len}
+    {
+      if (len < sizeof magic
+	  || std::memcmp (buf, magic, sizeof magic) != 0)
+	throw std::runtime_error ("binfmt: bad magic");
+      m_cur.sub (sizeof magic);
+    }
+
+    // Fetch next record into REC.  Returns false at the end of the
+    // buffer.
+    bool
+    next (record &rec)
+    {
+      if (m_cur.at_end ())
+	return false;
+
+      uint32_t len = m_cur.u32 ();
+      cursor body = m_cur.sub (len);
+      rec.kind = static_cast <record_kind> (body.u8 ());
+      rec.file = body.str ();
+      rec.payload = body;
+      return true;
+    }
+  };
+}
+
+#endif /* _BINFMT_H_ */
@@ -29,6 +29,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <getopt.h>
@@ -37,11 +39,18 @@
 #include <libintl.h>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 #include "libzwerg.hh"
 #include "libzwerg-dw.h"
+#include "format.hh"
 #include "options.hh"
+#include "output.hh"
 #include "libzwerg/std-memory.hh"
 #include "libzwerg/strip.hh"
 #include "version.h"
@@ -99,6 +108,34 @@ show_help (std::vector <ext_option> const &ext_opts)
     }
 }
 
+void
+show_profile (zw_result const &result)
+{
+  size_t n;
+  zw_profile_entry const *entries = zw_result_profile (&result, &n);
+
+  ios_flag_saver s {std::cerr};
+  std::cerr << std::setw (10) << "calls" << std::setw (10) << "yields"
+	    << std::setw (10) << "copies" << std::setw (12) << "incl ms"
+	    << std::setw (12) << "excl ms" << "  operation\n";
+
+  std::cerr << std::fixed << std::setprecision (3);
+  for (size_t i = 0; i < n; ++i)
+    {
+      auto const &e = entries[i];
+      std::cerr << std::setw (10) << e.calls << std::setw (10) << e.yields
+		<< std::setw (10) << e.copies
+		<< std::setw (12) << e.ns_inclusive / 1e6
+		<< std::setw (12) << e.ns_exclusive / 1e6
+		<< "  " << std::string (2 * e.depth, ' ') << e.name;
+      if (e.is_pred && e.calls > 0)
+	std::cerr << std::setprecision (1)
+		  << " (" << 100. * e.yields / e.calls << "% held)"
+		  << std::setprecision (3);
+      std::cerr << "\n";
+    }
+}
+
 void
 dump_err (zw_error *err)
 {
@@ -106,13 +143,21 @@ dump_err (zw_error *err)
   std::cerr << "Error: " << zw_error_message (err) << std::endl;
 }
 
+// The text format.  A dumper doesn't change once it is constructed,
+// and the queries that it uses to look into values can be run from
+// several threads at once.  One dumper can thus be shared by all
+// threads.
 class dumper
+  : public result_format
 {
-  zw_vocabulary const &m_voc;
+  std::unique_ptr <zw_query, zw_deleter> m_llelem_ops;
+  std::unique_ptr <zw_query, zw_deleter> m_llop_properties;
 
 public:
   explicit dumper (zw_vocabulary const &voc)
-    : m_voc (voc)
+    : m_llelem_ops {zw_query_parse (&voc, "[elem]", zw_throw_on_error {})}
+    , m_llop_properties {zw_query_parse (&voc, "[offset, label, value]",
+					 zw_throw_on_error {})}
   {}
 
   enum class format
@@ -122,26 +167,35 @@ public:
       inner_brief,
     };
 
-  void dump_value (std::ostream &os, zw_value const &val, format fmt);
+  void dump_value (std::ostream &os, zw_value const &val, format fmt) const;
+
+  void write_result (std::ostream &os, char const *fn,
+		     zw_stack_view const &stk) const override;
+  void write_count (std::ostream &os, char const *fn,
+		    uint64_t count) const override;
+  void write_error (std::ostream &os, std::string const &fn,
+		    char const *msg) const override;
 
 private:
-  void dump_const (std::ostream &os, zw_value const &val, format fmt);
-  void dump_charp (std::ostream &os, char const *buf, size_t len, format fmt);
-  void dump_string (std::ostream &os, zw_value const &val, format fmt);
-  void dump_seq (std::ostream &os, zw_value const &val, format fmt);
-  void dump_dwarf (std::ostream &os, zw_value const &val, format fmt);
-  void dump_cu (std::ostream &os, zw_value const &val, format fmt);
-  void dump_die (std::ostream &os, zw_value const &val, format fmt);
-  void dump_attr (std::ostream &os, zw_value const &val, format fmt);
-  void dump_llelem (std::ostream &os, zw_value const &val, format fmt);
-  void dump_llop (std::ostream &os, zw_value const &val, format fmt);
-  void dump_aset (std::ostream &os, zw_value const &val, format fmt);
-  void dump_elfsym (std::ostream &os, zw_value const &val, format fmt);
-  void dump_named_constant (std::ostream &os, unsigned cst, zw_cdom const &dom);
+  void dump_const (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_charp (std::ostream &os, char const *buf, size_t len,
+		   format fmt) const;
+  void dump_string (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_seq (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_dwarf (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_cu (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_die (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_attr (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_llelem (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_llop (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_aset (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_elfsym (std::ostream &os, zw_value const &val, format fmt) const;
+  void dump_named_constant (std::ostream &os, unsigned cst,
+			    zw_cdom const &dom) const;
 };
 
 void
-dumper::dump_const (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_const (std::ostream &os, zw_value const &val, format fmt) const
 {
   std::unique_ptr <zw_value, zw_deleter> str
        {fmt == format::full ? zw_value_const_format (&val, zw_throw_on_error {})
@@ -150,7 +204,8 @@ dumper::dump_const (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_charp (std::ostream &os, char const *buf, size_t len, format fmt)
+dumper::dump_charp (std::ostream &os, char const *buf, size_t len,
+		    format fmt) const
 {
   if (fmt == format::full)
     os << std::string {buf, len};
@@ -190,7 +245,7 @@ dumper::dump_charp (std::ostream &os, char const *buf, size_t len, format fmt)
 }
 
 void
-dumper::dump_string (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_string (std::ostream &os, zw_value const &val, format fmt) const
 {
   size_t len;
   char const *buf = zw_value_str_str (&val, &len);
@@ -198,7 +253,7 @@ dumper::dump_string (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_seq (std::ostream &os, zw_value const &val, format)
+dumper::dump_seq (std::ostream &os, zw_value const &val, format) const
 {
   os << "[";
   for (size_t n = zw_value_seq_length (&val), i = 0; i < n; ++i)
@@ -213,7 +268,7 @@ dumper::dump_seq (std::ostream &os, zw_value const &val, format)
 }
 
 void
-dumper::dump_dwarf (std::ostream &os, zw_value const &val, format)
+dumper::dump_dwarf (std::ostream &os, zw_value const &val, format) const
 {
   os << "<Dwarf ";
   char const *name = zw_value_dwarf_name (&val);
@@ -222,7 +277,7 @@ dumper::dump_dwarf (std::ostream &os, zw_value const &val, format)
 }
 
 void
-dumper::dump_cu (std::ostream &os, zw_value const &val, format)
+dumper::dump_cu (std::ostream &os, zw_value const &val, format) const
 {
   ios_flag_saver ifs {os};
   os << "<CU " << std::hex << std::showbase << zw_value_cu_offset (&val) << ">";
@@ -230,7 +285,7 @@ dumper::dump_cu (std::ostream &os, zw_value const &val, format)
 
 void
 exec_query_on (zw_value const &val, zw_query const &q,
-	       std::function <void (zw_stack const &)> cb)
+	       std::function <void (zw_stack_view const &)> cb)
 {
   std::unique_ptr <zw_stack, zw_deleter> stack
 	{zw_stack_init (zw_throw_on_error {})};
@@ -238,12 +293,12 @@ exec_query_on (zw_value const &val, zw_query const &q,
 
   for (std::unique_ptr <zw_result, zw_deleter> result
 	{zw_query_execute (&q, stack.get (), zw_throw_on_error {})};
-       auto out = zw_result_next (*result); )
+       auto out = zw_result_next_view (*result); )
     cb (*out);
 }
 
 void
-dumper::dump_die (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_die (std::ostream &os, zw_value const &val, format fmt) const
 {
   Dwarf_Die die = zw_value_die_die (&val);
   std::unique_ptr <zw_value, zw_deleter> tag
@@ -268,55 +323,45 @@ dumper::dump_die (std::ostream &os, zw_value const &val, format fmt)
 
   if (fmt == format::full)
     {
-      static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "raw attribute", zw_throw_on_error {})};
-      exec_query_on (val, *query,
-		     [&] (zw_stack const &stk) -> void {
-		       assert (zw_stack_depth (&stk) == 1);
-		       dump_attr (os << "\n\t", *zw_stack_at (&stk, 0),
-				  format::brief);
-		     });
+      std::unique_ptr <zw_value, zw_deleter> attrs
+	{zw_value_die_attributes_raw (&val, zw_throw_on_error {})};
+      for (size_t n = zw_value_seq_length (attrs.get ()), i = 0; i < n; ++i)
+	dump_attr (os << "\n\t", *zw_value_seq_at (attrs.get (), i),
+		   format::brief);
     }
 }
 
 void
-dumper::dump_attr (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_attr (std::ostream &os, zw_value const &val, format fmt) const
 {
-  static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "[value] swap label", zw_throw_on_error {})};
-  exec_query_on (val, *query,
-		 [&] (zw_stack const &stk) -> void
-		 {
-		   assert (zw_stack_depth (&stk) == 2);
-		   dump_value (os, *zw_stack_at (&stk, 0), format::brief);
+  Dwarf_Attribute attr = zw_value_attr_attr (&val);
+  dump_named_constant (os, dwarf_whatattr (&attr), *zw_cdom_dw_attr ());
 
-		   zw_value const *values = zw_stack_at (&stk, 1);
-		   assert (zw_value_is_seq (values));
+  std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
 
-		   switch (size_t n = zw_value_seq_length (values))
-		     {
-		     case 0:
-		       os << "\t<no value>";
-		       break;
-		     case 1:
-		       dump_value (os << "\t",
-				   *zw_value_seq_at (values, 0),
-				   format::brief);
-		       break;
-		     default:
-		       for (size_t i = 0; i < n; ++i)
-			 {
-			   os << (fmt == format::brief ? "\n\t\t" : "\n\t");
-			   dump_value (os, *zw_value_seq_at (values, i),
-				       format::brief);
-			 }
-		       break;
-		     }
-		 });
+  switch (size_t n = zw_value_seq_length (values.get ()))
+    {
+    case 0:
+      os << "\t<no value>";
+      break;
+    case 1:
+      dump_value (os << "\t", *zw_value_seq_at (values.get (), 0),
+		  format::brief);
+      break;
+    default:
+      for (size_t i = 0; i < n; ++i)
+	{
+	  os << (fmt == format::brief ? "\n\t\t" : "\n\t");
+	  dump_value (os, *zw_value_seq_at (values.get (), i),
+		      format::brief);
+	}
+      break;
+    }
 }
 
 void
-dumper::dump_llelem (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_llelem (std::ostream &os, zw_value const &val, format fmt) const
 {
   {
     ios_flag_saver ifs {os};
@@ -325,14 +370,11 @@ dumper::dump_llelem (std::ostream &os, zw_value const &val, format fmt)
        << zw_value_llelem_high (&val) << ":";
   }
 
-  static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "[elem]",
-			 zw_throw_on_error {})};
-  exec_query_on (val, *query,
-		 [&] (zw_stack const &stk) -> void
+  exec_query_on (val, *m_llelem_ops,
+		 [&] (zw_stack_view const &stk) -> void
 		 {
-		   assert (zw_stack_depth (&stk) == 2);
-		   zw_value const *ops = zw_stack_at (&stk, 0);
+		   assert (zw_stack_view_depth (&stk) == 2);
+		   zw_value const *ops = zw_stack_view_at (&stk, 0);
 		   assert (zw_value_is_seq (ops));
 
 		   if (size_t n = zw_value_seq_length (ops))
@@ -350,20 +392,16 @@ dumper::dump_llelem (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_llop (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_llop (std::ostream &os, zw_value const &val, format fmt) const
 {
   // We could get offset and label through zw_value_llop_op, but to
   // get values reliably and without duplication, we'd need to go
   // through Zwerg query "value" anyway.  So just do it all it one go.
-  static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "[offset, label, value]",
-			 zw_throw_on_error {})};
-
-  exec_query_on (val, *query,
-		 [&] (zw_stack const &stk) -> void
+  exec_query_on (val, *m_llop_properties,
+		 [&] (zw_stack_view const &stk) -> void
 		 {
-		   assert (zw_stack_depth (&stk) == 2);
-		   zw_value const *properties = zw_stack_at (&stk, 0);
+		   assert (zw_stack_view_depth (&stk) == 2);
+		   zw_value const *properties = zw_stack_view_at (&stk, 0);
 		   assert (zw_value_is_seq (properties));
 
 		   zw_value const *off = zw_value_seq_at (properties, 0);
@@ -384,7 +422,7 @@ dumper::dump_llop (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_aset (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_aset (std::ostream &os, zw_value const &val, format fmt) const
 {
   ios_flag_saver ifs {os};
   os << std::hex << std::showbase;
@@ -401,7 +439,8 @@ dumper::dump_aset (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_named_constant (std::ostream &os, unsigned v, zw_cdom const &dom)
+dumper::dump_named_constant (std::ostream &os, unsigned v,
+			     zw_cdom const &dom) const
 {
   std::unique_ptr <zw_value, zw_deleter> cst
 	{zw_value_init_const_u64 (v, &dom, 0, zw_throw_on_error {})};
@@ -412,7 +451,7 @@ dumper::dump_named_constant (std::ostream &os, unsigned v, zw_cdom const &dom)
 }
 
 void
-dumper::dump_elfsym (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_elfsym (std::ostream &os, zw_value const &val, format fmt) const
 {
   GElf_Sym sym = zw_value_elfsym_symbol (&val);
   os << zw_value_elfsym_symidx (&val) << ":\t";
@@ -440,7 +479,7 @@ dumper::dump_elfsym (std::ostream &os, zw_value const &val, format fmt)
 }
 
 void
-dumper::dump_value (std::ostream &os, zw_value const &val, format fmt)
+dumper::dump_value (std::ostream &os, zw_value const &val, format fmt) const
 {
   bool brackets;
   if (fmt == format::inner_brief)
@@ -483,6 +522,258 @@ dumper::dump_value (std::ostream &os, zw_value const &val, format fmt)
     os << ">";
 }
 
+void
+dumper::write_result (std::ostream &os, char const *fn,
+		      zw_stack_view const &stk) const
+{
+  if (fn != nullptr)
+    os << fn << ":\n";
+  if (zw_stack_view_depth (&stk) > 1)
+    os << "---\n";
+  for (size_t i = 0, n = zw_stack_view_depth (&stk); i < n; ++i)
+    {
+      auto const *val = zw_stack_view_at (&stk, i);
+      assert (val != nullptr);
+      dump_value (os, *val, format::full);
+      os << '\n';
+    }
+}
+
+void
+dumper::write_count (std::ostream &os, char const *fn, uint64_t count) const
+{
+  if (fn != nullptr)
+    os << fn << ":";
+  os << std::dec << count << '\n';
+}
+
+void
+dumper::write_error (std::ostream &os, std::string const &fn,
+		     char const *msg) const
+{
+  os << "dwgrep: " << (fn != "" ? fn : "<no-file>") << ": " << msg << '\n';
+}
+
+struct run_options
+{
+  int verbosity;
+  bool no_messages;
+  bool show_count;
+  uint64_t max_count;
+  bool with_filename;
+  unsigned nunit_jobs;
+  bool ordered;
+};
+
+enum class file_status
+  {
+    no_match,
+    match,
+    error,
+  };
+
+// Run QUERY over the file FN and write its results to OS.  An empty
+// FN stands for no input file.  When KEEP_RESULT is not null, the
+// result is stored there after it has been drained.
+file_status
+process_file (std::string const &fn, run_options const &opts,
+	      result_format const &fmt, zw_query const &query,
+	      zw_prepared_query &prepared, std::ostream &os,
+	      std::unique_ptr <zw_result, zw_deleter> *keep_result)
+{
+  try
+    {
+      std::unique_ptr <zw_stack, zw_deleter> stack
+	    {zw_stack_init (zw_throw_on_error {})};
+
+      if (fn != "")
+	{
+	  std::unique_ptr <zw_value, zw_deleter> dwv
+		{zw_value_init_dwarf (fn.c_str (), 0, zw_throw_on_error {})};
+
+	  zw_stack_push_take (stack.get (), dwv.get (), zw_throw_on_error {});
+	  dwv.release ();
+	}
+
+      // Profiles are only collected for queries run as a whole.
+      std::unique_ptr <zw_result, zw_deleter> result
+	    {opts.nunit_jobs > 0 && keep_result == nullptr
+	     ? zw_query_execute_units_parallel (&query, stack.get (),
+						opts.nunit_jobs, opts.ordered,
+						zw_throw_on_error {})
+	     : zw_prepared_query_execute (&prepared, stack.get (),
+					  zw_throw_on_error {})};
+
+      uint64_t count = 0;
+      if (opts.verbosity < 0 || opts.show_count)
+	{
+	  // Results are not shown, so they needn't be converted to
+	  // stacks.  grep: With -q, exit immediately with zero status
+	  // if any match is found, even if an error was detected.
+	  uint64_t limit = opts.verbosity < 0
+	    ? std::min <uint64_t> (opts.max_count, 1) : opts.max_count;
+	  zw_result_count (result.get (), limit, &count, zw_throw_on_error {});
+	  if (opts.verbosity < 0 && count > 0)
+	    return file_status::match;
+	}
+      else
+	{
+	  zw_stack_view const *out;
+	  while (count < opts.max_count
+		 && (out = zw_result_next_view (*result)) != nullptr)
+	    {
+	      ++count;
+	      fmt.write_result (os, opts.with_filename ? fn.c_str () : nullptr,
+				*out);
+	    }
+	}
+
+      if (opts.show_count)
+	fmt.write_count (os, opts.with_filename ? fn.c_str () : nullptr,
+			 count);
+
+      if (keep_result != nullptr)
+	*keep_result = std::move (result);
+
+      return count > 0 ? file_status::match : file_status::no_match;
+    }
+  catch (std::runtime_error const &e)
+    {
+      if (! opts.no_messages)
+	fmt.write_error (os, fn, e.what ());
+
+      return file_status::error;
+    }
+  catch (...)
+    {
+      os << "blah\n";
+      return file_status::no_match;
+    }
+}
+
+// Names of input files.  Those given on the command line come first,
+// followed by those read from a file list, one per line.
+class file_source
+{
+  std::vector <std::string> m_args;
+  size_t m_pos;
+  std::istream *m_list;
+
+public:
+  file_source (std::vector <std::string> args, std::istream *list)
+    : m_args {std::move (args)}
+    , m_pos {0}
+    , m_list {list}
+  {}
+
+  bool
+  next (std::string &fn)
+  {
+    if (m_pos < m_args.size ())
+      {
+	fn = m_args[m_pos++];
+	return true;
+      }
+
+    if (m_list != nullptr)
+      while (std::getline (*m_list, fn))
+	if (fn != "")
+	  return true;
+
+    return false;
+  }
+};
+
+// Process files from SRC on NJOBS threads.  Output of each file is
+// collected separately and handed to SINK as one block, in the order
+// in which the files were named.  Threads may get at most a
+// small number of files ahead of the first file whose output is still
+// pending, so that a single slow file doesn't make the others pile up.
+void
+process_files_parallel (file_source &src, unsigned njobs,
+			run_options const &opts, result_format const &fmt,
+			zw_query const &query, output_sink &sink,
+			bool &match, bool &errors)
+{
+  std::vector <std::unique_ptr <zw_prepared_query, zw_deleter>> prepared;
+  for (unsigned i = 0; i < njobs; ++i)
+    prepared.emplace_back (zw_query_prepare (&query, zw_throw_on_error {}));
+
+  size_t const window = 4 * njobs;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  size_t ntaken = 0;
+  size_t nwritten = 0;
+  bool quit = false;
+  std::map <size_t, std::pair <std::string, file_status>> done;
+
+  auto work = [&] (zw_prepared_query &prep)
+    {
+      while (true)
+	{
+	  std::string fn;
+	  size_t idx;
+	  {
+	    std::unique_lock <std::mutex> l {lock};
+	    cv.wait (l, [&] () {
+		return quit || ntaken < nwritten + window;
+	      });
+	    if (quit || ! src.next (fn))
+	      return;
+	    idx = ntaken++;
+	  }
+
+	  std::ostringstream os;
+	  file_status st = process_file (fn, opts, fmt, query, prep, os,
+					 nullptr);
+
+	  std::lock_guard <std::mutex> l {lock};
+	  done.emplace (idx, std::make_pair (os.str (), st));
+	  for (auto it = done.find (nwritten); it != done.end ();
+	       it = done.find (nwritten))
+	    {
+	      // The sink keeps the error for close to report.  There's
+	      // no point in processing further files, as their output
+	      // would be dropped.
+	      try
+		{
+		  sink.write (std::move (it->second.first));
+		}
+	      catch (std::system_error const &)
+		{
+		  quit = true;
+		  cv.notify_all ();
+		  return;
+		}
+
+	      if (it->second.second == file_status::match)
+		match = true;
+	      else if (it->second.second == file_status::error
+		       && opts.verbosity >= 0)
+		errors = true;
+	      done.erase (it);
+	      ++nwritten;
+	    }
+
+	  // Files that are still pending are not shown, so note the
+	  // match here.
+	  if (st == file_status::match && opts.verbosity < 0)
+	    {
+	      match = true;
+	      quit = true;
+	    }
+	  cv.notify_all ();
+	}
+    };
+
+  std::vector <std::thread> threads;
+  for (unsigned i = 0; i < njobs; ++i)
+    threads.emplace_back (work, std::ref (*prepared[i]));
+  for (auto &thr: threads)
+    thr.join ();
+}
+
 int
 main(int argc, char *argv[])
 try
@@ -496,8 +787,28 @@ try
     int verbosity = 0;
     bool no_messages = false;
     bool show_count = false;
+    uint64_t max_count = UINT64_MAX;
     bool with_filename = false;
     bool no_filename = false;
+    bool show_prof = false;
+    unsigned nunit_jobs = 0;
+    unsigned njobs = 1;
+    bool ordered = true;
+    char const *files_from_fn = nullptr;
+    bool use_writer = false;
+    char const *format_name = "text";
+
+    auto parse_jobs = [] (char const *arg, unsigned &ret)
+      {
+	char *end;
+	ret = strtoul (arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || ret == 0)
+	  {
+	    std::cerr << "Error: invalid number of jobs `" << arg << "'.\n";
+	    return false;
+	  }
+	return true;
+      };
 
     std::unique_ptr <zw_vocabulary, zw_deleter> voc
 	{zw_vocabulary_init (zw_throw_on_error {})};
@@ -528,6 +839,19 @@ try
 	    show_count = true;
 	    break;
 
+	  case 'm':
+	    {
+	      char *end;
+	      max_count = strtoull (optarg, &end, 10);
+	      if (*optarg == '\0' || *optarg == '-' || *end != '\0')
+		{
+		  std::cerr << "Error: invalid maximum count `"
+			    << optarg << "'.\n";
+		  return 2;
+		}
+	      break;
+	    }
+
 	  case 'H':
 	    with_filename = true;
 	    break;
@@ -544,6 +868,11 @@ try
 	    no_messages = true;
 	    break;
 
+	  case 'j':
+	    if (! parse_jobs (optarg, njobs))
+	      return 2;
+	    break;
+
 	  case 'f':
 	    {
 	      auto buf_to_string = [] (std::istream &is)
@@ -575,6 +904,37 @@ try
 		show_help (ext_options);
 		return 0;
 	      }
+	    else if (c == profile)
+	      {
+		show_prof = true;
+		break;
+	      }
+	    else if (c == unit_jobs)
+	      {
+		if (! parse_jobs (optarg, nunit_jobs))
+		  return 2;
+		break;
+	      }
+	    else if (c == files_from)
+	      {
+		files_from_fn = optarg;
+		break;
+	      }
+	    else if (c == writer)
+	      {
+		use_writer = true;
+		break;
+	      }
+	    else if (c == output_format)
+	      {
+		format_name = optarg;
+		break;
+	      }
+	    else if (c == unordered)
+	      {
+		ordered = false;
+		break;
+	      }
 	    else if (c == version)
 	      {
 		std::cout << "dwgrep "
@@ -607,93 +967,128 @@ try
 	      }
 	  } ()};
 
-    std::vector <char const *> to_process;
-    if (argc == 0)
+    std::ifstream files_from_ifs;
+    std::istream *files_from_is = nullptr;
+    if (files_from_fn != nullptr)
+      {
+	if (strcmp (files_from_fn, "-") != 0)
+	  {
+	    files_from_ifs.open (files_from_fn);
+	    if (files_from_ifs.fail ())
+	      {
+		std::cerr << "Error: can't open file list `"
+			  << files_from_fn << "'.\n";
+		return 2;
+	      }
+	    files_from_is = &files_from_ifs;
+	  }
+	else
+	  files_from_is = &std::cin;
+      }
+
+    std::vector <std::string> to_process;
+    if (argc == 0 && files_from_is == nullptr)
 	// No input files.
 	to_process.push_back ("");
     else
 	for (int i = 0; i < argc; ++i)
 	  to_process.push_back (argv[i]);
 
-    if (to_process.size () > 1)
+    // The number of files in a file list is not known up front.
+    if (to_process.size () > 1 || files_from_is != nullptr)
 	with_filename = true;
     if (no_filename)
 	with_filename = false;
 
+    run_options opts {verbosity, no_messages, show_count, max_count,
+		      with_filename, nunit_jobs, ordered};
+    file_source src {std::move (to_process), files_from_is};
+    std::unique_ptr <result_format> fmt;
+    if (strcmp (format_name, "text") == 0)
+      fmt = std::make_unique <dumper> (*voc);
+    else if (strcmp (format_name, "jsonl") == 0)
+      fmt = make_jsonl_format ();
+    else if (strcmp (format_name, "bin") == 0)
+      fmt = make_bin_format ();
+    else
+      {
+	std::cerr << "Error: unknown output format `" << format_name << "'.\n";
+	return 2;
+      }
+
     bool errors = false;
     bool match = false;
-    for (auto const &fn: to_process)
-      try
-	{
-	  std::unique_ptr <zw_stack, zw_deleter> stack
-		{zw_stack_init (zw_throw_on_error {})};
 
-	  if (fn[0] != '\0')
-	    {
-	      std::unique_ptr <zw_value, zw_deleter> dwv
-			{zw_value_init_dwarf (fn, 0, zw_throw_on_error {})};
+    // Results of a profiled query share the profile, so the last one
+    // is kept around to show it.
+    std::unique_ptr <zw_result, zw_deleter> last_result;
 
-	      zw_stack_push_take (stack.get (), dwv.get (),
-				  zw_throw_on_error {});
-	      dwv.release ();
-	    }
-	  dumper dump {*voc};
+    // Output bypasses std::cout.  It is collected in large chunks,
+    // which are written out either right away, or by a thread of
+    // their own.
+    std::unique_ptr <output_sink> sink;
+    if (use_writer)
+      sink = std::make_unique <writer_thread> (STDOUT_FILENO);
+    else
+      sink = std::make_unique <fd_sink> (STDOUT_FILENO);
 
-	  std::unique_ptr <zw_result, zw_deleter> result
-		{zw_query_execute (query.get (), stack.get (),
-				   zw_throw_on_error {})};
+    if (verbosity >= 0)
+      {
+	output_stream os {*sink};
+	fmt->write_header (os);
+      }
 
-	  uint64_t count = 0;
-	  while (auto out = zw_result_next (*result))
+    // A profile is only collected when files are processed one at a
+    // time.
+    if (njobs > 1 && ! show_prof)
+      process_files_parallel (src, njobs, opts, *fmt, *query, *sink,
+			      match, errors);
+    else
+      {
+	// The query is compiled once and reused for all input files.
+	std::unique_ptr <zw_prepared_query, zw_deleter> prepared
+	    {(show_prof ? zw_query_prepare_profiled : zw_query_prepare)
+		(query.get (), zw_throw_on_error {})};
+
+	output_stream os {*sink};
+	std::string fn;
+	while (src.next (fn))
+	  switch (process_file (fn, opts, *fmt, *query, *prepared, os,
+				show_prof ? &last_result : nullptr))
 	    {
+	    case file_status::match:
 	      // grep: Exit immediately with zero status if any match
 	      // is found, even if an error was detected.
 	      if (verbosity < 0)
 		return 0;
-
 	      match = true;
-	      if (! show_count)
-		{
-		  if (with_filename)
-		    std::cout << fn << ":\n";
-		  if (zw_stack_depth (out.get ()) > 1)
-		    std::cout << "---\n";
-		  for (size_t i = 0, n = zw_stack_depth (out.get ());
-		       i < n; ++i)
-		    {
-		      auto const *val = zw_stack_at (out.get (), i);
-		      assert (val != nullptr);
-		      dump.dump_value (std::cout, *val, dumper::format::full);
-		      std::cout << std::endl;
-		    }
-		}
-	      else
-		++count;
-	    }
+	      break;
 
-	  if (show_count)
-	    {
-	      if (with_filename)
-		std::cout << fn << ":";
-	      std::cout << std::dec << count << std::endl;
+	    case file_status::error:
+	      if (verbosity >= 0)
+		errors = true;
+	      break;
+
+	    case file_status::no_match:
+	      break;
 	    }
-	}
-      catch (std::runtime_error const &e)
-	{
-	  if (! no_messages)
-	    std::cout << "dwgrep: " << (fn[0] != '\0' ? fn : "<no-file>")
-		      << ": " << e.what () << std::endl;
+      }
 
-	  if (verbosity >= 0)
-	    errors = true;
+    // Let the writer finish before the profile is shown.
+    try
+      {
+	sink->close ();
+      }
+    catch (std::system_error const &e)
+      {
+	std::cerr << "dwgrep: error writing output: " << e.what ()
+		  << std::endl;
+	return 2;
+      }
+    sink = nullptr;
 
-	  continue;
-	}
-      catch (...)
-	{
-	  std::cout << "blah\n";
-	  continue;
-	}
+    if (last_result != nullptr)
+      show_profile (*last_result);
 
     if (errors)
 	return 2;
@@ -0,0 +1,293 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cassert>
+#include <cstring>
+
+#include "binfmt.hh"
+#include "format.hh"
+#include "libzwerg.hh"
+#include "libzwerg-dw.h"
+#include "libzwerg/std-memory.hh"
+
+namespace
+{
+  // Records are assembled in a buffer, because their length goes
+  // first.
+  class record_buf
+  {
+    std::string m_buf;
+
+  public:
+    explicit record_buf (binfmt::record_kind kind)
+    {
+      u32 (0);
+      u8 (static_cast <uint8_t> (kind));
+    }
+
+    template <class T>
+    void
+    le (T v)
+    {
+      char bytes[sizeof (T)];
+      for (size_t i = 0; i < sizeof (T); ++i)
+	bytes[i] = static_cast <char> (v >> (8 * i));
+      m_buf.append (bytes, sizeof (T));
+    }
+
+    void u8 (uint8_t v) { m_buf += static_cast <char> (v); }
+    void u32 (uint32_t v) { le (v); }
+    void u64 (uint64_t v) { le (v); }
+
+    void
+    type (binfmt::value_type t)
+    {
+      u8 (static_cast <uint8_t> (t));
+    }
+
+    void
+    str (char const *buf, size_t len)
+    {
+      u32 (len);
+      m_buf.append (buf, len);
+    }
+
+    void
+    str (char const *s)
+    {
+      str (s, strlen (s));
+    }
+
+    // Fill in the length and write the record out.
+    void
+    finish (std::ostream &os)
+    {
+      uint32_t len = m_buf.size () - 4;
+      for (size_t i = 0; i < 4; ++i)
+	m_buf[i] = static_cast <char> (len >> (8 * i));
+      os.write (m_buf.data (), m_buf.size ());
+    }
+  };
+
+  class bin_format
+    : public result_format
+  {
+    void write_value (record_buf &rb, zw_value const &val, bool top) const;
+    void write_attr (record_buf &rb, zw_value const &val) const;
+    void write_llop (record_buf &rb, Dwarf_Op const &op) const;
+
+  public:
+    void write_header (std::ostream &os) const override;
+    void write_result (std::ostream &os, char const *fn,
+		       zw_stack_view const &stk) const override;
+    void write_count (std::ostream &os, char const *fn,
+		      uint64_t count) const override;
+    void write_error (std::ostream &os, std::string const &fn,
+		      char const *msg) const override;
+  };
+
+  void
+  bin_format::write_attr (record_buf &rb, zw_value const &val) const
+  {
+    Dwarf_Attribute at = zw_value_attr_attr (&val);
+    rb.u32 (dwarf_whatattr (&at));
+    rb.u32 (dwarf_whatform (&at));
+
+    std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
+    size_t n = zw_value_seq_length (values.get ());
+    rb.u32 (n);
+    for (size_t i = 0; i < n; ++i)
+      write_value (rb, *zw_value_seq_at (values.get (), i), false);
+  }
+
+  void
+  bin_format::write_llop (record_buf &rb, Dwarf_Op const &op) const
+  {
+    rb.u64 (op.offset);
+    rb.u8 (op.atom);
+    rb.u64 (op.number);
+    rb.u64 (op.number2);
+  }
+
+  void
+  bin_format::write_value (record_buf &rb, zw_value const &val,
+			   bool top) const
+  {
+    using binfmt::value_type;
+
+    if (zw_value_is_const (&val))
+      {
+	rb.type (value_type::cst);
+	bool is_signed = zw_value_const_is_signed (&val);
+	rb.u8 (is_signed);
+	rb.u64 (is_signed ? static_cast <uint64_t> (zw_value_const_i64 (&val))
+		: zw_value_const_u64 (&val));
+	rb.str (zw_cdom_name (zw_value_const_dom (&val)));
+      }
+    else if (zw_value_is_str (&val))
+      {
+	size_t len;
+	char const *buf = zw_value_str_str (&val, &len);
+	rb.type (value_type::str);
+	rb.str (buf, len);
+      }
+    else if (zw_value_is_seq (&val))
+      {
+	rb.type (value_type::seq);
+	size_t n = zw_value_seq_length (&val);
+	rb.u32 (n);
+	for (size_t i = 0; i < n; ++i)
+	  write_value (rb, *zw_value_seq_at (&val, i), false);
+      }
+    else if (zw_value_is_dwarf (&val))
+      {
+	rb.type (value_type::dwarf);
+	rb.str (zw_value_dwarf_name (&val));
+      }
+    else if (zw_value_is_cu (&val))
+      {
+	rb.type (value_type::cu);
+	rb.u64 (zw_value_cu_offset (&val));
+      }
+    else if (zw_value_is_die (&val))
+      {
+	Dwarf_Die die = zw_value_die_die (&val);
+	rb.type (value_type::die);
+	rb.u64 (dwarf_dieoffset (&die));
+	rb.u32 (dwarf_tag (&die));
+	if (top)
+	  {
+	    std::unique_ptr <zw_value, zw_deleter> attrs
+		{zw_value_die_attributes_raw (&val, zw_throw_on_error {})};
+	    size_t n = zw_value_seq_length (attrs.get ());
+	    rb.u32 (n);
+	    for (size_t i = 0; i < n; ++i)
+	      write_attr (rb, *zw_value_seq_at (attrs.get (), i));
+	  }
+	else
+	  rb.u32 (0);
+      }
+    else if (zw_value_is_attr (&val))
+      {
+	rb.type (value_type::attr);
+	write_attr (rb, val);
+      }
+    else if (zw_value_is_llelem (&val))
+      {
+	rb.type (value_type::llelem);
+	rb.u64 (zw_value_llelem_low (&val));
+	rb.u64 (zw_value_llelem_high (&val));
+	size_t n;
+	Dwarf_Op *ops = zw_value_llelem_expr (&val, &n);
+	rb.u32 (n);
+	for (size_t i = 0; i < n; ++i)
+	  write_llop (rb, ops[i]);
+      }
+    else if (zw_value_is_llop (&val))
+      {
+	rb.type (value_type::llop);
+	write_llop (rb, *zw_value_llop_op (&val));
+      }
+    else if (zw_value_is_aset (&val))
+      {
+	rb.type (value_type::aset);
+	size_t n = zw_value_aset_length (&val);
+	rb.u32 (n);
+	for (size_t i = 0; i < n; ++i)
+	  {
+	    zw_aset_pair p = zw_value_aset_at (&val, i);
+	    rb.u64 (p.start);
+	    rb.u64 (p.length);
+	  }
+      }
+    else if (zw_value_is_elfsym (&val))
+      {
+	GElf_Sym sym = zw_value_elfsym_symbol (&val);
+	rb.type (value_type::elfsym);
+	rb.u32 (zw_value_elfsym_symidx (&val));
+	rb.u64 (sym.st_value);
+	rb.u64 (sym.st_size);
+	rb.u8 (sym.st_info);
+	rb.u8 (sym.st_other);
+	rb.str (zw_value_elfsym_name (&val));
+      }
+    else
+      rb.type (value_type::unknown);
+  }
+
+  void
+  bin_format::write_header (std::ostream &os) const
+  {
+    os.write (binfmt::magic, sizeof binfmt::magic);
+  }
+
+  void
+  bin_format::write_result (std::ostream &os, char const *fn,
+			    zw_stack_view const &stk) const
+  {
+    record_buf rb {binfmt::record_kind::result};
+    rb.str (fn != nullptr ? fn : "");
+
+    size_t n = zw_stack_view_depth (&stk);
+    rb.u32 (n);
+    for (size_t i = 0; i < n; ++i)
+      {
+	auto const *val = zw_stack_view_at (&stk, i);
+	assert (val != nullptr);
+	write_value (rb, *val, true);
+      }
+    rb.finish (os);
+  }
+
+  void
+  bin_format::write_count (std::ostream &os, char const *fn,
+			   uint64_t count) const
+  {
+    record_buf rb {binfmt::record_kind::count};
+    rb.str (fn != nullptr ? fn : "");
+    rb.u64 (count);
+    rb.finish (os);
+  }
+
+  void
+  bin_format::write_error (std::ostream &os, std::string const &fn,
+			   char const *msg) const
+  {
+    record_buf rb {binfmt::record_kind::error};
+    rb.str (fn.c_str (), fn.length ());
+    rb.str (msg);
+    rb.finish (os);
+  }
+}
+
+std::unique_ptr <result_format>
+make_bin_format ()
+{
+  return std::make_unique <bin_format> ();
+}
@@ -0,0 +1,284 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cassert>
+#include <cstring>
+
+#include "format.hh"
+#include "libzwerg.hh"
+#include "libzwerg-dw.h"
+#include "libzwerg/std-memory.hh"
+
+namespace
+{
+  void
+  write_json_string (std::ostream &os, char const *buf, size_t len)
+  {
+    static char const hex[] = "0123456789abcdef";
+
+    os << '"';
+    size_t run = 0;
+    for (size_t i = 0; i < len; ++i)
+      {
+	unsigned char c = buf[i];
+	if (c >= 0x20 && c != '"' && c != '\\')
+	  continue;
+
+	os.write (buf + run, i - run);
+	run = i + 1;
+
+	switch (c)
+	  {
+	  case '"':  os << "\\\""; break;
+	  case '\\': os << "\\\\"; break;
+	  case '\b': os << "\\b"; break;
+	  case '\f': os << "\\f"; break;
+	  case '\n': os << "\\n"; break;
+	  case '\r': os << "\\r"; break;
+	  case '\t': os << "\\t"; break;
+	  default:
+	    os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+	  }
+      }
+    os.write (buf + run, len - run);
+    os << '"';
+  }
+
+  void
+  write_json_string (std::ostream &os, char const *str)
+  {
+    write_json_string (os, str, strlen (str));
+  }
+
+  class jsonl_format
+    : public result_format
+  {
+    void write_value (std::ostream &os, zw_value const &val, bool top) const;
+    void write_attr (std::ostream &os, zw_value const &val) const;
+    void write_llop (std::ostream &os, Dwarf_Op const &op) const;
+    void write_file (std::ostream &os, char const *fn) const;
+
+  public:
+    void write_result (std::ostream &os, char const *fn,
+		       zw_stack_view const &stk) const override;
+    void write_count (std::ostream &os, char const *fn,
+		      uint64_t count) const override;
+    void write_error (std::ostream &os, std::string const &fn,
+		      char const *msg) const override;
+  };
+
+  void
+  jsonl_format::write_attr (std::ostream &os, zw_value const &val) const
+  {
+    Dwarf_Attribute at = zw_value_attr_attr (&val);
+    os << "{\"type\":\"attr\",\"name\":" << dwarf_whatattr (&at)
+       << ",\"form\":" << dwarf_whatform (&at) << ",\"values\":[";
+
+    std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
+    for (size_t n = zw_value_seq_length (values.get ()), i = 0; i < n; ++i)
+      {
+	if (i > 0)
+	  os << ',';
+	write_value (os, *zw_value_seq_at (values.get (), i), false);
+      }
+    os << "]}";
+  }
+
+  void
+  jsonl_format::write_llop (std::ostream &os, Dwarf_Op const &op) const
+  {
+    os << "{\"type\":\"llop\",\"offset\":" << op.offset
+       << ",\"atom\":" << unsigned (op.atom)
+       << ",\"number\":" << op.number
+       << ",\"number2\":" << op.number2 << '}';
+  }
+
+  // Only DIE's at the top of a result list their attributes, like
+  // they do in the text output.
+  void
+  jsonl_format::write_value (std::ostream &os, zw_value const &val,
+			     bool top) const
+  {
+    if (zw_value_is_const (&val))
+      {
+	os << "{\"type\":\"cst\",\"dom\":";
+	write_json_string (os, zw_cdom_name (zw_value_const_dom (&val)));
+	os << ",\"value\":";
+	if (zw_value_const_is_signed (&val))
+	  os << zw_value_const_i64 (&val);
+	else
+	  os << zw_value_const_u64 (&val);
+	os << '}';
+      }
+    else if (zw_value_is_str (&val))
+      {
+	size_t len;
+	char const *buf = zw_value_str_str (&val, &len);
+	os << "{\"type\":\"str\",\"value\":";
+	write_json_string (os, buf, len);
+	os << '}';
+      }
+    else if (zw_value_is_seq (&val))
+      {
+	os << "{\"type\":\"seq\",\"value\":[";
+	for (size_t n = zw_value_seq_length (&val), i = 0; i < n; ++i)
+	  {
+	    if (i > 0)
+	      os << ',';
+	    write_value (os, *zw_value_seq_at (&val, i), false);
+	  }
+	os << "]}";
+      }
+    else if (zw_value_is_dwarf (&val))
+      {
+	os << "{\"type\":\"dwarf\",\"name\":";
+	write_json_string (os, zw_value_dwarf_name (&val));
+	os << '}';
+      }
+    else if (zw_value_is_cu (&val))
+      os << "{\"type\":\"cu\",\"offset\":" << zw_value_cu_offset (&val) << '}';
+    else if (zw_value_is_die (&val))
+      {
+	Dwarf_Die die = zw_value_die_die (&val);
+	os << "{\"type\":\"die\",\"offset\":" << dwarf_dieoffset (&die)
+	   << ",\"tag\":" << dwarf_tag (&die);
+	if (top)
+	  {
+	    os << ",\"attributes\":[";
+	    std::unique_ptr <zw_value, zw_deleter> attrs
+		{zw_value_die_attributes_raw (&val, zw_throw_on_error {})};
+	    for (size_t n = zw_value_seq_length (attrs.get ()), i = 0;
+		 i < n; ++i)
+	      {
+		if (i > 0)
+		  os << ',';
+		write_attr (os, *zw_value_seq_at (attrs.get (), i));
+	      }
+	    os << ']';
+	  }
+	os << '}';
+      }
+    else if (zw_value_is_attr (&val))
+      write_attr (os, val);
+    else if (zw_value_is_llelem (&val))
+      {
+	os << "{\"type\":\"llelem\",\"low\":" << zw_value_llelem_low (&val)
+	   << ",\"high\":" << zw_value_llelem_high (&val) << ",\"ops\":[";
+	size_t n;
+	Dwarf_Op *ops = zw_value_llelem_expr (&val, &n);
+	for (size_t i = 0; i < n; ++i)
+	  {
+	    if (i > 0)
+	      os << ',';
+	    write_llop (os, ops[i]);
+	  }
+	os << "]}";
+      }
+    else if (zw_value_is_llop (&val))
+      write_llop (os, *zw_value_llop_op (&val));
+    else if (zw_value_is_aset (&val))
+      {
+	os << "{\"type\":\"aset\",\"ranges\":[";
+	for (size_t n = zw_value_aset_length (&val), i = 0; i < n; ++i)
+	  {
+	    zw_aset_pair p = zw_value_aset_at (&val, i);
+	    os << (i > 0 ? ",[" : "[") << p.start << ',' << p.length << ']';
+	  }
+	os << "]}";
+      }
+    else if (zw_value_is_elfsym (&val))
+      {
+	GElf_Sym sym = zw_value_elfsym_symbol (&val);
+	os << "{\"type\":\"elfsym\",\"index\":"
+	   << zw_value_elfsym_symidx (&val)
+	   << ",\"value\":" << sym.st_value << ",\"size\":" << sym.st_size
+	   << ",\"info\":" << unsigned (sym.st_info)
+	   << ",\"other\":" << unsigned (sym.st_other) << ",\"name\":";
+	write_json_string (os, zw_value_elfsym_name (&val));
+	os << '}';
+      }
+    else
+      os << "{\"type\":\"unknown\"}";
+  }
+
+  void
+  jsonl_format::write_file (std::ostream &os, char const *fn) const
+  {
+    if (fn != nullptr)
+      {
+	os << "\"file\":";
+	write_json_string (os, fn);
+	os << ',';
+      }
+  }
+
+  void
+  jsonl_format::write_result (std::ostream &os, char const *fn,
+			      zw_stack_view const &stk) const
+  {
+    os << '{';
+    write_file (os, fn);
+    os << "\"values\":[";
+    for (size_t i = 0, n = zw_stack_view_depth (&stk); i < n; ++i)
+      {
+	auto const *val = zw_stack_view_at (&stk, i);
+	assert (val != nullptr);
+	if (i > 0)
+	  os << ',';
+	write_value (os, *val, true);
+      }
+    os << "]}\n";
+  }
+
+  void
+  jsonl_format::write_count (std::ostream &os, char const *fn,
+			     uint64_t count) const
+  {
+    os << '{';
+    write_file (os, fn);
+    os << "\"count\":" << count << "}\n";
+  }
+
+  void
+  jsonl_format::write_error (std::ostream &os, std::string const &fn,
+			     char const *msg) const
+  {
+    os << '{';
+    write_file (os, fn != "" ? fn.c_str () : nullptr);
+    os << "\"error\":";
+    write_json_string (os, msg);
+    os << "}\n";
+  }
+}
+
+std::unique_ptr <result_format>
+make_jsonl_format ()
+{
+  return std::make_unique <jsonl_format> ();
+}
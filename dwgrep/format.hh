@@ -0,0 +1,71 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "libzwerg.h"
+
+// How query results are written out.  A format doesn't change once it
+// is constructed, and one format is shared by all threads.
+class result_format
+{
+public:
+  virtual ~result_format () {}
+
+  // Write whatever precedes all records.  This is called once, before
+  // any input file is processed.
+  virtual void write_header (std::ostream &os) const {}
+
+  // Write one result of a query.  FN is NULL unless file names are
+  // shown.
+  virtual void write_result (std::ostream &os, char const *fn,
+			     zw_stack_view const &stk) const = 0;
+
+  // Write number of results for -c.  FN is as above.
+  virtual void write_count (std::ostream &os, char const *fn,
+			    uint64_t count) const = 0;
+
+  // Write an error message MSG about file FN.  FN is empty if there
+  // was no input file.
+  virtual void write_error (std::ostream &os, std::string const &fn,
+			    char const *msg) const = 0;
+};
+
+// One JSON object per line.
+std::unique_ptr <result_format> make_jsonl_format ();
+
+// Length-prefixed binary records as described in binfmt.hh.
+std::unique_ptr <result_format> make_bin_format ();
+
+#endif /* _FORMAT_H_ */
@@ -53,7 +53,8 @@ merge_options (std::vector <ext_option> const &ext_opts)
   return opts;
 }
 
-ext_shopt help, version;
+ext_shopt help, version, profile, unit_jobs, unordered, files_from, writer,
+  output_format;
 
 std::vector <ext_option> ext_options = {
   {'q', "silent", ext_argument::no, ""},
@@ -88,6 +89,14 @@ std::vector <ext_option> ext_options = {
 	Print only a count of query results, not the results
 	themselves.
 
+)docstring"},
+
+  {'m', "max-count", ext_argument::required ("NUM"), R"docstring(
+
+	Stop processing a file after *NUM* results.  The query is not
+	asked for further results, so the rest of the file is not
+	looked at.  With ``-c``, counts stop at *NUM*.
+
 )docstring"},
 
   {'H', "with-filename", ext_argument::no,  R"docstring(
@@ -110,6 +119,76 @@ std::vector <ext_option> ext_options = {
 	file is read and run over the input file(s).  At most one
 	``-e`` or ``-f`` option shall be present.
 
+)docstring"},
+
+  {'j', "jobs", ext_argument::required ("NUM"), R"docstring(
+
+	Process up to *NUM* input files at a time, each on its own
+	thread.  Output of each file is written as one block once that
+	file is done, and blocks are written in the order in which the
+	files were named.  This option has no effect together with
+	``--profile``.
+
+)docstring"},
+
+  {files_from, "files-from", ext_argument::required ("FILE"), R"docstring(
+
+	Read names of further input files from *FILE*, one per line.
+	If *FILE* is ``-``, the names are read from standard input.
+	Files named on the command line are processed first.  Filename
+	is printed for each match, unless ``-h`` is given.
+
+)docstring"},
+
+  {output_format, "format", ext_argument::required ("FMT"), R"docstring(
+
+	Write results in format *FMT*.  ``text`` (the default) is the
+	human-readable output.  ``jsonl`` writes one JSON object per
+	result, count or error, each on a line of its own.  ``bin``
+	writes length-prefixed binary records.  Their layout is
+	described in the header ``dwgrep/binfmt.hh``, which also
+	provides a reader.
+
+)docstring"},
+
+  {writer, "writer-thread", ext_argument::no, R"docstring(
+
+	Write output on a separate thread.  Output is always collected
+	in large chunks before it is written.  With this option, the
+	chunks are written by a thread of its own, so that formatting
+	and query execution go on while output is being written.
+
+)docstring"},
+
+  {unit_jobs, "unit-jobs", ext_argument::required ("NUM"), R"docstring(
+
+	Run the query over units of each input file on *NUM* threads.
+	This applies to queries that start with ``unit`` or ``entry``,
+	other queries run as usual.  Results are shown in the same
+	order as without this option, unless ``--unordered`` is given
+	as well.  Positions of DIE's that ``entry`` yields are counted
+	anew in each unit, so queries that start with ``entry`` and use
+	``pos`` are not split.
+
+)docstring"},
+
+  {unordered, "unordered", ext_argument::no, R"docstring(
+
+	With ``--unit-jobs``, show results of each unit as soon as that
+	unit is done, instead of in the order of units.
+
+)docstring"},
+
+  {profile, "profile", ext_argument::no, R"docstring(
+
+	Profile the query.  After all input files are processed, the
+	query is shown as a tree of the operations that it consists
+	of, each annotated with the number of times it was invoked,
+	the number of stacks it produced and copied, and the time
+	spent in it.  Exclusive time does not include time spent in
+	operations that the given operation pulled stacks from.  The
+	profile is written to standard error.
+
 )docstring"},
 
   {help, "help", ext_argument::no, R"docstring(
@@ -156,5 +156,6 @@ struct ext_option
 std::map <int, std::pair <std::vector <std::string>, std::string>>
 merge_options (std::vector <ext_option> const &ext_opts);
 
-extern ext_shopt help, version;
+extern ext_shopt help, version, profile, unit_jobs, unordered, files_from,
+  writer, output_format;
 extern std::vector <ext_option> ext_options;
@@ -0,0 +1,220 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+
+#include "output.hh"
+
+void
+fd_sink::write (std::string chunk)
+{
+  if (m_error != nullptr)
+    std::rethrow_exception (m_error);
+
+  char const *buf = chunk.data ();
+  size_t len = chunk.size ();
+  while (len > 0)
+    {
+      ssize_t ret = ::write (m_fd, buf, len);
+      if (ret < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  m_error = std::make_exception_ptr
+	    (std::system_error (errno, std::system_category ()));
+	  std::rethrow_exception (m_error);
+	}
+      buf += ret;
+      len -= ret;
+    }
+}
+
+void
+fd_sink::close ()
+{
+  if (m_error != nullptr)
+    std::rethrow_exception (m_error);
+}
+
+writer_thread::writer_thread (int fd)
+  : m_fd {fd}
+  , m_ring (ring_size)
+  , m_head {0}
+  , m_tail {0}
+  , m_closed {false}
+  , m_sleepers {0}
+  , m_failed {false}
+  , m_thread {&writer_thread::run, this}
+{}
+
+writer_thread::~writer_thread ()
+{
+  if (m_thread.joinable ())
+    finish ();
+}
+
+void
+writer_thread::finish ()
+{
+  m_closed = true;
+  wake ();
+  m_thread.join ();
+}
+
+void
+writer_thread::close ()
+{
+  finish ();
+  if (m_failed)
+    std::rethrow_exception (m_error);
+}
+
+// Wait until PRED holds.  A thread that goes to sleep announces
+// itself in m_sleepers before it checks PRED for the last time, and a
+// thread that moves one of the ring ends checks m_sleepers after it
+// did.  Either the sleeper sees the move, or the mover sees the
+// sleeper and wakes it up.
+template <class Pred>
+void
+writer_thread::wait_until (Pred pred)
+{
+  for (int i = 0; i < 16; ++i)
+    if (pred ())
+      return;
+    else
+      std::this_thread::yield ();
+
+  std::unique_lock <std::mutex> lock {m_mutex};
+  ++m_sleepers;
+  m_cv.wait (lock, pred);
+  --m_sleepers;
+}
+
+void
+writer_thread::wake ()
+{
+  if (m_sleepers != 0)
+    {
+      std::lock_guard <std::mutex> lock {m_mutex};
+      m_cv.notify_all ();
+    }
+}
+
+void
+writer_thread::write (std::string chunk)
+{
+  if (m_failed)
+    std::rethrow_exception (m_error);
+
+  size_t tail = m_tail;
+  wait_until ([&] () { return tail - m_head < ring_size; });
+  m_ring[tail % ring_size] = std::move (chunk);
+  m_tail = tail + 1;
+  wake ();
+}
+
+void
+writer_thread::run ()
+{
+  fd_sink out {m_fd};
+  for (size_t head = m_head; ; )
+    {
+      wait_until ([&] () { return m_tail != head || m_closed; });
+      if (m_tail == head)
+	return;
+
+      std::string chunk = std::move (m_ring[head % ring_size]);
+      m_head = ++head;
+      wake ();
+
+      // Once a write fails, the rest of the output is dropped, but
+      // the ring is still drained so that producers don't block.  The
+      // error is kept for write and close to report.
+      if (! m_failed)
+	try
+	  {
+	    out.write (std::move (chunk));
+	  }
+	catch (std::system_error const &)
+	  {
+	    m_error = std::current_exception ();
+	    m_failed = true;
+	  }
+    }
+}
+
+output_buffer::output_buffer (output_sink &sink, size_t size)
+  : m_sink (sink)
+  , m_buf (size)
+{
+  setp (m_buf.data (), m_buf.data () + m_buf.size ());
+}
+
+output_buffer::~output_buffer ()
+{
+  // Errors can't be reported from here.  Callers that care flush the
+  // stream first and check its state.
+  try
+    {
+      submit ();
+    }
+  catch (std::system_error const &)
+    {
+    }
+}
+
+void
+output_buffer::submit ()
+{
+  if (pptr () != pbase ())
+    {
+      m_sink.write (std::string (pbase (), pptr ()));
+      setp (m_buf.data (), m_buf.data () + m_buf.size ());
+    }
+}
+
+output_buffer::int_type
+output_buffer::overflow (int_type c)
+{
+  submit ();
+  if (! traits_type::eq_int_type (c, traits_type::eof ()))
+    {
+      *pptr () = traits_type::to_char_type (c);
+      pbump (1);
+    }
+  return traits_type::not_eof (c);
+}
+
+int
+output_buffer::sync ()
+{
+  submit ();
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where formatted output ends up.  Output is handed over in chunks,
+// each of which is written as a whole.  Chunks are written in the
+// order in which they are handed over, and write must not be called
+// from several threads at once.
+class output_sink
+{
+public:
+  virtual ~output_sink () {}
+  virtual void write (std::string chunk) = 0;
+
+  // Wait until all chunks are written, and throw if any write failed.
+  // Streams swallow exceptions that write throws and only note the
+  // failure in their state, so this is where write errors surface.
+  virtual void close () = 0;
+};
+
+// Writes chunks to a file descriptor as they come.
+class fd_sink
+  : public output_sink
+{
+  int m_fd;
+
+  // The error that the first failed write threw.  Later chunks are
+  // dropped.
+  std::exception_ptr m_error;
+
+public:
+  explicit fd_sink (int fd)
+    : m_fd {fd}
+  {}
+
+  void write (std::string chunk) override;
+  void close () override;
+};
+
+// Hands chunks over to a thread of its own that writes them to a
+// file descriptor, so that producers don't wait for the writes to
+// finish.  Chunks travel through a bounded ring whose ends are
+// atomic counters.  Threads only fall back to a mutex when they have
+// to sleep, because the ring is full or empty.
+class writer_thread
+  : public output_sink
+{
+  static size_t const ring_size = 64;
+
+  int m_fd;
+  std::vector <std::string> m_ring;
+  std::atomic <size_t> m_head;
+  std::atomic <size_t> m_tail;
+  std::atomic <bool> m_closed;
+
+  std::atomic <unsigned> m_sleepers;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+
+  // The error that the first failed write threw.  It is only set
+  // once, before m_failed.
+  std::exception_ptr m_error;
+  std::atomic <bool> m_failed;
+
+  std::thread m_thread;
+
+  template <class Pred> void wait_until (Pred pred);
+  void wake ();
+  void run ();
+  void finish ();
+
+public:
+  explicit writer_thread (int fd);
+
+  // Writes out chunks that are still queued before returning.  Write
+  // errors are only reported by close.
+  ~writer_thread ();
+
+  // Throws if a chunk written earlier failed to be written.
+  void write (std::string chunk) override;
+  void close () override;
+};
+
+// A stream buffer that collects output in a large buffer, and hands
+// it to a sink when the buffer fills up or the stream is flushed.
+class output_buffer
+  : public std::streambuf
+{
+  output_sink &m_sink;
+  std::vector <char> m_buf;
+
+  void submit ();
+
+protected:
+  int_type overflow (int_type c) override;
+  int sync () override;
+
+public:
+  explicit output_buffer (output_sink &sink, size_t size = 1 << 16);
+  ~output_buffer ();
+};
+
+class output_stream
+  : public std::ostream
+{
+  output_buffer m_buf;
+
+public:
+  explicit output_stream (output_sink &sink)
+    : std::ostream {nullptr}
+    , m_buf {sink}
+  {
+    rdbuf (&m_buf);
+  }
+
+  ~output_stream ()
+  {
+    flush ();
+  }
+};
+
+#endif /* _OUTPUT_H_ */
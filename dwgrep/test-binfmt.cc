@@ -0,0 +1,229 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dwarf.h>
+
+#include "binfmt.hh"
+#include "format.hh"
+#include "libzwerg.hh"
+#include "libzwerg-dw.h"
+
+extern std::string g_test_case_directory;
+
+namespace
+{
+  std::string
+  test_file (std::string name)
+  {
+    return g_test_case_directory + "/" + name;
+  }
+
+  int
+  collect_name (Dwarf_Attribute *at, void *data)
+  {
+    static_cast <std::vector <unsigned> *> (data)->push_back (at->code);
+    return DWARF_CB_OK;
+  }
+
+  // Names of attributes of DIE, in the order that they are stored.
+  std::vector <unsigned>
+  attr_names (Dwarf_Die die)
+  {
+    std::vector <unsigned> ret;
+    if (dwarf_getattrs (&die, &collect_name, &ret, 0) == -1)
+      throw std::runtime_error (dwarf_errmsg (-1));
+    return ret;
+  }
+
+  binfmt::value_type
+  peek_type (binfmt::cursor c)
+  {
+    return static_cast <binfmt::value_type> (c.u8 ());
+  }
+
+  struct BinfmtTest
+    : public testing::Test
+  {
+    std::unique_ptr <zw_vocabulary, zw_deleter> voc;
+    std::unique_ptr <zw_value, zw_deleter> dwarf;
+    std::unique_ptr <result_format> fmt;
+
+    void
+    SetUp () override final
+    {
+      voc.reset (zw_vocabulary_init (zw_throw_on_error {}));
+      zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+			 zw_throw_on_error {});
+      zw_vocabulary_add (voc.get (),
+			 zw_vocabulary_dwarf (zw_throw_on_error {}),
+			 zw_throw_on_error {});
+      dwarf.reset (zw_value_init_dwarf (test_file ("twocus").c_str (), 0,
+					zw_throw_on_error {}));
+      fmt = make_bin_format ();
+    }
+
+    // Run Q on the test binary and write its results to OS.  Call F
+    // with each result before it is written.
+    template <class F>
+    void
+    write_results (std::ostream &os, char const *q, F f)
+    {
+      std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), q, zw_throw_on_error {})};
+      std::unique_ptr <zw_stack, zw_deleter> input
+	{zw_stack_init (zw_throw_on_error {})};
+      zw_stack_push (input.get (), dwarf.get (), zw_throw_on_error {});
+
+      std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (query.get (), input.get (),
+			   zw_throw_on_error {})};
+      while (auto view = zw_result_next_view (*result))
+	{
+	  f (*view);
+	  fmt->write_result (os, nullptr, *view);
+	}
+    }
+  };
+}
+
+TEST_F (BinfmtTest, dies_read_back)
+{
+  struct expect
+  {
+    Dwarf_Off off;
+    int tag;
+    std::vector <unsigned> names;
+  };
+  std::vector <expect> want;
+
+  std::ostringstream os;
+  fmt->write_header (os);
+  write_results (os, "entry", [&] (zw_stack_view const &view)
+    {
+      Dwarf_Die die = zw_value_die_die (zw_stack_view_at (&view, 0));
+      want.push_back ({dwarf_dieoffset (&die), dwarf_tag (&die),
+		       attr_names (die)});
+    });
+  fmt->write_count (os, "twocus", want.size ());
+  ASSERT_LT (0u, want.size ());
+
+  std::string out = os.str ();
+  binfmt::reader rd {out.data (), out.size ()};
+  binfmt::record rec;
+  for (auto const &w: want)
+    {
+      ASSERT_TRUE (rd.next (rec));
+      ASSERT_EQ (binfmt::record_kind::result, rec.kind);
+      EXPECT_EQ (0u, rec.file.second);
+
+      binfmt::cursor &c = rec.payload;
+      ASSERT_EQ (1u, c.u32 ());
+      ASSERT_EQ (binfmt::value_type::die, peek_type (c));
+      c.u8 ();
+      EXPECT_EQ (w.off, c.u64 ());
+      EXPECT_EQ (w.tag, (int) c.u32 ());
+
+      uint32_t n = c.u32 ();
+      ASSERT_EQ (w.names.size (), n);
+      for (uint32_t i = 0; i < n; ++i)
+	{
+	  EXPECT_EQ (w.names[i], c.u32 ());
+	  c.u32 ();
+	  for (uint32_t m = c.u32 (), j = 0; j < m; ++j)
+	    binfmt::skip_value (c);
+	}
+      EXPECT_TRUE (c.at_end ());
+    }
+
+  ASSERT_TRUE (rd.next (rec));
+  ASSERT_EQ (binfmt::record_kind::count, rec.kind);
+  EXPECT_EQ ("twocus", std::string (rec.file.first, rec.file.second));
+  EXPECT_EQ (want.size (), rec.payload.u64 ());
+  EXPECT_FALSE (rd.next (rec));
+}
+
+TEST_F (BinfmtTest, values_skipped)
+{
+  // Each result holds a CU, an attribute and a sequence with a
+  // constant, a string and a DIE, TOS last.
+  std::ostringstream os;
+  fmt->write_header (os);
+  size_t count = 0;
+  write_results (os, "entry (offset == 0x80) dup unit swap attribute "
+		 "[1, \"x\", drop root]",
+		 [&] (zw_stack_view const &) { ++count; });
+  fmt->write_error (os, "twocus", "oops");
+  ASSERT_LT (0u, count);
+
+  std::string out = os.str ();
+  binfmt::reader rd {out.data (), out.size ()};
+  binfmt::record rec;
+  for (size_t i = 0; i < count; ++i)
+    {
+      ASSERT_TRUE (rd.next (rec));
+      ASSERT_EQ (binfmt::record_kind::result, rec.kind);
+
+      binfmt::cursor &c = rec.payload;
+      ASSERT_EQ (3u, c.u32 ());
+
+      ASSERT_EQ (binfmt::value_type::seq, peek_type (c));
+      c.u8 ();
+      ASSERT_EQ (3u, c.u32 ());
+      EXPECT_EQ (binfmt::value_type::cst, peek_type (c));
+      binfmt::skip_value (c);
+      EXPECT_EQ (binfmt::value_type::str, peek_type (c));
+      binfmt::skip_value (c);
+
+      // DIE's nested in other values don't list their attributes.
+      ASSERT_EQ (binfmt::value_type::die, peek_type (c));
+      c.u8 ();
+      EXPECT_EQ (0x5eu, c.u64 ());
+      EXPECT_EQ (DW_TAG_compile_unit, (int) c.u32 ());
+      EXPECT_EQ (0u, c.u32 ());
+
+      EXPECT_EQ (binfmt::value_type::attr, peek_type (c));
+      binfmt::skip_value (c);
+      EXPECT_EQ (binfmt::value_type::cu, peek_type (c));
+      binfmt::skip_value (c);
+      EXPECT_TRUE (c.at_end ());
+    }
+
+  ASSERT_TRUE (rd.next (rec));
+  ASSERT_EQ (binfmt::record_kind::error, rec.kind);
+  auto msg = rec.payload.str ();
+  EXPECT_EQ ("oops", std::string (msg.first, msg.second));
+  EXPECT_FALSE (rd.next (rec));
+
+  // Truncated output is detected.
+  binfmt::reader trunc {out.data (), out.size () - 1};
+  EXPECT_THROW ({ while (trunc.next (rec)) {} }, std::runtime_error);
+}
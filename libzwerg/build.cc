@@ -27,18 +27,61 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
+#include "builtin-cst.hh"
 #include "op.hh"
+#include "overload.hh"
+#include "profile.hh"
 #include "scope.hh"
 #include "tree.hh"
+#include "value-closure.hh"
 #include "value-cst.hh"
 #include "value-seq.hh"
 #include "value-str.hh"
 
 std::unique_ptr <pred>
 tree::build_pred () const
+{
+  auto prof = profile::building ();
+  if (prof == nullptr)
+    return do_build_pred ();
+
+  size_t idx = prof->enter (*this, true);
+  auto ret = do_build_pred ();
+  prof->leave (idx, ret != nullptr);
+  if (ret == nullptr)
+    return nullptr;
+  return profile::instrument (prof, idx, std::move (ret));
+}
+
+std::shared_ptr <op>
+tree::build_exec (std::shared_ptr <op> upstream) const
+{
+  auto prof = profile::building ();
+
+  // CAT only threads the ops of its children together, and what it
+  // returns is the op of its last child.
+  if (prof == nullptr || m_tt == tree_type::CAT)
+    return do_build_exec (upstream);
+
+  size_t idx = prof->enter (*this, false);
+  auto ret = do_build_exec (upstream);
+  prof->leave (idx, true);
+
+  // Builtin predicates are built as assertions, and the predicate
+  // itself has an entry of its own.
+  if (m_tt == tree_type::F_BUILTIN
+      && std::dynamic_pointer_cast <op_assert> (ret) != nullptr)
+    prof->rename (idx, "assert");
+
+  return profile::instrument (prof, idx, ret);
+}
+
+std::unique_ptr <pred>
+tree::do_build_pred () const
 {
   switch (m_tt)
     {
@@ -103,7 +146,7 @@ tree::build_pred () const
 }
 
 std::shared_ptr <op>
-tree::build_exec (std::shared_ptr <op> upstream) const
+tree::do_build_exec (std::shared_ptr <op> upstream) const
 {
   if (upstream == nullptr)
     upstream = std::make_shared <op_origin> (std::make_unique <stack> ());
@@ -286,3 +329,486 @@ tree::build_exec (std::shared_ptr <op> upstream) const
 
   abort ();
 }
+
+namespace
+{
+  // Walk a tree and compute profiles of stacks that flow through it.
+  // Where PEG, also peg overloads and check that the stack is never
+  // underrun.  The profiles are computed conservatively, so that a
+  // pegged overload is always the one that dynamic dispatch would
+  // have selected.
+  //
+  // Each node is visited with PEG set exactly once.  Before that, the
+  // body of a closure may be visited several times while looking for
+  // a profile that covers all its iterations.
+  struct peg_pass
+  {
+    bool m_proven;
+
+    peg_pass ()
+      : m_proven {true}
+    {}
+
+    void
+    need (static_profile const &profile, size_t n, bool peg)
+    {
+      if (peg && n > profile.size ())
+	m_proven = false;
+    }
+
+    static_profile
+    unknown (bool peg)
+    {
+      if (peg)
+	m_proven = false;
+      return {};
+    }
+
+    static_profile
+    builtin_effect (tree &t, static_profile const &profile, bool peg)
+    {
+      if (auto ob = std::dynamic_pointer_cast <overloaded_builtin const>
+			(t.m_builtin))
+	{
+	  auto found = ob->get_overload_tab ()->find_static (profile);
+	  auto const &ovls = found.first;
+
+	  if (! found.second || ovls.size () != 1)
+	    {
+	      // Left for dynamic dispatch.  Any of the candidates may
+	      // end up being selected.
+	      if (peg)
+		m_proven = false;
+
+	      if (ovls.empty ())
+		return {};
+
+	      static_profile ret;
+	      for (size_t i = 0; i < ovls.size (); ++i)
+		{
+		  auto p = profile;
+		  if (std::get <1> (ovls[i])->stack_effect (p) < 0)
+		    return {};
+		  ret = i == 0 ? p : static_profile::join (ret, p);
+		}
+	      return ret;
+	    }
+
+	  if (peg)
+	    t.m_builtin = ob->create_pegged (std::get <1> (ovls.front ()));
+	  else
+	    {
+	      auto p = profile;
+	      if (std::get <1> (ovls.front ())->stack_effect (p) < 0)
+		return {};
+	      return p;
+	    }
+	}
+
+      auto ret = profile;
+      ssize_t n = t.m_builtin->stack_effect (ret);
+      if (n < 0)
+	return unknown (peg);
+
+      need (profile, n, peg);
+      return ret;
+    }
+
+    void
+    pred (tree &t, static_profile const &profile, bool peg)
+    {
+      switch (t.m_tt)
+	{
+	case tree_type::PRED_NOT:
+	case tree_type::PRED_OR:
+	case tree_type::PRED_AND:
+	  for (auto &ch: t.m_children)
+	    pred (ch, profile, peg);
+	  return;
+
+	case tree_type::PRED_SUBX_ANY:
+	  exec (t.child (0), profile, peg);
+	  return;
+
+	case tree_type::PRED_SUBX_CMP:
+	  {
+	    auto p1 = exec (t.child (0), profile, peg);
+	    auto p2 = exec (t.child (1), profile, peg);
+	    need (p2, 1, peg);
+	    p1.push (p2.top ());
+	    pred (t.child (2), p1, peg);
+	    return;
+	  }
+
+	case tree_type::F_BUILTIN:
+	  builtin_effect (t, profile, peg);
+	  return;
+
+	case tree_type::CAT:
+	case tree_type::NOP:
+	case tree_type::ASSERT:
+	case tree_type::ALT:
+	case tree_type::OR:
+	case tree_type::CAPTURE:
+	case tree_type::SUBX_EVAL:
+	case tree_type::EMPTY_LIST:
+	case tree_type::CLOSE_STAR:
+	case tree_type::CLOSE_PLUS:
+	case tree_type::CONST:
+	case tree_type::STR:
+	case tree_type::FORMAT:
+	case tree_type::F_DEBUG:
+	case tree_type::BIND:
+	case tree_type::READ:
+	case tree_type::SCOPE:
+	case tree_type::BLOCK:
+	case tree_type::IFELSE:
+	  assert (! "Should never get here.");
+	  abort ();
+	}
+      abort ();
+    }
+
+    static_profile
+    exec (tree &t, static_profile const &profile, bool peg)
+    {
+      switch (t.m_tt)
+	{
+	case tree_type::CAT:
+	  {
+	    auto ret = profile;
+	    for (auto &ch: t.m_children)
+	      ret = exec (ch, ret, peg);
+	    return ret;
+	  }
+
+	case tree_type::ALT:
+	case tree_type::OR:
+	  {
+	    auto ret = exec (t.child (0), profile, peg);
+	    for (size_t i = 1; i < t.m_children.size (); ++i)
+	      ret = static_profile::join (ret, exec (t.child (i), profile, peg));
+	    return ret;
+	  }
+
+	case tree_type::NOP:
+	case tree_type::F_DEBUG:
+	  return profile;
+
+	case tree_type::F_BUILTIN:
+	  return builtin_effect (t, profile, peg);
+
+	case tree_type::ASSERT:
+	  pred (t.child (0), profile, peg);
+	  return profile;
+
+	case tree_type::FORMAT:
+	  {
+	    // Stringers are chained such that the last one sees the
+	    // incoming stack first.
+	    auto p = profile;
+	    for (auto it = t.m_children.rbegin (), eit = t.m_children.rend ();
+		 it != eit; ++it)
+	      if (it->m_tt != tree_type::STR)
+		{
+		  p = exec (*it, p, peg);
+		  need (p, 1, peg);
+		  p.pop ();
+		}
+	    p.push (value_str::vtype);
+	    return p;
+	  }
+
+	case tree_type::CONST:
+	  {
+	    auto ret = profile;
+	    ret.push (value_cst::vtype);
+	    return ret;
+	  }
+
+	case tree_type::STR:
+	  {
+	    auto ret = profile;
+	    ret.push (value_str::vtype);
+	    return ret;
+	  }
+
+	case tree_type::EMPTY_LIST:
+	  {
+	    auto ret = profile;
+	    ret.push (value_seq::vtype);
+	    return ret;
+	  }
+
+	case tree_type::CAPTURE:
+	  {
+	    exec (t.child (0), profile, peg);
+	    auto ret = profile;
+	    ret.push (value_seq::vtype);
+	    return ret;
+	  }
+
+	case tree_type::SUBX_EVAL:
+	  {
+	    auto p = exec (t.child (0), profile, peg);
+	    size_t keep = t.cst ().value ().uval ();
+	    need (p, keep, peg);
+
+	    auto ret = profile;
+	    for (size_t i = keep; i-- > 0; )
+	      ret.push (p.get (i));
+	    return ret;
+	  }
+
+	case tree_type::CLOSE_STAR:
+	case tree_type::CLOSE_PLUS:
+	  {
+	    // Find a profile that covers stacks after any number of
+	    // iterations.  Joins only ever lose information, so this
+	    // converges.
+	    auto p = profile;
+	    while (true)
+	      {
+		auto q = static_profile::join
+		  (p, exec (t.child (0), p, false));
+		if (q == p)
+		  break;
+		p = q;
+	      }
+	    exec (t.child (0), p, peg);
+	    return p;
+	  }
+
+	case tree_type::SCOPE:
+	  return exec (t.child (0), profile, peg);
+
+	case tree_type::BLOCK:
+	  {
+	    // The block is evaluated later, on stacks that we know
+	    // nothing about.
+	    exec (t.child (0), {}, peg);
+	    auto ret = profile;
+	    ret.push (value_closure::vtype);
+	    return ret;
+	  }
+
+	case tree_type::BIND:
+	  {
+	    need (profile, 1, peg);
+	    auto ret = profile;
+	    ret.pop ();
+	    return ret;
+	  }
+
+	case tree_type::READ:
+	  // The variable may hold a closure, which is then applied.
+	  return unknown (peg);
+
+	case tree_type::IFELSE:
+	  exec (t.child (0), profile, peg);
+	  return static_profile::join (exec (t.child (1), profile, peg),
+				       exec (t.child (2), profile, peg));
+
+	case tree_type::PRED_AND:
+	case tree_type::PRED_OR:
+	case tree_type::PRED_NOT:
+	case tree_type::PRED_SUBX_ANY:
+	case tree_type::PRED_SUBX_CMP:
+	  assert (! "Should never get here.");
+	  abort ();
+	}
+
+      abort ();
+    }
+  };
+}
+
+bool
+tree::peg_overloads (static_profile const &profile)
+{
+  peg_pass pass;
+  pass.exec (*this, profile, true);
+  return pass.m_proven;
+}
+
+namespace
+{
+  // Collect to TAGS the tags of T, which is either a tag filter, or
+  // an OR or ALT node of type TT whose branches are tag filters.
+  // Each branch sits in a scope, which binds nothing when all the
+  // branch holds is a builtin.
+  bool
+  collect_tags (tree const &t, tree_type tt, std::vector <int> &tags)
+  {
+    if (t.m_tt == tree_type::SCOPE
+	&& t.child (0).m_tt == tree_type::F_BUILTIN)
+      return collect_tags (t.child (0), tt, tags);
+
+    if (t.m_tt == tt)
+      return std::all_of (t.m_children.begin (), t.m_children.end (),
+			  [&] (tree const &c)
+			  { return collect_tags (c, tt, tags); });
+
+    reduction red {reduction_key::root, {}, false};
+    if (t.m_tt != tree_type::F_BUILTIN
+	|| ! t.m_builtin->describe_filter (red)
+	|| red.m_key != reduction_key::tag)
+      return false;
+
+    tags.push_back (red.m_cst.value ().uval ());
+    return true;
+  }
+
+  // Match T against a filter that a builtin might be able to evaluate
+  // on its own, i.e. (KEY == CST), ?root, alternatives of tags, or a
+  // builtin that describes itself as such a filter, and fill in RED.
+  bool
+  match_reduction (tree const &t, reduction &red)
+  {
+    if (t.m_tt == tree_type::OR || t.m_tt == tree_type::ALT)
+      {
+	std::vector <int> tags;
+	if (! collect_tags (t, t.m_tt, tags))
+	  return false;
+
+	std::sort (tags.begin (), tags.end ());
+	auto it = std::unique (tags.begin (), tags.end ());
+
+	// A DIE passes an ALT once for each branch that it passes, so
+	// the tags there have to be distinct.
+	if (it != tags.end () && t.m_tt == tree_type::ALT)
+	  return false;
+
+	tags.erase (it, tags.end ());
+	red.m_key = reduction_key::tags;
+	red.m_tags = std::move (tags);
+	return true;
+      }
+
+    if (t.m_tt == tree_type::F_BUILTIN)
+      {
+	if (t.m_builtin->describe_filter (red))
+	  return true;
+	if (strcmp (t.m_builtin->name (), "?root") != 0)
+	  return false;
+	red.m_key = reduction_key::root;
+	return true;
+      }
+
+    if (t.m_tt != tree_type::ASSERT
+	|| t.child (0).m_tt != tree_type::PRED_SUBX_CMP)
+      return false;
+
+    tree const &cmp = t.child (0);
+    if (cmp.child (2).m_tt != tree_type::F_BUILTIN
+	|| strcmp (cmp.child (2).m_builtin->name (), "?eq") != 0)
+      return false;
+
+    auto get_key = [&] (tree const &k)
+      {
+	if (k.m_tt != tree_type::F_BUILTIN)
+	  return false;
+
+	char const *name = k.m_builtin->name ();
+	if (strcmp (name, "offset") == 0)
+	  red.m_key = reduction_key::offset;
+	else if (strcmp (name, "label") == 0)
+	  red.m_key = reduction_key::label;
+	else if (strcmp (name, "pos") == 0)
+	  red.m_key = reduction_key::pos;
+	else
+	  return false;
+	return true;
+      };
+
+    auto get_cst = [&] (tree const &c)
+      {
+	if (c.m_tt == tree_type::CONST)
+	  {
+	    red.m_cst = c.cst ();
+	    return true;
+	  }
+
+	if (c.m_tt == tree_type::F_BUILTIN)
+	  if (auto bc = std::dynamic_pointer_cast <builtin_constant const>
+				(c.m_builtin))
+	    if (auto v = value::as <value_cst> (&bc->get_value ()))
+	      {
+		red.m_cst = v->get_constant ();
+		return true;
+	      }
+
+	return false;
+      };
+
+    return (get_key (cmp.child (0)) && get_cst (cmp.child (1)))
+      || (get_key (cmp.child (1)) && get_cst (cmp.child (0)));
+  }
+
+  // Replace X FILTER, or X* FILTER, with a builtin that X reduces to.
+  // Reductions whose key is pos are done in one round, the rest in
+  // another, so that the pos words that the former consume don't
+  // count as observing positions in the latter.
+  void
+  reduce_pass (tree &t, bool pos_keys, bool keep_pos)
+  {
+    for (auto &c: t.m_children)
+      reduce_pass (c, pos_keys, keep_pos);
+
+    if (t.m_tt != tree_type::CAT)
+      return;
+
+    for (size_t i = 0; i + 1 < t.m_children.size (); ++i)
+      {
+	tree &x = t.m_children[i];
+	reduction red {reduction_key::root, {}, keep_pos};
+	if (! match_reduction (t.m_children[i + 1], red)
+	    || (red.m_key == reduction_key::pos) != pos_keys)
+	  continue;
+
+	std::shared_ptr <builtin const> reduced;
+	if (x.m_tt == tree_type::F_BUILTIN)
+	  reduced = x.m_builtin->reduce (red);
+	else if (x.m_tt == tree_type::CLOSE_STAR
+		 && x.child (0).m_tt == tree_type::F_BUILTIN)
+	  reduced = x.child (0).m_builtin->reduce_star (red);
+
+	if (reduced != nullptr)
+	  {
+	    tree nx {tree_type::F_BUILTIN};
+	    nx.m_builtin = reduced;
+	    x.swap (nx);
+	    t.m_children.erase (t.m_children.begin () + i + 1);
+	  }
+      }
+
+    if (t.m_children.size () == 1)
+      {
+	tree tmp = t.child (0);
+	t.swap (tmp);
+      }
+  }
+}
+
+bool
+tree::mentions (char const *name) const
+{
+  if (m_tt == tree_type::F_BUILTIN && strcmp (m_builtin->name (), name) == 0)
+    return true;
+
+  return std::any_of (m_children.begin (), m_children.end (),
+		      [name] (tree const &t) { return t.mentions (name); });
+}
+
+bool
+tree::uses_pos () const
+{
+  return mentions ("pos");
+}
+
+void
+tree::reduce_strength ()
+{
+  reduce_pass (*this, true, true);
+  reduce_pass (*this, false, uses_pos ());
+}
@@ -35,17 +35,28 @@
 struct op_apply::pimpl
 {
   std::shared_ptr <op> m_upstream;
-  std::shared_ptr <op> m_op;
   std::shared_ptr <frame> m_old_frame;
 
+  // The op graph built for the most recently applied closure.  Later
+  // applications of closures that share that closure's tree only
+  // re-seed the origin.
+  std::shared_ptr <tree const> m_tree;
+  std::shared_ptr <op_origin> m_origin;
+  std::shared_ptr <op> m_op;
+  bool m_primed;
+
   pimpl (std::shared_ptr <op> upstream)
     : m_upstream {upstream}
+    , m_primed {false}
   {}
 
   void
   reset_me ()
   {
-    m_op = nullptr;
+    // Let the graph drop whatever stacks it still holds.
+    if (m_primed)
+      m_op->reset ();
+    m_primed = false;
     value_closure::maybe_unlink_frame (m_old_frame);
     m_old_frame = nullptr;
   }
@@ -60,7 +71,7 @@ struct op_apply::pimpl
   {
     while (true)
       {
-	while (m_op == nullptr)
+	while (! m_primed)
 	  if (auto stk = m_upstream->next ())
 	    {
 	      if (! stk->top ().is <value_closure> ())
@@ -72,11 +83,19 @@ struct op_apply::pimpl
 	      auto val = stk->pop ();
 	      auto &cl = static_cast <value_closure &> (*val);
 
+	      if (cl.get_tree () != m_tree)
+		{
+		  m_tree = cl.get_tree ();
+		  m_origin = std::make_shared <op_origin> (nullptr);
+		  m_op = m_tree->build_exec (m_origin);
+		}
+
 	      assert (m_old_frame == nullptr);
 	      m_old_frame = stk->nth_frame (0);
 	      stk->set_frame (cl.get_frame ());
-	      auto origin = std::make_shared <op_origin> (std::move (stk));
-	      m_op = cl.get_tree ().build_exec (origin);
+	      m_op->reset ();
+	      m_origin->set_next (std::move (stk));
+	      m_primed = true;
 	    }
 	  else
 	    return nullptr;
@@ -166,6 +166,12 @@ builtin_eq::docstring () const
   return cmp_docstring;
 }
 
+ssize_t
+builtin_eq::stack_effect (static_profile &profile) const
+{
+  return 2;
+}
+
 
 std::unique_ptr <pred>
 builtin_lt::build_pred () const
@@ -188,6 +194,12 @@ builtin_lt::docstring () const
   return cmp_docstring;
 }
 
+ssize_t
+builtin_lt::stack_effect (static_profile &profile) const
+{
+  return 2;
+}
+
 
 std::unique_ptr <pred>
 builtin_gt::build_pred () const
@@ -209,3 +221,9 @@ builtin_gt::docstring () const
 {
   return cmp_docstring;
 }
+
+ssize_t
+builtin_gt::stack_effect (static_profile &profile) const
+{
+  return 2;
+}
@@ -103,6 +103,13 @@ builtin_constant::docstring () const
   return val->get_constant ().dom ()->docstring ();
 }
 
+ssize_t
+builtin_constant::stack_effect (static_profile &profile) const
+{
+  profile.push (m_value->get_type ());
+  return 0;
+}
+
 
 namespace
 {
@@ -136,6 +143,14 @@ Though you can achieve the same effect with formatting directives
 	=0x3=
 
 )docstring";
+
+  ssize_t
+  cast_stack_effect (static_profile &profile)
+  {
+    profile.pop ();
+    profile.push (value_cst::vtype);
+    return 1;
+  }
 }
 
 
@@ -157,6 +172,12 @@ builtin_hex::docstring () const
   return radices_docstring;
 }
 
+ssize_t
+builtin_hex::stack_effect (static_profile &profile) const
+{
+  return cast_stack_effect (profile);
+}
+
 
 std::shared_ptr <op>
 builtin_dec::build_exec (std::shared_ptr <op> upstream) const
@@ -176,6 +197,12 @@ builtin_dec::docstring () const
   return radices_docstring;
 }
 
+ssize_t
+builtin_dec::stack_effect (static_profile &profile) const
+{
+  return cast_stack_effect (profile);
+}
+
 
 std::shared_ptr <op>
 builtin_oct::build_exec (std::shared_ptr <op> upstream) const
@@ -195,6 +222,12 @@ builtin_oct::docstring () const
   return radices_docstring;
 }
 
+ssize_t
+builtin_oct::stack_effect (static_profile &profile) const
+{
+  return cast_stack_effect (profile);
+}
+
 
 std::shared_ptr <op>
 builtin_bin::build_exec (std::shared_ptr <op> upstream) const
@@ -214,6 +247,12 @@ builtin_bin::docstring () const
   return radices_docstring;
 }
 
+ssize_t
+builtin_bin::stack_effect (static_profile &profile) const
+{
+  return cast_stack_effect (profile);
+}
+
 
 stack::uptr
 op_type::next ()
@@ -240,15 +279,38 @@ as T_CONST, T_DIE, T_STR, etc.).
 )docstring";
 }
 
+ssize_t
+op_type::stack_effect (static_profile &profile)
+{
+  profile.pop ();
+  profile.push (value_cst::vtype);
+  return 1;
+}
+
+constant_dom const &
+pos_dom ()
+{
+  static numeric_constant_dom_t pos_dom_obj ("pos");
+  return pos_dom_obj;
+}
+
+bool
+pos_of_constant (constant const &cst, size_t &pos)
+{
+  if (cst.value () < 0)
+    return false;
+  pos = cst.value ().uval ();
+  return constant {pos, &pos_dom ()} == cst;
+}
+
 stack::uptr
 op_pos::next ()
 {
   if (auto stk = m_upstream->next ())
     {
       auto vp = stk->pop ();
-      static numeric_constant_dom_t pos_dom_obj ("pos");
       stk->push (std::make_unique <value_cst>
-		(constant {vp->get_pos (), &pos_dom_obj}, 0));
+		(constant {vp->get_pos (), &pos_dom ()}, 0));
       return stk;
     }
 
@@ -302,3 +364,81 @@ Note that *every* function counts its elements anew::
 
 )docstring";
 }
+
+ssize_t
+op_pos::stack_effect (static_profile &profile)
+{
+  profile.pop ();
+  profile.push (value_cst::vtype);
+  return 1;
+}
+
+stack::uptr
+op_limit::next ()
+{
+  if (m_done)
+    return nullptr;
+
+  while (auto stk = m_upstream->next ())
+    {
+      auto vp = stk->pop ();
+      auto v = value::as <value_cst> (&*vp);
+      if (v == nullptr || v->get_constant ().value () < 0)
+	{
+	  std::cerr << "Error: limit expects a non-negative constant"
+		    << " on TOS.\n";
+	  continue;
+	}
+
+      uint64_t n = v->get_constant ().value ().uval ();
+      if (m_count < n)
+	{
+	  if (++m_count == n)
+	    m_done = true;
+	  return stk;
+	}
+
+      break;
+    }
+
+  m_done = true;
+  return nullptr;
+}
+
+void
+op_limit::reset ()
+{
+  m_count = 0;
+  m_done = false;
+  inner_op::reset ();
+}
+
+std::string
+op_limit::docstring ()
+{
+  return R"docstring(
+
+Takes a constant N from TOS and passes through the first N stacks that
+come through, and no more.  Once N stacks were passed, the expression
+that feeds ``limit`` is not asked for further values, so the rest of
+the computation is skipped::
+
+	$ dwgrep '(1, 2, 3) 2 limit'
+	1
+	2
+
+``limit`` counts stacks anew each time the expression that it is part
+of is evaluated anew.  E.g. this finds the first child of each
+``structure_type``::
+
+	entry ?TAG_structure_type [child 1 limit]
+
+)docstring";
+}
+
+ssize_t
+op_limit::stack_effect (static_profile &profile)
+{
+  profile.pop ();
+  return 1;
+}
@@ -45,12 +45,17 @@ public:
     : m_value {std::move (value)}
   {}
 
+  value const &get_value () const
+  { return *m_value; }
+
   std::shared_ptr <op> build_exec (std::shared_ptr <op> upstream)
     const override;
 
   char const *name () const override;
 
   std::string docstring () const override;
+
+  ssize_t stack_effect (static_profile &profile) const override;
 };
 
 struct builtin_hex
@@ -61,6 +66,7 @@ struct builtin_hex
 
   char const *name () const override;
   std::string docstring () const override;
+  ssize_t stack_effect (static_profile &profile) const override;
 };
 
 struct builtin_dec
@@ -71,6 +77,7 @@ struct builtin_dec
 
   char const *name () const override;
   std::string docstring () const override;
+  ssize_t stack_effect (static_profile &profile) const override;
 };
 
 struct builtin_oct
@@ -81,6 +88,7 @@ struct builtin_oct
 
   char const *name () const override;
   std::string docstring () const override;
+  ssize_t stack_effect (static_profile &profile) const override;
 };
 
 struct builtin_bin
@@ -91,6 +99,7 @@ struct builtin_bin
 
   char const *name () const override;
   std::string docstring () const override;
+  ssize_t stack_effect (static_profile &profile) const override;
 };
 
 struct op_type
@@ -100,8 +109,17 @@ struct op_type
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
+// Domain of constants that the word pos yields.
+constant_dom const &pos_dom ();
+
+// Return true if a position compares equal to CST, in which case
+// that position is stored to POS.  Useful for reductions of (pos ==
+// CST).
+bool pos_of_constant (constant const &cst, size_t &pos);
+
 struct op_pos
   : public inner_op
 {
@@ -109,6 +127,33 @@ struct op_pos
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
+};
+
+// Yields at most as many stacks as the constant on TOS says, counted
+// since the last reset.  Once the limit is reached, upstream is not
+// asked for more.  It is not reset right away either, because e.g. a
+// tine shares its upstream with the other branches of an
+// alternation.  Whatever it holds is released when this op is reset
+// or destroyed.
+class op_limit
+  : public inner_op
+{
+  uint64_t m_count;
+  bool m_done;
+
+public:
+  explicit op_limit (std::shared_ptr <op> upstream)
+    : inner_op {upstream}
+    , m_count {0}
+    , m_done {false}
+  {}
+
+  stack::uptr next () override;
+  void reset () override;
+
+  static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 #endif /* _BUILTIN_CST_H_ */
@@ -35,6 +35,32 @@
 #include "known-dwarf.h"
 #include "known-elf.h"
 
+namespace
+{
+  // ?TAG_* describe themselves as filters, so that builtins that can
+  // look for DIE's of a given tag directly are able to do so.
+  struct tag_pred_builtin
+    : public overloaded_pred_builtin
+  {
+    constant m_tag;
+
+    tag_pred_builtin (char const *name,
+		      std::shared_ptr <overload_tab> ovl_tab,
+		      constant tag)
+      : overloaded_pred_builtin {name, ovl_tab, true}
+      , m_tag {tag}
+    {}
+
+    bool
+    describe_filter (reduction &red) const override
+    {
+      red.m_key = reduction_key::tag;
+      red.m_cst = m_tag;
+      return true;
+    }
+  };
+}
+
 std::unique_ptr <vocabulary>
 dwgrep_vocabulary_dw ()
 {
@@ -200,6 +226,33 @@ dwgrep_vocabulary_dw ()
     voc.add (std::make_shared <overloaded_op_builtin> ("parent", t));
   }
 
+  {
+    auto t = std::make_shared <overload_tab> ();
+
+    t->add_op_overload <op_ancestor_die> ();
+
+    voc.add (std::make_shared <overloaded_op_builtin> ("ancestor", t));
+  }
+
+  {
+    auto t = std::make_shared <overload_tab> ();
+
+    t->add_op_overload <op_depth_die> ();
+
+    voc.add (std::make_shared <overloaded_op_builtin> ("depth", t));
+  }
+
+  {
+    auto t = std::make_shared <overload_tab> ();
+
+    t->add_pred_overload <pred_ancestor_ofp_die_die> ();
+
+    voc.add (std::make_shared <overloaded_pred_builtin>
+	     ("?ancestor_of", t, true));
+    voc.add (std::make_shared <overloaded_pred_builtin>
+	     ("!ancestor_of", t, false));
+  }
+
   {
     auto t = std::make_shared <overload_tab> ();
 
@@ -456,12 +509,13 @@ dwgrep_vocabulary_dw ()
       t->add_pred_overload <pred_tag_abbrev> (code);
       t->add_pred_overload <pred_tag_cst> (code);
 
-      voc.add (std::make_shared <overloaded_pred_builtin> (qname, t, true));
+      constant cst {code, &dw_tag_dom ()};
+      voc.add (std::make_shared <tag_pred_builtin> (qname, t, cst));
       voc.add (std::make_shared <overloaded_pred_builtin> (bname, t, false));
-      voc.add (std::make_shared <overloaded_pred_builtin> (lqname, t, true));
+      voc.add (std::make_shared <tag_pred_builtin> (lqname, t, cst));
       voc.add (std::make_shared <overloaded_pred_builtin> (lbname, t, false));
 
-      add_builtin_constant (voc, constant (code, &dw_tag_dom ()), lqname + 1);
+      add_builtin_constant (voc, cst, lqname + 1);
     };
 
 #define DWARF_ONE_KNOWN_DW_TAG(NAME, CODE)				\
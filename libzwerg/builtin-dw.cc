@@ -30,7 +30,9 @@
 #include <sstream>
 
 #include "atval.hh"
+#include "builtin-cst.hh"
 #include "builtin-dw.hh"
+#include "cache.hh"
 #include "dwcst.hh"
 #include "dwit.hh"
 #include "dwmods.hh"
@@ -400,18 +402,136 @@ several times, each time in a different context::
 
 namespace
 {
+  // Yield DIE's of a unit whose tag is one of given tags, in the same
+  // order and with the same imports as die_it_producer over all DIE's
+  // of that unit would, but look them up in the tag index instead of
+  // visiting the rest of the unit.  In cooked mode, import points are
+  // looked up as well.
+  struct tagged_die_producer
+    : public value_producer <value_die>
+  {
+    std::shared_ptr <dwfl_context> m_dwctx;
+    std::vector <int> m_tags;
+    std::vector <int> m_lookup;
+
+    // Offsets of DIE's still to visit in the unit and in each partial
+    // unit that is being imported.
+    struct frame
+    {
+      Dwarf *m_dw;
+      std::vector <Dwarf_Off> m_offs;
+      size_t m_i;
+    };
+    std::vector <frame> m_stack;
+
+    // Chain of DIE's where partial units were imported.
+    std::shared_ptr <value_die> m_import;
+
+    size_t m_i;
+    doneness m_doneness;
+
+    tagged_die_producer (std::shared_ptr <dwfl_context> dwctx,
+			 Dwarf_Die cudie, std::vector <int> const &tags,
+			 doneness d)
+      : m_dwctx {dwctx}
+      , m_tags (tags)
+      , m_lookup (tags)
+      , m_i {0}
+      , m_doneness {d}
+    {
+      if (d == doneness::cooked && ! wanted (DW_TAG_imported_unit))
+	m_lookup.push_back (DW_TAG_imported_unit);
+      push (cudie, false);
+    }
+
+    bool
+    wanted (int tag) const
+    {
+      return std::find (m_tags.begin (), m_tags.end (), tag) != m_tags.end ();
+    }
+
+    void
+    push (Dwarf_Die cudie, bool skip)
+    {
+      frame f {dwarf_cu_getdwarf (cudie.cu),
+	       m_dwctx->find_tagged (cudie, m_lookup), 0};
+
+      // Root DIE's of partial units are skipped.
+      if (skip && ! f.m_offs.empty ()
+	  && f.m_offs.front () == dwarf_dieoffset (&cudie))
+	f.m_i = 1;
+
+      m_stack.push_back (std::move (f));
+    }
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      while (! m_stack.empty ())
+	{
+	  frame &f = m_stack.back ();
+	  if (f.m_i == f.m_offs.size ())
+	    {
+	      m_stack.pop_back ();
+	      if (m_import != nullptr)
+		m_import = m_import->get_import ();
+	      continue;
+	    }
+
+	  Dwarf_Die die = dwpp_offdie (f.m_dw, f.m_offs[f.m_i++]);
+	  int tag = dwarf_tag (&die);
+
+	  Dwarf_Attribute at_import;
+	  Dwarf_Die cudie;
+	  if (m_doneness == doneness::cooked
+	      && tag == DW_TAG_imported_unit
+	      && dwarf_hasattr (&die, DW_AT_import)
+	      && dwarf_attr (&die, DW_AT_import, &at_import) != nullptr
+	      && dwarf_formref_die (&at_import, &cudie) != nullptr)
+	    {
+	      m_import = std::make_shared <value_die>
+		(m_dwctx, m_import, die, 0, doneness::cooked);
+	      push (cudie, true);
+	      continue;
+	    }
+
+	  if (wanted (tag))
+	    return std::make_unique <value_die>
+	      (m_dwctx, m_import, die, m_i++, m_doneness);
+	}
+
+      return nullptr;
+    }
+  };
+
+  // Yield DIE's of all units.  If TAGS is not empty, only yield those
+  // whose tag is one of TAGS.
   struct dwarf_entry_producer
     : public value_producer <value_die>
   {
     dwarf_unit_producer m_unitprod;
-    std::unique_ptr <die_it_producer <all_dies_iterator>> m_dieprod;
+    std::unique_ptr <value_producer <value_die>> m_dieprod;
+    std::vector <int> m_tags;
     size_t m_i;
 
-    dwarf_entry_producer (std::shared_ptr <dwfl_context> dwctx, doneness d)
+    dwarf_entry_producer (std::shared_ptr <dwfl_context> dwctx, doneness d,
+			  std::vector <int> const &tags = {})
       : m_unitprod {dwctx, d}
+      , m_tags (tags)
       , m_i {0}
     {}
 
+    std::unique_ptr <value_producer <value_die>>
+    make_die_producer (Dwarf_Die cudie)
+    {
+      if (m_tags.empty ())
+	return std::make_unique <die_it_producer <all_dies_iterator>>
+	  (m_unitprod.m_dwctx, cudie, m_unitprod.m_doneness);
+      else
+	return std::make_unique <tagged_die_producer>
+	  (m_unitprod.m_dwctx, cudie, m_tags, m_unitprod.m_doneness);
+    }
+
     std::unique_ptr <value_die>
     next () override
     {
@@ -419,9 +539,7 @@ namespace
 	{
 	  while (m_dieprod == nullptr)
 	    if (auto cu = m_unitprod.next ())
-	      m_dieprod = std::make_unique <die_it_producer <all_dies_iterator>>
-				(m_unitprod.m_dwctx, dwpp_cudie (cu->get_cu ()),
-				 m_unitprod.m_doneness);
+	      m_dieprod = make_die_producer (dwpp_cudie (cu->get_cu ()));
 	    else
 	      return nullptr;
 
@@ -455,9 +573,224 @@ behaves equivalently to the following::
 
 	unit entry
 
+When immediately followed by a tag assertion, such as in ``entry
+?TAG_subprogram``, or by alternatives of tag assertions, such as in
+``entry (?TAG_const_type || ?TAG_volatile_type)``, DIE's with other
+tags are skipped without being looked at, unless the query uses
+``pos``.  DIE's with each tag are looked up in an index built for each
+unit the first time it is needed.
+
 )docstring";
 }
 
+namespace
+{
+  // Find a DIE at offset OFF.  Descends from the root DIE of the unit
+  // that covers OFF, skipping over siblings that start at or before
+  // OFF, so that only a fraction of the unit is visited.  Returns
+  // false if there is no DIE at OFF.
+  bool
+  find_die_at (Dwarf *dw, Dwarf_Off off, Dwarf_Die &ret)
+  {
+    Dwarf_Off cuoff = 0;
+    Dwarf_Off next;
+    size_t hsize;
+    while (dwarf_nextcu (dw, cuoff, &next, &hsize,
+			 nullptr, nullptr, nullptr) == 0)
+      {
+	if (off >= next)
+	  {
+	    cuoff = next;
+	    continue;
+	  }
+
+	if (dwarf_offdie (dw, cuoff + hsize, &ret) == nullptr)
+	  throw_libdw ();
+
+	while (dwarf_dieoffset (&ret) != off)
+	  {
+	    Dwarf_Die child;
+	    if (dwarf_dieoffset (&ret) > off)
+	      return false;
+	    switch (dwarf_child (&ret, &child))
+	      {
+	      case -1:
+		throw_libdw ();
+	      case 1:
+		return false;
+	      }
+
+	    while (true)
+	      {
+		Dwarf_Die sib;
+		switch (dwarf_siblingof (&child, &sib))
+		  {
+		  case -1:
+		    throw_libdw ();
+		  case 0:
+		    if (dwarf_dieoffset (&sib) <= off)
+		      {
+			child = sib;
+			continue;
+		      }
+		  }
+		break;
+	      }
+
+	    ret = child;
+	  }
+
+	return true;
+      }
+
+    return false;
+  }
+
+  // In cooked mode, DIE's in partial units are yielded once for each
+  // place where they are imported, if any, and with import chains
+  // that reflect that.  Only units without partial units can be
+  // looked up directly.
+  bool
+  has_partial_units (Dwarf *dw)
+  {
+    if (dwarf_getalt (dw) != nullptr)
+      return true;
+
+    for (auto it = cu_iterator {dw}; it != cu_iterator::end (); ++it)
+      if (dwarf_tag (*it) == DW_TAG_partial_unit)
+	return true;
+
+    return false;
+  }
+
+  struct dwarf_root_producer
+    : public value_producer <value_die>
+  {
+    dwarf_unit_producer m_unitprod;
+
+    dwarf_root_producer (std::shared_ptr <dwfl_context> dwctx, doneness d)
+      : m_unitprod {dwctx, d}
+    {}
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      if (auto cu = m_unitprod.next ())
+	return std::make_unique <value_die>
+	  (m_unitprod.m_dwctx, dwpp_cudie (cu->get_cu ()), cu->get_pos (),
+	   m_unitprod.m_doneness);
+      return nullptr;
+    }
+  };
+
+  bool
+  die_has_offset (value_die &a, constant const &cst)
+  {
+    return constant {dwarf_dieoffset (&a.get_die ()), &dw_offset_dom ()}
+	== cst;
+  }
+
+  std::unique_ptr <value_producer <value_die>>
+  entry_at_offset (std::unique_ptr <value_dwarf> a, reduction const &red)
+  {
+    auto dwctx = a->get_dwctx ();
+    doneness d = a->get_doneness ();
+    auto dwarfs = all_dwarfs (*dwctx);
+
+    // Direct lookups can't reproduce positions that the DIE's would
+    // have, had they been enumerated.
+    if (! red.m_keep_pos
+	&& (d == doneness::raw
+	    || std::none_of (dwarfs.begin (), dwarfs.end (),
+			     has_partial_units)))
+      {
+	auto ret = std::make_unique <value_producer_cat <value_die>> ();
+	if (red.m_cst.value () < 0)
+	  return std::move (ret);
+
+	Dwarf_Off off = red.m_cst.value ().uval ();
+	size_t i = 0;
+	for (Dwarf *dw: dwarfs)
+	  {
+	    Dwarf_Die die;
+	    if (find_die_at (dw, off, die)
+		// Cooked entry skips the import points themselves.
+		&& (d == doneness::raw
+		    || dwarf_tag (&die) != DW_TAG_imported_unit))
+	      {
+		auto v = std::make_unique <value_die> (dwctx, die, i++, d);
+		if (die_has_offset (*v, red.m_cst))
+		  ret->m_vprs.push_back
+		    (std::make_unique <value_producer_single <value_die>>
+		     (std::move (v)));
+	      }
+	  }
+
+	return std::move (ret);
+      }
+
+    constant cst = red.m_cst;
+    return std::make_unique <value_producer_filter <value_die>>
+      (std::make_unique <dwarf_entry_producer> (dwctx, d),
+       [cst] (value_die &die) { return die_has_offset (die, cst); });
+  }
+
+  std::unique_ptr <value_producer <value_die>>
+  entry_roots (std::unique_ptr <value_dwarf> a, reduction const &red)
+  {
+    auto dwctx = a->get_dwctx ();
+
+    // Entry yields root DIE's of exactly those units that unit
+    // yields, because roots of imported units are skipped.
+    if (! red.m_keep_pos)
+      return std::make_unique <dwarf_root_producer>
+	(dwctx, a->get_doneness ());
+
+    return std::make_unique <value_producer_filter <value_die>>
+      (std::make_unique <dwarf_entry_producer> (dwctx, a->get_doneness ()),
+       [dwctx] (value_die &die) { return dwctx->is_root (die.get_die ()); });
+  }
+}
+
+std::shared_ptr <builtin const>
+op_entry_dwarf::reduce (reduction const &red)
+{
+  switch (red.m_key)
+    {
+    case reduction_key::offset:
+      return make_reduced_builtin <value_die, value_dwarf>
+	([red] (std::unique_ptr <value_dwarf> a)
+	 { return entry_at_offset (std::move (a), red); });
+
+    case reduction_key::root:
+      return make_reduced_builtin <value_die, value_dwarf>
+	([red] (std::unique_ptr <value_dwarf> a)
+	 { return entry_roots (std::move (a), red); });
+
+    case reduction_key::tag:
+    case reduction_key::tags:
+      // The tag index can't tell positions that the DIE's would have
+      // had, had all of them been enumerated.
+      if (red.m_keep_pos)
+	break;
+      return make_reduced_builtin <value_die, value_dwarf>
+	([red] (std::unique_ptr <value_dwarf> a)
+	 {
+	   std::vector <int> tags = red.m_tags;
+	   if (red.m_key == reduction_key::tag)
+	     tags.push_back (red.m_cst.value ().uval ());
+	   return std::make_unique <dwarf_entry_producer>
+	     (a->get_dwctx (), a->get_doneness (), tags);
+	 });
+
+    case reduction_key::label:
+    case reduction_key::pos:
+      break;
+    }
+
+  return nullptr;
+}
+
 
 // child
 namespace
@@ -479,6 +812,23 @@ op_child_die::operate (std::unique_ptr <value_die> a)
 				  a->get_doneness ());
 }
 
+std::shared_ptr <builtin const>
+op_child_die::reduce (reduction const &red)
+{
+  if (red.m_key != reduction_key::offset)
+    return nullptr;
+
+  constant cst = red.m_cst;
+  return make_reduced_builtin <value_die, value_die>
+    ([cst] (std::unique_ptr <value_die> a)
+     {
+       return std::make_unique <value_producer_filter <value_die>>
+	 (make_die_child_producer (a->get_dwctx (), a->get_die (),
+				   a->get_doneness ()),
+	  [cst] (value_die &die) { return die_has_offset (die, cst); });
+     });
+}
+
 std::string
 op_child_die::docstring ()
 {
@@ -584,6 +934,38 @@ op_elem_loclist_elem::docstring ()
   return elem_loclist_docstring;
 }
 
+namespace
+{
+  // Operators of a location expression are stored in an array, (pos
+  // == N) can thus be answered directly.  Note that both elem and
+  // relem number operators by their index in that array.
+  std::shared_ptr <builtin const>
+  reduce_elem_loclist (reduction const &red)
+  {
+    if (red.m_key != reduction_key::pos)
+      return nullptr;
+
+    size_t idx;
+    bool valid = pos_of_constant (red.m_cst, idx);
+    return make_reduced_builtin <value_loclist_op, value_loclist_elem>
+      ([valid, idx] (std::unique_ptr <value_loclist_elem> a)
+       {
+	 std::unique_ptr <value_loclist_op> v;
+	 if (valid && idx < a->get_exprlen ())
+	   v = std::make_unique <value_loclist_op>
+	     (a->get_dwctx (), a->get_attr (), a->get_expr () + idx, idx);
+	 return std::make_unique <value_producer_single <value_loclist_op>>
+	   (std::move (v));
+       });
+  }
+}
+
+std::shared_ptr <builtin const>
+op_elem_loclist_elem::reduce (reduction const &red)
+{
+  return reduce_elem_loclist (red);
+}
+
 std::unique_ptr <value_producer <value_loclist_op>>
 op_relem_loclist_elem::operate (std::unique_ptr <value_loclist_elem> a)
 {
@@ -596,6 +978,12 @@ op_relem_loclist_elem::docstring ()
   return elem_loclist_docstring;
 }
 
+std::shared_ptr <builtin const>
+op_relem_loclist_elem::reduce (reduction const &red)
+{
+  return reduce_elem_loclist (red);
+}
+
 
 // attribute
 namespace
@@ -628,7 +1016,8 @@ namespace
   {
     std::shared_ptr <dwfl_context> m_dwctx;
     std::unique_ptr <value_die> m_die;
-    attr_iterator m_it;
+    die_attrs m_attrs;
+    size_t m_ai;
     size_t m_i;
     doneness m_doneness;
     bool m_secondary;
@@ -660,7 +1049,8 @@ namespace
 
       m_die = std::move (m_next.back ());
       m_next.pop_back ();
-      m_it = attr_iterator {&m_die->get_die ()};
+      m_attrs = die_attrs {m_die->get_die ()};
+      m_ai = 0;
       return true;
     }
 
@@ -673,7 +1063,7 @@ namespace
 
     attribute_producer (std::unique_ptr <value_die> value)
       : m_dwctx {value->get_dwctx ()}
-      , m_it {attr_iterator::end ()}
+      , m_ai {0}
       , m_i {0}
       , m_doneness {value->get_doneness ()}
       , m_secondary {false}
@@ -690,13 +1080,13 @@ namespace
       do
 	{
 	again:
-	  while (m_it == attr_iterator::end ())
+	  while (m_ai == m_attrs.size ())
 	    if (! integrate || ! next_die ())
 	      return nullptr;
 	    else
 	      m_secondary = true;
 
-	  at = **m_it++;
+	  at = m_attrs[m_ai++];
 	  if (integrate
 	      && (at.code == DW_AT_specification
 		  || at.code == DW_AT_abstract_origin))
@@ -719,6 +1109,30 @@ op_attribute_die::operate (std::unique_ptr <value_die> a)
   return std::make_unique <attribute_producer> (std::move (a));
 }
 
+std::shared_ptr <builtin const>
+op_attribute_die::reduce (reduction const &red)
+{
+  if (red.m_key != reduction_key::label)
+    return nullptr;
+
+  // Attributes of cooked DIE's are integrated from several DIE's,
+  // and positions of the yielded ones depend on the others, so this
+  // still runs the full producer and only skips the evaluation of
+  // the filter expression.
+  constant cst = red.m_cst;
+  return make_reduced_builtin <value_attr, value_die>
+    ([cst] (std::unique_ptr <value_die> a)
+     {
+       return std::make_unique <value_producer_filter <value_attr>>
+	 (std::make_unique <attribute_producer> (std::move (a)),
+	  [cst] (value_attr &at)
+	  {
+	    return constant {dwarf_whatattr (&at.get_attr ()),
+			     &dw_attr_dom ()} == cst;
+	  });
+     });
+}
+
 std::string
 op_attribute_die::docstring ()
 {
@@ -1169,6 +1583,192 @@ particular DIE was explored::
 )docstring";
 }
 
+namespace
+{
+  // Whether DIE is the same DIE as THAT, disregarding import paths.
+  bool
+  same_die (value_die const &die, value_die const &that)
+  {
+    return dwarf_cu_getdwarf (die.get_die ().cu)
+	== dwarf_cu_getdwarf (that.get_die ().cu)
+      && dwarf_dieoffset ((Dwarf_Die *) &die.get_die ())
+	== dwarf_dieoffset ((Dwarf_Die *) &that.get_die ());
+  }
+
+  // Whether DIE is a cooked DIE that was reached through an import.
+  // Its parent then has to be looked up by get_parent, which follows
+  // the import.  Parents never carry an import, so for the rest of
+  // the way up, the parent cache can be consulted directly.
+  bool
+  is_imported (value_die const &die)
+  {
+    return die.is_cooked () && die.get_import () != nullptr;
+  }
+
+  // Yield ancestors of a DIE in the same order that "parent+" would,
+  // closest first.  If a tag is given, yield only those ancestors
+  // that have that tag, and skip the rest without making values for
+  // them.
+  struct ancestor_producer
+    : public value_producer <value_die>
+  {
+    std::unique_ptr <value_die> m_die;
+    int m_tag;
+
+    ancestor_producer (std::unique_ptr <value_die> die, int tag)
+      : m_die {std::move (die)}
+      , m_tag {tag}
+    {}
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      while (m_die != nullptr)
+	{
+	  if (is_imported (*m_die))
+	    {
+	      m_die = m_die->get_parent ();
+	      if (m_die != nullptr
+		  && (m_tag < 0 || dwarf_tag (&m_die->get_die ()) == m_tag))
+		return std::make_unique <value_die> (*m_die);
+	      continue;
+	    }
+
+	  auto dwctx = m_die->get_dwctx ();
+	  Dwarf_Die &die = m_die->get_die ();
+	  Dwarf_Off off = m_tag < 0 ? dwctx->find_parent (die)
+	    : dwctx->find_ancestor (die, m_tag);
+	  if (off == parent_cache::no_off)
+	    {
+	      m_die = nullptr;
+	      break;
+	    }
+
+	  m_die = std::make_unique <value_die>
+	    (dwctx, dwpp_offdie (dwarf_cu_getdwarf (die.cu), off), 0,
+	     m_die->get_doneness ());
+	  return std::make_unique <value_die> (*m_die);
+	}
+
+      return nullptr;
+    }
+  };
+
+  // If RED is a tag filter that a reduced builtin can apply while
+  // walking up the DIE tree, store the tag to TAG.
+  bool
+  get_ancestor_tag (reduction const &red, int &tag)
+  {
+    // Ancestors that are skipped don't get a position.
+    if (red.m_key != reduction_key::tag || red.m_keep_pos)
+      return false;
+
+    tag = red.m_cst.value ().uval ();
+    return true;
+  }
+}
+
+std::shared_ptr <builtin const>
+op_parent_die::reduce_star (reduction const &red)
+{
+  int tag;
+  if (! get_ancestor_tag (red, tag))
+    return nullptr;
+
+  return make_reduced_builtin <value_die, value_die>
+    ([tag] (std::unique_ptr <value_die> a)
+     {
+       std::unique_ptr <value_die> self;
+       if (dwarf_tag (&a->get_die ()) == tag)
+	 self = std::make_unique <value_die> (*a);
+
+       return std::make_unique <value_producer_cat <value_die>>
+	 (std::make_unique <value_producer_single <value_die>>
+		(std::move (self)),
+	  std::make_unique <ancestor_producer> (std::move (a), tag));
+     });
+}
+
+
+// ancestor
+
+std::unique_ptr <value_producer <value_die>>
+op_ancestor_die::operate (std::unique_ptr <value_die> a)
+{
+  return std::make_unique <ancestor_producer> (std::move (a), -1);
+}
+
+std::shared_ptr <builtin const>
+op_ancestor_die::reduce (reduction const &red)
+{
+  int tag;
+  if (! get_ancestor_tag (red, tag))
+    return nullptr;
+
+  return make_reduced_builtin <value_die, value_die>
+    ([tag] (std::unique_ptr <value_die> a)
+     {
+       return std::make_unique <ancestor_producer> (std::move (a), tag);
+     });
+}
+
+std::string
+op_ancestor_die::docstring ()
+{
+  return
+R"docstring(
+
+Takes a DIE on TOS and yields all its ancestors, closest first.  This
+yields the same DIE's as ``parent+``, but does so without the
+bookkeeping of a transitive closure::
+
+	$ dwgrep ./tests/twocus -e 'entry (offset == 0xa3) ancestor "%s"'
+	[80] subprogram
+	[5e] compile_unit
+
+When immediately followed by a tag assertion, such as in ``ancestor
+?TAG_namespace``, ancestors with other tags are skipped without being
+yielded, unless the query uses ``pos``.  ``parent* ?TAG_namespace``
+is evaluated the same way.
+
+)docstring";
+}
+
+
+// depth
+
+value_cst
+op_depth_die::operate (std::unique_ptr <value_die> a)
+{
+  unsigned depth = 0;
+  if (is_imported (*a))
+    {
+      a = a->get_parent ();
+      if (a == nullptr)
+	return value_cst {constant {0, &dec_constant_dom}, 0};
+      depth = 1;
+    }
+
+  depth += a->get_dwctx ()->die_depth (a->get_die ());
+  return value_cst {constant {depth, &dec_constant_dom}, 0};
+}
+
+std::string
+op_depth_die::docstring ()
+{
+  return
+R"docstring(
+
+Takes a DIE on TOS and yields the number of its ancestors, i.e. how
+many times ``parent`` can be applied to it.  Root DIE's are at depth
+0::
+
+	$ dwgrep ./tests/twocus -e 'entry (offset == 0xa3) depth'
+	2
+
+)docstring";
+}
+
 
 // ?root
 
@@ -1196,6 +1796,50 @@ Holds for root DIE's, i.e. DIE's that don't have a parental DIE.
 }
 
 
+// ?ancestor_of
+
+pred_result
+pred_ancestor_ofp_die_die::result (value_die &a, value_die &b)
+{
+  std::unique_ptr <value_die> par;
+  value_die *die = &b;
+  if (is_imported (b))
+    {
+      par = b.get_parent ();
+      if (par == nullptr)
+	return pred_result::no;
+      if (same_die (a, *par))
+	return pred_result::yes;
+      die = par.get ();
+    }
+
+  return pred_result (die->get_dwctx ()->is_ancestor (a.get_die (),
+						      die->get_die ()));
+}
+
+std::string
+pred_ancestor_ofp_die_die::docstring ()
+{
+  return
+R"docstring(
+
+Inspects two DIE's on top of the stack, and holds if the one below
+TOS is an ancestor of the one on TOS, i.e. if ``parent+`` applied to
+the latter would yield the former.  A DIE is not its own ancestor::
+
+	$ dwgrep ./tests/twocus -e '
+		entry (offset == 0xa3) (|A| A parent* A ?ancestor_of)
+		"%s contains %s"'
+	[80] subprogram contains [a3] subprogram
+	[5e] compile_unit contains [a3] subprogram
+
+This does not walk the DIE tree, so it is a cheap way to tell whether
+one DIE is nested in another.
+
+)docstring";
+}
+
+
 // root
 
 value_die
@@ -1702,16 +2346,27 @@ namespace
   // If found_integrated, and if DWCTX is non-nullptr, a new value_die
   // with the DIE where the attribute was found is created and passed
   // in second slot of the returned pair.
+  //
+  // Which attributes a DIE has is looked up in ABBREVS.
 
   std::pair <find_attribute_result, std::unique_ptr <value_die>>
-  find_attribute (Dwarf_Die die, int atname, doneness d,
-		  Dwarf_Attribute *ret_at,
+  find_attribute (abbrev_cache &abbrevs, Dwarf_Die die, int atname,
+		  doneness d, Dwarf_Attribute *ret_at,
 		  std::shared_ptr <dwfl_context> dwctx)
   {
-    if (dwarf_hasattr (&die, atname))
+    abbrev_summary const &summary = abbrevs.get (die);
+    auto get_attr = [&] (int name) -> Dwarf_Attribute
+      {
+	Dwarf_Attribute at;
+	if (! summary.find_fixed (die, name, at))
+	  at = dwpp_attr (die, name);
+	return at;
+      };
+
+    if (summary.has (atname))
       {
 	if (ret_at != nullptr)
-	  *ret_at = dwpp_attr (die, atname);
+	  *ret_at = get_attr (atname);
 	return std::make_pair (find_attribute_result::found, nullptr);
       }
     else if (d == doneness::cooked && attr_should_be_integrated (atname))
@@ -1721,12 +2376,12 @@ namespace
 		-> std::pair <find_attribute_result,
 			      std::unique_ptr <value_die>>
 	  {
-	    if (dwarf_hasattr (&die, atname2))
+	    if (summary.has (atname2))
 	      {
-		Dwarf_Attribute at = dwpp_attr (die, atname2);
+		Dwarf_Attribute at = get_attr (atname2);
 		Dwarf_Die integrated_die = dwpp_formref_die (at);
-		auto ret = find_attribute (integrated_die, atname, d,
-					   ret_at, nullptr);
+		auto ret = find_attribute (abbrevs, integrated_die, atname,
+					   d, ret_at, nullptr);
 
 		// If this call found anything, translate from found
 		// to found_integrated and create the accompanying
@@ -1762,7 +2417,8 @@ std::unique_ptr <value_producer <value>>
 op_atval_die::operate (std::unique_ptr <value_die> a)
 {
   Dwarf_Attribute attr;
-  auto r = find_attribute (a->get_die (), m_atname, a->get_doneness (),
+  auto r = find_attribute (a->get_dwctx ()->get_abbrev_cache (),
+			   a->get_die (), m_atname, a->get_doneness (),
 			   &attr, a->get_dwctx ());
   if (r.first == find_attribute_result::not_found)
     return nullptr;
@@ -1798,7 +2454,8 @@ pred_atname_die::pred_atname_die (unsigned atname)
 pred_result
 pred_atname_die::result (value_die &a)
 {
-  return find_attribute (a.get_die (), m_atname,
+  return find_attribute (a.get_dwctx ()->get_abbrev_cache (),
+			 a.get_die (), m_atname,
 			 a.get_doneness (), nullptr, nullptr).first
 		!= find_attribute_result::not_found
     ? pred_result::yes : pred_result::no;
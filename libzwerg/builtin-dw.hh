@@ -100,6 +100,7 @@ struct op_entry_dwarf
   operate (std::unique_ptr <value_dwarf> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_child_die
@@ -111,6 +112,7 @@ struct op_child_die
   operate (std::unique_ptr <value_die> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_elem_loclist_elem
@@ -122,6 +124,7 @@ struct op_elem_loclist_elem
   operate (std::unique_ptr <value_loclist_elem> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_relem_loclist_elem
@@ -133,6 +136,7 @@ struct op_relem_loclist_elem
   operate (std::unique_ptr <value_loclist_elem> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_attribute_die
@@ -144,6 +148,7 @@ struct op_attribute_die
   operate (std::unique_ptr <value_die> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_offset_cu
@@ -243,6 +248,28 @@ struct op_parent_die
 
   std::unique_ptr <value_die> operate (std::unique_ptr <value_die> a) override;
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce_star (reduction const &red);
+};
+
+struct op_ancestor_die
+  : public op_yielding_overload <value_die, value_die>
+{
+  using op_yielding_overload::op_yielding_overload;
+
+  std::unique_ptr <value_producer <value_die>>
+  operate (std::unique_ptr <value_die> a) override;
+
+  static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
+};
+
+struct op_depth_die
+  : public op_once_overload <value_cst, value_die>
+{
+  using op_once_overload::op_once_overload;
+
+  value_cst operate (std::unique_ptr <value_die> a) override;
+  static std::string docstring ();
 };
 
 struct pred_rootp_die
@@ -254,6 +281,15 @@ struct pred_rootp_die
   static std::string docstring ();
 };
 
+struct pred_ancestor_ofp_die_die
+  : public pred_overload <value_die, value_die>
+{
+  using pred_overload::pred_overload;
+
+  pred_result result (value_die &a, value_die &b) override;
+  static std::string docstring ();
+};
+
 struct op_root_cu
   : public op_once_overload <value_die, value_cu>
 {
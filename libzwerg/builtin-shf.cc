@@ -75,6 +75,13 @@ op_drop::docstring ()
   return shf_docstring;
 }
 
+ssize_t
+op_drop::stack_effect (static_profile &profile)
+{
+  profile.pop ();
+  return 1;
+}
+
 
 stack::uptr
 op_swap::next ()
@@ -96,6 +103,17 @@ op_swap::docstring ()
   return shf_docstring;
 }
 
+ssize_t
+op_swap::stack_effect (static_profile &profile)
+{
+  value_type a = profile.get (0);
+  value_type b = profile.get (1);
+  profile.pop (2);
+  profile.push (a);
+  profile.push (b);
+  return 2;
+}
+
 
 stack::uptr
 op_dup::next ()
@@ -114,6 +132,13 @@ op_dup::docstring ()
   return shf_docstring;
 }
 
+ssize_t
+op_dup::stack_effect (static_profile &profile)
+{
+  profile.push (profile.top ());
+  return 1;
+}
+
 
 stack::uptr
 op_over::next ()
@@ -132,6 +157,13 @@ op_over::docstring ()
   return shf_docstring;
 }
 
+ssize_t
+op_over::stack_effect (static_profile &profile)
+{
+  profile.push (profile.get (1));
+  return 2;
+}
+
 
 stack::uptr
 op_rot::next ()
@@ -154,3 +186,16 @@ op_rot::docstring ()
 {
   return shf_docstring;
 }
+
+ssize_t
+op_rot::stack_effect (static_profile &profile)
+{
+  value_type a = profile.get (0);
+  value_type b = profile.get (1);
+  value_type c = profile.get (2);
+  profile.pop (3);
+  profile.push (b);
+  profile.push (a);
+  profile.push (c);
+  return 3;
+}
@@ -29,6 +29,7 @@
 #ifndef _BUILTIN_SHF_H_
 #define _BUILTIN_SHF_H_
 
+#include "builtin.hh"
 #include "op.hh"
 
 struct op_drop
@@ -38,6 +39,7 @@ struct op_drop
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 struct op_swap
@@ -47,6 +49,7 @@ struct op_swap
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 struct op_dup
@@ -56,6 +59,7 @@ struct op_dup
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 struct op_over
@@ -65,6 +69,7 @@ struct op_over
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 struct op_rot
@@ -74,6 +79,7 @@ struct op_rot
   stack::uptr next () override;
 
   static std::string docstring ();
+  static ssize_t stack_effect (static_profile &profile);
 };
 
 #endif /* _BUILTIN_SHF_H_ */
@@ -60,6 +60,54 @@ builtin::protomap () const
   return {};
 }
 
+ssize_t
+builtin::stack_effect (static_profile &profile) const
+{
+  auto pm = protomap ();
+  if (pm.size () != 1)
+    return -1;
+
+  auto const &proto = pm.front ();
+  size_t nargs = std::get <0> (proto).size ();
+  if (std::get <1> (proto) != yield::pred)
+    {
+      profile.pop (nargs);
+      for (auto vt: std::get <2> (proto))
+	profile.push (vt);
+    }
+  return nargs;
+}
+
+std::shared_ptr <builtin const>
+builtin::reduce (reduction const &red) const
+{
+  return nullptr;
+}
+
+std::shared_ptr <builtin const>
+builtin::reduce_star (reduction const &red) const
+{
+  return nullptr;
+}
+
+bool
+builtin::describe_filter (reduction &red) const
+{
+  return false;
+}
+
+static_profile
+static_profile::join (static_profile const &a, static_profile const &b)
+{
+  static_profile ret;
+  for (size_t i = std::min (a.size (), b.size ()); i-- > 0; )
+    {
+      value_type va = a.get (i);
+      ret.push (va == b.get (i) ? va : value_type {0});
+    }
+  return ret;
+}
+
 std::unique_ptr <pred>
 maybe_invert (std::unique_ptr <pred> pred, bool positive)
 {
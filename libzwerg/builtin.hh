@@ -29,6 +29,7 @@
 #ifndef _BUILTIN_H_
 #define _BUILTIN_H_
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <map>
@@ -65,6 +66,101 @@ using builtin_prototype = std::tuple <std::vector <value_type>, yield,
 				      std::vector <value_type>>;
 using builtin_protomap = std::vector <builtin_prototype>;
 
+// Static profile describes stacks as known at the time that a query
+// is built.  The stack is guaranteed to hold at least as many values
+// as the profile does, nothing is known about values deeper than
+// that.  A value_type with code 0 stands for a value of unknown type.
+class static_profile
+{
+  std::vector <value_type> m_types;
+
+public:
+  static_profile () = default;
+
+  size_t
+  size () const
+  {
+    return m_types.size ();
+  }
+
+  // Generic value type, which some prototypes declare, stands for a
+  // value of any type.
+  void
+  push (value_type vt)
+  {
+    m_types.push_back (vt == value::vtype ? value_type {0} : vt);
+  }
+
+  void
+  pop (size_t n = 1)
+  {
+    m_types.erase (m_types.end () - std::min (n, m_types.size ()),
+		   m_types.end ());
+  }
+
+  value_type
+  get (size_t depth) const
+  {
+    return depth < m_types.size ()
+      ? m_types[m_types.size () - 1 - depth] : value_type {0};
+  }
+
+  value_type
+  top () const
+  {
+    return get (0);
+  }
+
+  bool
+  operator== (static_profile const &that) const
+  {
+    return m_types == that.m_types;
+  }
+
+  bool
+  operator!= (static_profile const &that) const
+  {
+    return ! (*this == that);
+  }
+
+  // Return a profile that describes stacks described by either A or
+  // B.
+  static static_profile join (static_profile const &a,
+			      static_profile const &b);
+};
+
+// Keys of filters that some builtins can evaluate on their own.  See
+// builtin::reduce.
+enum class reduction_key
+  {
+    offset,	// (offset == CST)
+    label,	// (label == CST)
+    pos,	// (pos == CST)
+    root,	// ?root
+    tag,	// ?TAG_* with the tag in m_cst
+    tags,	// (?TAG_a || ?TAG_b), or (?TAG_a, ?TAG_b), see m_tags
+  };
+
+// A reduction describes a filter that immediately follows a builtin,
+// such as the parenthesis in "entry (offset == 0x123)".
+struct reduction
+{
+  reduction_key m_key;
+
+  // The constant that the key is compared to, or for
+  // reduction_key::tag, the tag.  Unused for reduction_key::root.
+  constant m_cst;
+
+  // Whether the query may observe positions of values that the
+  // builtin yields.  If it doesn't, a reduced builtin is free to
+  // number the values differently than the original one would.
+  bool m_keep_pos;
+
+  // For reduction_key::tags, the tags that the filter lets through,
+  // sorted and without duplicates.
+  std::vector <int> m_tags;
+};
+
 class builtin
 {
 public:
@@ -80,6 +176,30 @@ public:
 
   virtual std::string docstring () const;
   virtual builtin_protomap protomap () const;
+
+  // Describe stack effect of this builtin.  PROFILE describes stacks
+  // that the builtin is applied to, and is updated to describe stacks
+  // that it yields.  Returns the number of values near TOS that the
+  // builtin needs, or -1 if the effect is not known, in which case
+  // PROFILE is left in an unspecified state.  The default
+  // implementation derives the effect from protomap.
+  virtual ssize_t stack_effect (static_profile &profile) const;
+
+  // Reduction point.  Return a builtin that yields what this builtin
+  // followed by the filter RED would, or nullptr if there is no way
+  // to do that better than by evaluating the filter on each value.
+  // The default implementation returns nullptr.
+  virtual std::shared_ptr <builtin const> reduce (reduction const &red) const;
+
+  // Likewise, but return a builtin that yields what X* followed by
+  // the filter RED would, X being this builtin.
+  virtual std::shared_ptr <builtin const>
+  reduce_star (reduction const &red) const;
+
+  // If this builtin is a filter that other builtins may be able to
+  // evaluate on their own, describe it in RED and return true.  The
+  // default implementation returns false.
+  virtual bool describe_filter (reduction &red) const;
 };
 
 // Return either PRED, or PRED_NOT(PRED), depending on POSITIVE.
@@ -174,6 +294,12 @@ add_simple_exec_builtin (vocabulary &voc, char const *name)
     {
       return Op::docstring ();
     }
+
+    ssize_t
+    stack_effect (static_profile &profile) const override
+    {
+      return Op::stack_effect (profile);
+    }
   };
 
   voc.add (std::make_shared <simple_exec_builtin> (name));
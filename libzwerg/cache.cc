@@ -29,91 +29,467 @@
 #include <cassert>
 #include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <dwarf.h>
 
 #include "cache.hh"
 #include "dwpp.hh"
 #include "dwit.hh"
 
-void
-parent_cache::recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-					 Dwarf_Off paroff)
+parent_cache::unit_index
+parent_cache::build_index (Dwarf_Die cudie)
 {
+  unit_index ui;
+  ui.m_cuoff = dwarf_dieoffset (&cudie);
+
+  // The unit is walked depth-first, which visits DIE's in the order
+  // of their offsets.  PATH holds DIE's whose children are being
+  // walked.
+  std::vector <Dwarf_Die> path;
+  Dwarf_Die die = cudie;
+
   while (true)
     {
-      Dwarf_Off off = dwarf_dieoffset (&die);
-      uc.push_back (std::make_pair (off, paroff));
+      Dwarf_Off reloff = dwarf_dieoffset (&die) - ui.m_cuoff;
+      if (reloff >= (uint32_t) -1)
+	throw std::runtime_error ("unit too large to index");
+      if (path.size () >= (uint16_t) -1)
+	throw std::runtime_error ("unit too deep to index");
+      ui.m_offs.push_back (reloff);
+      ui.m_depths.push_back (path.size ());
+
+      int tag = dwarf_tag (&die);
+      if (tag < 0)
+	throw_libdw ();
+      auto it = std::find (ui.m_tags.begin (), ui.m_tags.end (), tag);
+      if (it == ui.m_tags.end () && ui.m_tags.size () < unit_index::other_tag)
+	it = ui.m_tags.insert (it, tag);
+      ui.m_tagidx.push_back (it - ui.m_tags.begin ());
 
       {
 	Dwarf_Die child;
 	if (dwpp_child (die, child))
-	  recursively_populate_unit (uc, child, off);
+	  {
+	    path.push_back (die);
+	    die = child;
+	    continue;
+	  }
       }
 
-      switch (dwarf_siblingof (&die, &die))
+      // Move on to the next sibling, climbing up for as long as there
+      // is none.  The unit DIE has no siblings to consider.
+      while (true)
 	{
-	case 0:
-	  break;
-	case -1:
-	  throw_libdw ();
-	case 1:
-	  return;
+	  if (path.empty ())
+	    {
+	      ui.m_offs.shrink_to_fit ();
+	      ui.m_depths.shrink_to_fit ();
+	      ui.m_tagidx.shrink_to_fit ();
+	      ui.build_mins ();
+	      return ui;
+	    }
+
+	  int ret = dwarf_siblingof (&die, &die);
+	  if (ret == 0)
+	    break;
+	  if (ret < 0)
+	    throw_libdw ();
+
+	  die = path.back ();
+	  path.pop_back ();
 	}
     }
 }
 
-parent_cache::unit_cache_t
-parent_cache::populate_unit (Dwarf_Die die)
+void
+parent_cache::unit_index::build_mins ()
 {
-  unit_cache_t uc;
-  recursively_populate_unit (uc, die, no_off);
-  return uc;
+  for (size_t k = 0; level (k).size () > 1; ++k)
+    {
+      auto const &lv = level (k);
+      std::vector <uint16_t> up ((lv.size () + block_size - 1) / block_size);
+      for (size_t i = 0; i < lv.size (); ++i)
+	if (i % block_size == 0)
+	  up[i / block_size] = lv[i];
+	else
+	  up[i / block_size] = std::min (up[i / block_size], lv[i]);
+      m_mins.push_back (std::move (up));
+    }
 }
 
-Dwarf_Off
-parent_cache::find (Dwarf_Die die)
+uint32_t
+parent_cache::unit_index::last_at_most (uint32_t idx, uint16_t depth) const
+{
+  // Scan the rest of the block that IDX is in, then climb up a level
+  // and scan the rest of the block there, and so on.  Once an entry
+  // that is small enough is found, descend into its block and find
+  // the last entry there that is, down to the DIE's themselves.
+  size_t k = 0;
+  size_t pos = idx;
+  size_t found;
+  while (true)
+    {
+      auto const &lv = level (k);
+      size_t start = pos - pos % block_size;
+      for (found = pos; found-- > start; )
+	if (lv[found] <= depth)
+	  goto descend;
+      if (start == 0)
+	return no_idx;
+      pos = start / block_size;
+      ++k;
+    }
+
+ descend:
+  while (k-- > 0)
+    {
+      auto const &lv = level (k);
+      size_t start = found * block_size;
+      for (found = std::min (start + block_size, lv.size ());
+	   found-- > start; )
+	if (lv[found] <= depth)
+	  break;
+      assert (lv[found] <= depth);
+    }
+  return found;
+}
+
+int
+parent_cache::unit_index::tag (uint32_t idx, Dwarf *dw) const
+{
+  if (m_tagidx[idx] != other_tag)
+    return m_tags[m_tagidx[idx]];
+
+  Dwarf_Die die = dwpp_offdie (dw, m_cuoff + m_offs[idx]);
+  return dwarf_tag (&die);
+}
+
+std::pair <parent_cache::unit_index const *, uint32_t>
+parent_cache::locate (Dwarf_Die die, size_t dwidx)
 {
   Dwarf_Die cudie;
   if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
     throw_libdw ();
 
   Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
+  auto key = std::make_pair (dwidx, cuoff);
+
+  // Map nodes stay put, and a unit index is never changed once it is
+  // inserted, so the lock only needs to cover the map itself.  Indices
+  // are built without holding it.  Should two threads index
+  // the same unit at once, the second result is dropped.
+  unit_index const *ui = nullptr;
+  {
+    std::lock_guard <std::mutex> lock {m_mutex};
+    auto it = m_cache.find (key);
+    if (it != m_cache.end ())
+      ui = &it->second;
+  }
+  if (ui == nullptr)
+    {
+      auto nui = build_index (cudie);
+      std::lock_guard <std::mutex> lock {m_mutex};
+      ui = &m_cache.insert (std::make_pair (key, std::move (nui)))
+		.first->second;
+    }
+
+  uint32_t reloff = dwarf_dieoffset (&die) - cuoff;
+  auto jt = std::lower_bound (ui->m_offs.begin (), ui->m_offs.end (),
+			      reloff);
+  assert (jt != ui->m_offs.end ());
+  assert (*jt == reloff);
+
+  return std::make_pair (ui, jt - ui->m_offs.begin ());
+}
+
+Dwarf_Off
+parent_cache::find (Dwarf_Die die, size_t dwidx)
+{
+  auto loc = locate (die, dwidx);
+  unit_index const *ui = loc.first;
+
+  uint16_t depth = ui->m_depths[loc.second];
+  if (depth == 0)
+    return no_off;
+  return ui->m_cuoff
+    + ui->m_offs[ui->last_at_most (loc.second, depth - 1)];
+}
+
+Dwarf_Off
+parent_cache::find_ancestor (Dwarf_Die die, size_t dwidx, int tag)
+{
+  auto loc = locate (die, dwidx);
+  unit_index const *ui = loc.first;
   Dwarf *dw = dwarf_cu_getdwarf (die.cu);
-  auto key = std::make_pair (dw, cuoff);
 
-  auto it = m_cache.find (key);
-  if (it == m_cache.end ())
-    it = m_cache.insert (std::make_pair (key, populate_unit (cudie))).first;
+  // Tags that the unit doesn't use need no walk at all.
+  if (ui->m_tags.size () < unit_index::other_tag
+      && std::find (ui->m_tags.begin (), ui->m_tags.end (), tag)
+	   == ui->m_tags.end ())
+    return no_off;
 
-  Dwarf_Off dieoff = dwarf_dieoffset (&die);
-  auto jt = std::lower_bound
-    (it->second.begin (), it->second.end (), dieoff,
-     [] (std::pair <Dwarf_Off, Dwarf_Off> const &a, Dwarf_Off b)
-     {
-       return a.first < b;
-     });
+  // Each step up is a look-up in the index, no DIE is decoded.
+  for (uint32_t idx = loc.second; ui->m_depths[idx] > 0; )
+    {
+      idx = ui->last_at_most (idx, ui->m_depths[idx] - 1);
+      if (ui->tag (idx, dw) == tag)
+	return ui->m_cuoff + ui->m_offs[idx];
+    }
 
-  assert (jt != it->second.end ());
-  assert (jt->first == dieoff);
-  return jt->second;
+  return no_off;
 }
 
+unsigned
+parent_cache::depth (Dwarf_Die die, size_t dwidx)
+{
+  auto loc = locate (die, dwidx);
+  return loc.first->m_depths[loc.second];
+}
 
 bool
-root_cache::is_root (Dwarf_Die die)
+parent_cache::is_ancestor (Dwarf_Die anc, Dwarf_Die die, size_t dwidx)
 {
-  Dwarf *dw = dwarf_cu_getdwarf (die.cu);
-  auto it = m_cache.find (dw);
-  if (it == m_cache.end ())
+  auto aloc = locate (anc, dwidx);
+  auto loc = locate (die, dwidx);
+  if (aloc.first != loc.first || aloc.second >= loc.second)
+    return false;
+
+  // ANC is an ancestor if DIE, and all DIE's between the two, are
+  // deeper than ANC.
+  unit_index const *ui = loc.first;
+  uint16_t depth = ui->m_depths[aloc.second];
+  return ui->m_depths[loc.second] > depth
+    && ui->last_at_most (loc.second, depth) == aloc.second;
+}
+
+bool
+root_cache::is_root (Dwarf_Die die, size_t dwidx)
+{
+  off_vect const *offs = nullptr;
+  {
+    std::lock_guard <std::mutex> lock {m_mutex};
+    auto it = m_cache.find (dwidx);
+    if (it != m_cache.end ())
+      offs = &it->second;
+  }
+  if (offs == nullptr)
     {
+      Dwarf *dw = dwarf_cu_getdwarf (die.cu);
       off_vect v;
       for (auto jt = cu_iterator { dw }; jt != cu_iterator::end (); ++jt)
 	v.push_back (dwarf_dieoffset (*jt));
 
       // Populate the cache for this Dwarf.
-      it = m_cache.insert (std::make_pair (dw, std::move (v))).first;
+      std::lock_guard <std::mutex> lock {m_mutex};
+      offs = &m_cache.insert (std::make_pair (dwidx, std::move (v)))
+		  .first->second;
     }
 
   Dwarf_Off dieoff = dwarf_dieoffset (&die);
-  auto jt = std::lower_bound (it->second.begin (), it->second.end (), dieoff);
-  return jt != it->second.end () && *jt == dieoff;
+  auto jt = std::lower_bound (offs->begin (), offs->end (), dieoff);
+  return jt != offs->end () && *jt == dieoff;
+}
+
+tag_cache::unit_index
+tag_cache::build_index (Dwarf_Die cudie)
+{
+  unit_index ui;
+  Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
+
+  cu_iterator cuit {dwarf_cu_getdwarf (cudie.cu), cudie};
+  all_dies_iterator it (cuit);
+  all_dies_iterator e (++cuit);
+  for (; it != e; ++it)
+    {
+      Dwarf_Off reloff = dwarf_dieoffset (*it) - cuoff;
+      if (reloff >= (uint32_t) -1)
+	throw std::runtime_error ("unit too large to index");
+
+      int tag = dwarf_tag (*it);
+      if (tag < 0)
+	throw_libdw ();
+
+      ui[tag].push_back (reloff);
+    }
+
+  return ui;
+}
+
+std::vector <Dwarf_Off>
+tag_cache::find (Dwarf_Die cudie, size_t dwidx,
+		 std::vector <int> const &tags)
+{
+  Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
+  auto key = std::make_pair (dwidx, cuoff);
+
+  // See parent_cache::locate for why this is enough locking.
+  unit_index const *ui = nullptr;
+  {
+    std::lock_guard <std::mutex> lock {m_mutex};
+    auto it = m_cache.find (key);
+    if (it != m_cache.end ())
+      ui = &it->second;
+  }
+  if (ui == nullptr)
+    {
+      auto nui = build_index (cudie);
+      std::lock_guard <std::mutex> lock {m_mutex};
+      ui = &m_cache.insert (std::make_pair (key, std::move (nui)))
+		.first->second;
+    }
+
+  std::vector <Dwarf_Off> ret;
+  for (int tag: tags)
+    {
+      auto it = ui->find (tag);
+      if (it != ui->end ())
+	for (uint32_t reloff: it->second)
+	  ret.push_back (cuoff + reloff);
+    }
+
+  // Lists of several tags need to be merged.
+  if (tags.size () > 1)
+    std::sort (ret.begin (), ret.end ());
+
+  return ret;
+}
+
+
+bool
+abbrev_summary::has (unsigned atname) const
+{
+  if (atname < m_low.size ())
+    return m_low.test (atname);
+  return std::binary_search (m_high.begin (), m_high.end (), atname);
+}
+
+bool
+abbrev_summary::find_fixed (Dwarf_Die &die, unsigned atname,
+			    Dwarf_Attribute &at) const
+{
+  auto it = std::find_if (m_fixed.begin (), m_fixed.end (),
+			  [atname] (fixed_attr const &fa)
+			  { return fa.m_name == atname; });
+  if (it == m_fixed.end ())
+    return false;
+
+  // Attribute data follow the abbreviation code, a ULEB128.
+  auto p = static_cast <unsigned char *> (die.addr);
+  while (*p++ & 0x80)
+    ;
+
+  at.code = it->m_name;
+  at.form = it->m_form;
+  at.valp = p + it->m_off;
+  at.cu = die.cu;
+  return true;
+}
+
+namespace
+{
+  // Size of data of an attribute with FORM, or -1 if that is not
+  // known up front.
+  ssize_t
+  form_size (unsigned form, uint8_t address_size, uint8_t offset_size)
+  {
+    switch (form)
+      {
+      case DW_FORM_flag_present:
+	return 0;
+
+      case DW_FORM_data1:
+      case DW_FORM_ref1:
+      case DW_FORM_flag:
+	return 1;
+
+      case DW_FORM_data2:
+      case DW_FORM_ref2:
+	return 2;
+
+      case DW_FORM_data4:
+      case DW_FORM_ref4:
+	return 4;
+
+      case DW_FORM_data8:
+      case DW_FORM_ref8:
+      case DW_FORM_ref_sig8:
+	return 8;
+
+      case DW_FORM_addr:
+	return address_size;
+
+      case DW_FORM_strp:
+      case DW_FORM_sec_offset:
+	return offset_size;
+
+      default:
+	return -1;
+      }
+  }
+}
+
+abbrev_summary
+abbrev_cache::summarize (Dwarf_Die &die)
+{
+  Dwarf_Die cudie;
+  uint8_t address_size, offset_size;
+  if (dwarf_cu_die (die.cu, &cudie, nullptr, nullptr,
+		    &address_size, &offset_size, nullptr, nullptr) == nullptr)
+    throw_libdw ();
+
+  abbrev_summary ret;
+  bool fixed = true;
+  size_t off = 0;
+
+  size_t cnt = dwpp_abbrev_attrcnt (*die.abbrev);
+  for (size_t i = 0; i < cnt; ++i)
+    {
+      unsigned int name;
+      unsigned int form;
+      if (dwarf_getabbrevattr (die.abbrev, i, &name, &form, nullptr) != 0)
+	throw_libdw ();
+
+      if (name < ret.m_low.size ())
+	ret.m_low.set (name);
+      else
+	ret.m_high.push_back (name);
+
+      ssize_t size = form_size (form, address_size, offset_size);
+      if (size < 0)
+	fixed = false;
+      if (fixed)
+	{
+	  ret.m_fixed.push_back ({name, form, off});
+	  off += size;
+	}
+    }
+
+  std::sort (ret.m_high.begin (), ret.m_high.end ());
+  return ret;
+}
+
+abbrev_cache::abbrev_cache ()
+  : m_last_abbrev {nullptr}
+  , m_last {nullptr}
+{}
+
+abbrev_summary const &
+abbrev_cache::get (Dwarf_Die &die)
+{
+  // If the DIE doesn't have an abbreviation yet, force its look-up.
+  if (die.abbrev == nullptr)
+    dwarf_haschildren (&die);
+  assert (die.abbrev != nullptr);
+
+  if (die.abbrev != m_last_abbrev)
+    {
+      auto it = m_cache.find (die.abbrev);
+      if (it == m_cache.end ())
+	it = m_cache.insert (std::make_pair (die.abbrev, summarize (die)))
+		.first;
+      m_last_abbrev = die.abbrev;
+      m_last = &it->second;
+    }
+
+  return *m_last;
 }
@@ -29,39 +29,191 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include <cstdint>
+#include <bitset>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <elfutils/libdw.h>
 
+// The parent and root caches are keyed by index of a Dwarf among
+// Dwarfs of a Dwfl rather than by the Dwarf itself, so that they can
+// be shared by several Dwfl handles opened for the same file, which
+// may be used from several threads.
+
+// Parents of DIE's are looked up in a flat index built for each unit
+// on first use.  DIE's of a unit are numbered in the order that they
+// appear in the unit, which is also the order of their offsets.  For
+// each DIE, the index holds its offset relative to the unit DIE, its
+// depth, and its tag as an index into a table of tags of the unit.
+// That makes for seven bytes per DIE.  Minima of depths over blocks
+// of DIE's, and over blocks of those blocks and so on, add well under
+// a byte more.
+//
+// As the numbering is pre-order, the parent of a DIE is the closest
+// DIE before it that is less deep, and a DIE is an ancestor of the
+// DIE's after it up to the next one that is at most as deep.  The
+// block minima let both be found by scanning at most a few blocks on
+// each level, i.e. in logarithmic time.
 class parent_cache
 {
-  using unit_cache_t = std::vector <std::pair <Dwarf_Off, Dwarf_Off>>;
-  using cache_t = std::map <std::pair <Dwarf *, Dwarf_Off>, unit_cache_t>;
+  struct unit_index
+  {
+    static uint32_t const no_idx = (uint32_t) -1;
+    static uint8_t const other_tag = 0xff;
+    static size_t const block_size = 32;
 
+    // Offset of the unit DIE.
+    Dwarf_Off m_cuoff;
+
+    // Offsets of DIE's relative to m_cuoff, sorted.
+    std::vector <uint32_t> m_offs;
+
+    // Depths of DIE's.  The unit DIE is at depth 0.
+    std::vector <uint16_t> m_depths;
+
+    // m_mins[0] holds minima of m_depths over blocks of block_size
+    // DIE's, and each further level minima of the one before, up to a
+    // level with a single entry.
+    std::vector <std::vector <uint16_t>> m_mins;
+
+    // Tags of DIE's, as indices into m_tags.  Should a unit use more
+    // tags than fit, the rest is noted as other_tag, and read from
+    // the DIE itself.
+    std::vector <uint8_t> m_tagidx;
+    std::vector <int> m_tags;
+
+    std::vector <uint16_t> const &
+    level (size_t k) const
+    {
+      return k == 0 ? m_depths : m_mins[k - 1];
+    }
+
+    void build_mins ();
+
+    // Number of the closest DIE before IDX whose depth is at most
+    // DEPTH, or no_idx if there is none.
+    uint32_t last_at_most (uint32_t idx, uint16_t depth) const;
+
+    int tag (uint32_t idx, Dwarf *dw) const;
+  };
+
+  using cache_t = std::map <std::pair <size_t, Dwarf_Off>, unit_index>;
+
+  std::mutex m_mutex;
   cache_t m_cache;
 
-  void recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-				  Dwarf_Off paroff);
-  unit_cache_t populate_unit (Dwarf_Die die);
+  static unit_index build_index (Dwarf_Die cudie);
+
+  // Find the index of the unit that DIE belongs to, building it if
+  // necessary, and the number of DIE in that index.
+  std::pair <unit_index const *, uint32_t> locate (Dwarf_Die die,
+						   size_t dwidx);
 
 public:
   static Dwarf_Off const no_off = (Dwarf_Off) -1;
-  Dwarf_Off find (Dwarf_Die die);
+
+  // Return offset of parent of DIE, or no_off if DIE is a unit DIE.
+  Dwarf_Off find (Dwarf_Die die, size_t dwidx);
+
+  // Return offset of the closest ancestor of DIE whose tag is TAG, or
+  // no_off if there is none.
+  Dwarf_Off find_ancestor (Dwarf_Die die, size_t dwidx, int tag);
+
+  // Return the number of ancestors of DIE.
+  unsigned depth (Dwarf_Die die, size_t dwidx);
+
+  // Whether ANC is an ancestor of DIE.  Both DIE's shall come from
+  // the same Dwarf.  A DIE is not its own ancestor.
+  bool is_ancestor (Dwarf_Die anc, Dwarf_Die die, size_t dwidx);
 };
 
 class root_cache
 {
   using off_vect = std::vector <Dwarf_Off>;
-  using cache_t = std::map <Dwarf *, off_vect>;
+  using cache_t = std::map <size_t, off_vect>;
 
+  std::mutex m_mutex;
   cache_t m_cache;
 
 public:
-  bool is_root (Dwarf_Die die);
+  bool is_root (Dwarf_Die die, size_t dwidx);
 };
 
+// DIE's of a unit grouped by their tag.  The index for a unit is
+// built on first use, in one pass over the unit, and holds for each
+// tag that occurs there a list of offsets of DIE's with that tag,
+// relative to the unit DIE and in the order that the DIE's appear in
+// the unit.
+class tag_cache
+{
+  using unit_index = std::unordered_map <int, std::vector <uint32_t>>;
+  using cache_t = std::map <std::pair <size_t, Dwarf_Off>, unit_index>;
+
+  std::mutex m_mutex;
+  cache_t m_cache;
+
+  static unit_index build_index (Dwarf_Die cudie);
+
+public:
+  // Return offsets of DIE's of the unit whose unit DIE is CUDIE, and
+  // whose tag is one of TAGS, in ascending order.
+  std::vector <Dwarf_Off> find (Dwarf_Die cudie, size_t dwidx,
+				std::vector <int> const &tags);
+};
+
+
+// What an abbreviation says about DIE's that use it.
+struct abbrev_summary
+{
+  // Names of attributes that the abbreviation declares.  Those below
+  // 256, which covers all standard attributes, are kept as a bitset,
+  // the rest as a sorted vector.
+  std::bitset <256> m_low;
+  std::vector <unsigned> m_high;
+
+  // Attributes whose data start at the same offset in each DIE that
+  // uses the abbreviation, i.e. those that are only preceded by
+  // attributes with forms of known size.
+  struct fixed_attr
+  {
+    unsigned m_name;
+    unsigned m_form;
+    size_t m_off;
+  };
+  std::vector <fixed_attr> m_fixed;
+
+  bool has (unsigned atname) const;
+
+  // If attribute ATNAME of DIE, which uses this abbreviation, is at a
+  // fixed offset, fill in AT and return true.  Otherwise return false
+  // and leave the look-up to libdw.
+  bool find_fixed (Dwarf_Die &die, unsigned atname,
+		   Dwarf_Attribute &at) const;
+};
+
+// Summaries of abbreviations, built on first use.  libdw keeps a
+// separate copy of an abbreviation for each unit that uses it, so the
+// cache is keyed by the abbreviation itself.  That makes it specific
+// to one Dwfl handle, and it is meant to be used from one thread.
+class abbrev_cache
+{
+  std::unordered_map <Dwarf_Abbrev const *, abbrev_summary> m_cache;
+
+  // The summary looked up last.  Consecutive look-ups tend to be for
+  // the same DIE, or for DIE's of the same sort.
+  Dwarf_Abbrev const *m_last_abbrev;
+  abbrev_summary const *m_last;
+
+  static abbrev_summary summarize (Dwarf_Die &die);
+
+public:
+  abbrev_cache ();
+  abbrev_summary const &get (Dwarf_Die &die);
+};
 
 #endif /* _CACHE_H_ */
@@ -26,47 +26,274 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <system_error>
+
 #include "std-memory.hh"
 #include "dwfl_context.hh"
 #include "cache.hh"
 #include "dwit.hh"
 
-struct dwfl_context::pimpl
+namespace
 {
-  parent_cache m_parcache;
-  root_cache m_rootcache;
+  int
+  prime_dwflmod (Dwfl_Module *dwflmod, void **userdata, const char *name,
+		 Dwarf_Addr base, void *arg)
+  {
+    // Prime the ELF file associated with a Dwfl module.  This is
+    // necessary when later we request a Dwarf.  For dwz files, that
+    // would fail with a message about missing symbol table, but it
+    // doesn't if we first prime the ELF file.
+    GElf_Addr bias;
+    if (dwfl_module_getelf (dwflmod, &bias) == nullptr)
+      throw_libdwfl ();
+
+    return DWARF_CB_OK;
+  }
+
+  struct fd_handle
+  {
+    int fd;
+    operator int () { return fd; }
+
+    fd_handle () : fd {-1} {}
+    fd_handle (int fd) : fd {fd} {}
+
+    int release ()
+    {
+      int ret = fd;
+      fd = -1;
+      return ret;
+    }
 
-  Dwarf_Off
-  find_parent (Dwarf_Die die)
+    ~fd_handle ()
+    {
+      if (fd != -1)
+	close (fd);
+    }
+  };
+
+  std::shared_ptr <Dwfl>
+  open_dwfl (std::string const &fn)
   {
-    return m_parcache.find (die);
+    fd_handle fd = open (fn.c_str (), O_RDONLY);
+    if (fd == -1)
+      throw std::runtime_error
+	(std::error_code (errno, std::system_category ()).message ());
+
+    const static Dwfl_Callbacks callbacks =
+      {
+	.find_elf = dwfl_build_id_find_elf,
+	.find_debuginfo = dwfl_standard_find_debuginfo,
+	.section_address = dwfl_offline_section_address,
+      };
+
+    elf_version (EV_CURRENT);
+
+    auto dwfl = std::shared_ptr <Dwfl> (dwfl_begin (&callbacks), dwfl_end);
+    if (dwfl == nullptr)
+      throw_libdwfl ();
+
+    if (dwfl_report_offline (&*dwfl, fn.c_str (), fn.c_str (), fd) == nullptr)
+      throw_libdwfl ();
+
+    // At this point the handle was consumed by dwfl_report_offline.
+    fd.release ();
+
+    if (dwfl_report_end (&*dwfl, nullptr, nullptr) != 0)
+      throw_libdwfl ();
+
+    dwfl_getmodules (&*dwfl, &prime_dwflmod, nullptr, 0);
+
+    return dwfl;
   }
 
-  bool
-  is_root (Dwarf_Die die)
+  // Like all_dwarfs, but modules without debuginfo are skipped
+  // instead of failing, so that files without DWARF can still be
+  // opened.  Queries that need DWARF of such files fail later on,
+  // when they call all_dwarfs.
+  std::vector <Dwarf *>
+  module_dwarfs (Dwfl *dwfl)
   {
-    return m_rootcache.is_root (die);
+    std::vector <Dwarf *> ret;
+    for (auto it = dwfl_module_iterator {dwfl};
+	 it != dwfl_module_iterator::end (); ++it)
+      {
+	Dwarf_Addr bias;
+	if (Dwarf *dw = dwfl_module_getdwarf (*it, &bias))
+	  {
+	    ret.push_back (dw);
+	    if (Dwarf *alt = dwarf_getalt (dw))
+	      ret.push_back (alt);
+	  }
+      }
+    return ret;
   }
+}
+
+struct dwfl_context::pimpl
+{
+  parent_cache m_parcache;
+  root_cache m_rootcache;
+  tag_cache m_tagcache;
+
+  // Handles of threads that asked for one.
+  std::mutex m_mutex;
+  std::map <std::thread::id, std::shared_ptr <Dwfl>> m_handles;
 };
 
+dwfl_context::dwfl_context (std::shared_ptr <pimpl> pi,
+			    std::shared_ptr <Dwfl> dwfl,
+			    std::string const &fn, std::thread::id thread)
+  : m_pimpl {pi}
+  , m_dwfl {dwfl}
+  , m_fn {fn}
+  , m_thread {thread}
+  , m_dwarfs {module_dwarfs (&*m_dwfl)}
+  , m_abbrevs {std::make_unique <abbrev_cache> ()}
+{}
+
 dwfl_context::dwfl_context (std::shared_ptr <Dwfl> dwfl)
-  : m_pimpl {std::make_unique <pimpl> ()}
+  : m_pimpl {std::make_shared <pimpl> ()}
   , m_dwfl {dwfl}
+  , m_thread {std::this_thread::get_id ()}
+  , m_dwarfs {module_dwarfs (&*m_dwfl)}
+  , m_abbrevs {std::make_unique <abbrev_cache> ()}
 {}
 
+dwfl_context::dwfl_context (std::string const &fn)
+  : m_pimpl {std::make_shared <pimpl> ()}
+  , m_dwfl {open_dwfl (fn)}
+  , m_fn {fn}
+  , m_thread {std::this_thread::get_id ()}
+  , m_dwarfs {module_dwarfs (&*m_dwfl)}
+  , m_abbrevs {std::make_unique <abbrev_cache> ()}
+{
+  m_pimpl->m_handles.insert (std::make_pair (m_thread, m_dwfl));
+}
+
 dwfl_context::~dwfl_context ()
 {}
 
+size_t
+dwfl_context::dwarf_index (Dwarf *dw) const
+{
+  auto it = std::find (m_dwarfs.begin (), m_dwarfs.end (), dw);
+  assert (it != m_dwarfs.end ());
+  return it - m_dwarfs.begin ();
+}
+
 Dwarf_Off
 dwfl_context::find_parent (Dwarf_Die die)
 {
-  return m_pimpl->find_parent (die);
+  return m_pimpl->m_parcache.find (die,
+				   dwarf_index (dwarf_cu_getdwarf (die.cu)));
+}
+
+Dwarf_Off
+dwfl_context::find_ancestor (Dwarf_Die die, int tag)
+{
+  return m_pimpl->m_parcache.find_ancestor
+    (die, dwarf_index (dwarf_cu_getdwarf (die.cu)), tag);
+}
+
+unsigned
+dwfl_context::die_depth (Dwarf_Die die)
+{
+  return m_pimpl->m_parcache.depth (die,
+				    dwarf_index (dwarf_cu_getdwarf (die.cu)));
+}
+
+bool
+dwfl_context::is_ancestor (Dwarf_Die anc, Dwarf_Die die)
+{
+  Dwarf *dw = dwarf_cu_getdwarf (die.cu);
+  if (dwarf_cu_getdwarf (anc.cu) != dw)
+    return false;
+  return m_pimpl->m_parcache.is_ancestor (anc, die, dwarf_index (dw));
+}
+
+std::vector <Dwarf_Off>
+dwfl_context::find_tagged (Dwarf_Die cudie, std::vector <int> const &tags)
+{
+  return m_pimpl->m_tagcache.find
+    (cudie, dwarf_index (dwarf_cu_getdwarf (cudie.cu)), tags);
 }
 
 bool
 dwfl_context::is_root (Dwarf_Die die)
 {
-  return m_pimpl->is_root (die);
+  return m_pimpl->m_rootcache.is_root (die,
+				       dwarf_index (dwarf_cu_getdwarf (die.cu)));
+}
+
+std::shared_ptr <dwfl_context>
+dwfl_context::reopen () const
+{
+  if (m_fn.empty ())
+    return nullptr;
+  return std::shared_ptr <dwfl_context>
+    (new dwfl_context (m_pimpl, open_dwfl (m_fn), m_fn, std::thread::id {}));
+}
+
+std::shared_ptr <dwfl_context>
+dwfl_context::for_this_thread ()
+{
+  auto id = std::this_thread::get_id ();
+  if (m_fn.empty () || m_thread == id)
+    return shared_from_this ();
+
+  std::shared_ptr <Dwfl> dwfl;
+  {
+    std::lock_guard <std::mutex> lock {m_pimpl->m_mutex};
+    auto it = m_pimpl->m_handles.find (id);
+    if (it != m_pimpl->m_handles.end ())
+      dwfl = it->second;
+  }
+
+  // Only this thread ever adds a handle for itself, so the file can
+  // be opened without holding the lock.
+  if (dwfl == nullptr)
+    {
+      dwfl = open_dwfl (m_fn);
+      std::lock_guard <std::mutex> lock {m_pimpl->m_mutex};
+      m_pimpl->m_handles.insert (std::make_pair (id, dwfl));
+    }
+
+  return std::shared_ptr <dwfl_context>
+    (new dwfl_context (m_pimpl, dwfl, m_fn, id));
+}
+
+Dwarf *
+dwfl_context::translate (dwfl_context const &from, Dwarf *dw)
+{
+  if (&from == this)
+    return dw;
+
+  size_t idx = from.dwarf_index (dw);
+  assert (idx < m_dwarfs.size ());
+  return m_dwarfs[idx];
+}
+
+Dwarf_Die
+dwfl_context::translate (dwfl_context const &from, Dwarf_Die die)
+{
+  if (&from == this)
+    return die;
+
+  Dwarf_Die ret;
+  if (dwarf_offdie (translate (from, dwarf_cu_getdwarf (die.cu)),
+		    dwarf_dieoffset (&die), &ret) == nullptr)
+    throw_libdw ();
+  return ret;
 }
 
 int
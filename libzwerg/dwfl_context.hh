@@ -30,25 +30,106 @@
 #define _DWFL_CONTEXT_H_
 
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include <elfutils/libdwfl.h>
 
+class abbrev_cache;
+
 // This represents a Dwfl handle together with some query caches.
+//
+// A Dwfl handle must not be used by several threads at once.  A
+// context opened from a file can therefore provide further handles
+// for the same file, one for each thread that asks.  All handles
+// opened for one file share the query caches, which refer to DIE's
+// by offset and so apply to any of them.
 class dwfl_context
+  : public std::enable_shared_from_this <dwfl_context>
 {
+  // State shared by all handles opened for one file.
   class pimpl;
-  std::unique_ptr <pimpl> m_pimpl;
+  std::shared_ptr <pimpl> m_pimpl;
   std::shared_ptr <Dwfl> m_dwfl;
 
+  // Name of the file that the Dwfl was opened from, or an empty
+  // string if the Dwfl was provided from outside.
+  std::string m_fn;
+
+  // The thread that this handle belongs to.  Handles opened by
+  // reopen don't belong to any thread.
+  std::thread::id m_thread;
+
+  // Dwarfs of this handle, in the order that all_dwarfs lists them.
+  // Filled when the handle is opened and not changed afterwards, so
+  // that other threads can translate DIE's of this handle to their
+  // own (see translate).
+  std::vector <Dwarf *> m_dwarfs;
+
+  // Abbreviations refer to this handle's Dwarfs, so unlike the query
+  // caches, this one is not shared.
+  std::unique_ptr <abbrev_cache> m_abbrevs;
+
+  dwfl_context (std::shared_ptr <pimpl> pi, std::shared_ptr <Dwfl> dwfl,
+		std::string const &fn, std::thread::id thread);
+
 public:
   explicit dwfl_context (std::shared_ptr <Dwfl> dwfl);
+
+  // Open file FN.  The handle belongs to the calling thread.
+  explicit dwfl_context (std::string const &fn);
+
   ~dwfl_context ();
 
+  // Open the file that this context was opened from anew, and return
+  // a context with an independent Dwfl handle that shares caches
+  // with this one.  Returns nullptr if the Dwfl was not opened from a
+  // file.
+  std::shared_ptr <dwfl_context> reopen () const;
+
+  bool can_reopen () const
+  { return ! m_fn.empty (); }
+
+  // Return a context for the same file whose handle belongs to the
+  // calling thread.  That is this context itself if it belongs to
+  // the calling thread, or if it was not opened from a file.
+  // Otherwise each thread gets a handle of its own, opened the first
+  // time the thread asks for one, and kept for the later requests.
+  std::shared_ptr <dwfl_context> for_this_thread ();
+
   Dwfl *get_dwfl ()
   { return &*m_dwfl; }
 
+  // Translate DW, a Dwarf of FROM, to the corresponding Dwarf of this
+  // context.  Both contexts have to refer to the same file.  FROM may
+  // belong to another thread, as its Dwfl is not touched.
+  Dwarf *translate (dwfl_context const &from, Dwarf *dw);
+
+  // Translate DIE, which comes from FROM, to the DIE at the same
+  // offset in this context.
+  Dwarf_Die translate (dwfl_context const &from, Dwarf_Die die);
+
   Dwarf_Off find_parent (Dwarf_Die die);
   bool is_root (Dwarf_Die die);
+
+  // See parent_cache for these.  DIE's from different Dwarfs are
+  // never ancestors of one another.
+  Dwarf_Off find_ancestor (Dwarf_Die die, int tag);
+  unsigned die_depth (Dwarf_Die die);
+  bool is_ancestor (Dwarf_Die anc, Dwarf_Die die);
+
+  // See tag_cache.
+  std::vector <Dwarf_Off> find_tagged (Dwarf_Die cudie,
+				       std::vector <int> const &tags);
+
   int get_machine () const;
+
+  abbrev_cache &get_abbrev_cache ()
+  { return *m_abbrevs; }
+
+private:
+  // Index of DW within m_dwarfs.
+  size_t dwarf_index (Dwarf *dw) const;
 };
 
 #endif /* _DWFL_CONTEXT_H_ */
@@ -385,3 +385,33 @@ all_dies_iterator::cu () const
 {
   return m_cuit;
 }
+
+die_attrs::die_attrs ()
+  : m_size {0}
+{}
+
+die_attrs::die_attrs (Dwarf_Die &die)
+  : m_size {0}
+{
+  if (dwarf_getattrs (&die, &callback, this, 0) == -1)
+    throw_libdw ();
+}
+
+int
+die_attrs::callback (Dwarf_Attribute *at, void *data)
+{
+  die_attrs &self = *static_cast<die_attrs *> (data);
+
+  if (self.m_size < inline_size)
+    self.m_inline[self.m_size] = *at;
+  else
+    {
+      // Spill to the heap, keeping the attributes contiguous.
+      if (self.m_more.empty ())
+	self.m_more.assign (self.m_inline, self.m_inline + inline_size);
+      self.m_more.push_back (*at);
+    }
+
+  ++self.m_size;
+  return DWARF_CB_OK;
+}
@@ -179,103 +179,42 @@ public:
   cu_iterator cu () const;
 };
 
-class attr_iterator
-  : public std::iterator<std::input_iterator_tag, Dwarf_Attribute *>
+// Attributes of a DIE, decoded in a single walk over its
+// abbreviation.  Most DIE's have only a handful of attributes, and
+// those are kept in an inline buffer.
+class die_attrs
 {
-  Dwarf_Die *m_die;
-  Dwarf_Attribute m_at;
-  ptrdiff_t m_offset;
-
-  struct cb_data
-  {
-    Dwarf_Attribute *at;
-    bool been;
-  };
+  static size_t const inline_size = 16;
 
-  static int
-  callback (Dwarf_Attribute *at, void *data)
-  {
-    cb_data *d = static_cast<cb_data *> (data);
-    if (d->been)
-      return DWARF_CB_ABORT;
-
-    *d->at = *at;
-    d->been = true;
+  Dwarf_Attribute m_inline[inline_size];
+  std::vector<Dwarf_Attribute> m_more;
+  size_t m_size;
 
-    // Do a second iteration to find the next offset.
-    return DWARF_CB_OK;
-  }
-
-  void
-  move ()
-  {
-    // If m_offset is already 1, we are done iterating.
-    if (m_offset == 1)
-      {
-	*this = end ();
-	return;
-      }
-
-    cb_data data = {&m_at, false};
-    m_offset = dwarf_getattrs (m_die, &callback, &data, m_offset);
-    if (m_offset == -1)
-      throw_libdw ();
-  }
-
-  attr_iterator (ptrdiff_t offset)
-    : m_die (nullptr)
-    , m_at ({0})
-    , m_offset (offset)
-  {}
+  static int callback (Dwarf_Attribute *at, void *data);
 
 public:
-  attr_iterator (Dwarf_Die *die)
-    : m_die (die)
-    , m_at ({0})
-    , m_offset (0)
-  {
-    move ();
-  }
-
-  bool
-  operator== (attr_iterator const &other) const
-  {
-    return m_offset == other.m_offset
-      && m_at.code == other.m_at.code;
-  }
+  die_attrs ();
+  explicit die_attrs (Dwarf_Die &die);
 
-  bool
-  operator!= (attr_iterator const &other) const
-  {
-    return !(*this == other);
-  }
-
-  attr_iterator &
-  operator++ ()
-  {
-    assert (*this != end ());
-    move ();
-    return *this;
-  }
+  size_t size () const { return m_size; }
 
-  attr_iterator
-  operator++ (int)
+  Dwarf_Attribute const *
+  begin () const
   {
-    attr_iterator tmp = *this;
-    ++*this;
-    return tmp;
+    return m_more.empty () ? m_inline : m_more.data ();
   }
 
-  Dwarf_Attribute *
-  operator* ()
+  Dwarf_Attribute const *
+  end () const
   {
-    return &m_at;
+    return begin () + m_size;
   }
 
-  static attr_iterator
-  end ()
+  Dwarf_Attribute const &
+  operator[] (size_t i) const
   {
-    return attr_iterator ((ptrdiff_t)1);
+    assert (i < m_size);
+    return begin ()[i];
   }
 };
 
@@ -29,9 +29,17 @@
 #include "libzwerg-dw.h"
 #include "libzwerg.hh"
 
+#include <algorithm>
+#include <thread>
+
+#include "atval.hh"
 #include "builtin-dw.hh"
+#include "dwit.hh"
+#include "op.hh"
+#include "parallel-dw.hh"
 #include "value-aset.hh"
 #include "value-dw.hh"
+#include "value-seq.hh"
 #include "value-symbol.hh"
 #include "dwcst.hh"
 
@@ -201,6 +209,44 @@ zw_value_is_dwarf (zw_value const *val)
   return val->is <value_dwarf> ();
 }
 
+zw_result *
+zw_query_execute_units_parallel (zw_query const *query,
+				 zw_stack const *input_stack,
+				 unsigned nthreads, bool ordered,
+				 zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      static_profile profile;
+      for (auto const &emt: input_stack->m_values)
+	profile.push (emt->get_type ());
+
+      tree t = query->m_query;
+      bool unchecked = t.peg_overloads (profile);
+
+      // The split looks for a plain unit or entry, so it has to see
+      // the query before strength reduction folds filters into them.
+      if (auto job = split_dwarf_units (t, input_stack->m_values))
+	{
+	  if (nthreads == 0)
+	    nthreads = std::max (1u, std::thread::hardware_concurrency ());
+	  return new zw_result
+	    { std::make_shared <op_parallel> (job, nthreads, ordered), nullptr };
+	}
+
+      t.reduce_strength ();
+
+      auto stk = std::make_unique <stack> ();
+      if (unchecked)
+	stk->set_unchecked ();
+      for (auto const &emt: input_stack->m_values)
+	stk->push (emt->clone ());
+
+      return new zw_result
+	{ t.build_exec (std::make_shared <op_origin> (std::move (stk))),
+	  nullptr };
+    }, nullptr, out_err);
+}
+
 bool
 zw_value_is_cu (zw_value const *val)
 {
@@ -345,6 +391,23 @@ zw_value_die_dwarf (zw_value const *val, zw_error **out_err)
     }, nullptr, out_err);
 }
 
+zw_value *
+zw_value_die_attributes_raw (zw_value const *val, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      value_die const &d = die (val);
+      value_die rawdie {d.get_dwctx (), d.get_die (), 0, doneness::raw};
+
+      value_seq::seq_t seq;
+      size_t i = 0;
+      for (auto const &at: die_attrs {rawdie.get_die ()})
+	seq.push_back (std::make_unique <value_attr>
+		       (rawdie, at, i++, doneness::raw));
+
+      return new value_seq {std::move (seq), 0};
+    }, nullptr, out_err);
+}
+
 namespace
 {
   value_attr const &
@@ -369,6 +432,22 @@ zw_value_attr_dwarf (zw_value const *val, zw_error **out_err)
     }, nullptr, out_err);
 }
 
+zw_value *
+zw_value_attr_values (zw_value const *val, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      value_attr const &a = attr (val);
+      auto prod = at_value (a.get_dwctx (), a.get_value_die (),
+			    a.get_attr ());
+
+      value_seq::seq_t seq;
+      while (auto v = prod->next ())
+	seq.push_back (std::move (v));
+
+      return new value_seq {std::move (seq), 0};
+    }, nullptr, out_err);
+}
+
 
 namespace
 {
@@ -176,6 +176,28 @@ extern "C" {
   zw_machine const *zw_value_dwarf_machine (zw_value const *dw,
 					    zw_error **out_err);
 
+  // Like zw_query_execute, but if QUERY starts with "unit" or
+  // "entry", and the value on top of INPUT_STACK is a DWARF (ELF)
+  // value that was opened from a file, run the query separately for
+  // each unit of that file, on NTHREADS threads.  If NTHREADS is 0, a
+  // thread per processor is used.  If ORDERED, results come in the
+  // same order that zw_query_execute would produce them, otherwise
+  // results of each unit come as soon as that unit is done.
+  //
+  // Each thread opens the file anew, so values yielded for different
+  // units may come from different Dwfl handles.  Queries that can't
+  // be split this way are run like zw_query_execute would run them.
+  // Those include queries that start with "entry" and use "pos",
+  // and queries run on stacks that hold anything but constants and
+  // strings below the DWARF value.
+  //
+  // Returns NULL on error, in which case it sets *OUT_ERR.  OUT_ERR
+  // shall be non-NULL.
+  zw_result *zw_query_execute_units_parallel (zw_query const *query,
+					      zw_stack const *input_stack,
+					      unsigned nthreads, bool ordered,
+					      zw_error **out_err);
+
 
   /**
    * CU.
@@ -228,6 +250,15 @@ extern "C" {
   // *OUT_ERR.  OUT_ERR shall be non-NULL.
   zw_value const *zw_value_die_dwarf (zw_value const *die, zw_error **out_err);
 
+  // Return a new sequence value with raw attributes of DIE, which
+  // shall be a DIE value.  This is equivalent to Zwerg query "[raw
+  // attribute]", but doesn't go through the query engine.  Returns
+  // NULL on error, in which case it sets *OUT_ERR.  OUT_ERR shall be
+  // non-NULL.  The returned value shall be released with
+  // zw_value_destroy.
+  zw_value *zw_value_die_attributes_raw (zw_value const *die,
+					 zw_error **out_err);
+
 
   /**
    * DIE attribute.
@@ -247,6 +278,14 @@ extern "C" {
   zw_value const *zw_value_attr_dwarf (zw_value const *attr,
 				       zw_error **out_err);
 
+  // Return a new sequence value with all values of ATTR, which shall
+  // be an attribute value.  This is equivalent to Zwerg query
+  // "[value]", but doesn't go through the query engine.  Returns NULL
+  // on error, in which case it sets *OUT_ERR.  OUT_ERR shall be
+  // non-NULL.  The returned value shall be released with
+  // zw_value_destroy.
+  zw_value *zw_value_attr_values (zw_value const *attr, zw_error **out_err);
+
 
   /**
    * Location list element.
@@ -36,6 +36,7 @@
 #include "init.hh"
 #include "op.hh"
 #include "parser.hh"
+#include "profile.hh"
 #include "stack.hh"
 #include "tree.hh"
 
@@ -139,6 +140,20 @@ zw_stack_at (zw_stack const *stack, size_t depth)
   return stack->m_values[stack->m_values.size () - 1 - depth].get ();
 }
 
+size_t
+zw_stack_view_depth (zw_stack_view const *view)
+{
+  return view->m_stack->size ();
+}
+
+zw_value const *
+zw_stack_view_at (zw_stack_view const *view, size_t depth)
+{
+  assert (view != nullptr);
+  assert (depth < view->m_stack->size ());
+  return &view->m_stack->get (depth);
+}
+
 
 zw_query *
 zw_query_parse (zw_vocabulary const *voc, char const *query,
@@ -155,6 +170,7 @@ zw_query_parse_len (zw_vocabulary const *voc,
   return capture_errors ([&] () {
       tree t = parse_query (*voc->m_voc, {query, query_len});
       t.simplify ();
+      t.peg_overloads ();
       return new zw_query { t };
     }, nullptr, out_err);
 }
@@ -178,16 +194,118 @@ zw_value_destroy (zw_value *value)
 }
 
 
+namespace
+{
+  std::unique_ptr <stack>
+  make_stack (zw_stack const *input_stack, bool unchecked)
+  {
+    auto stk = std::make_unique <stack> ();
+    if (unchecked)
+      stk->set_unchecked ();
+    // The input stack may have been filled on another thread.
+    for (auto const &emt: input_stack->m_values)
+      stk->push (emt->clone_for_this_thread ());
+    return stk;
+  }
+
+  static_profile
+  make_profile (zw_stack const *input_stack)
+  {
+    static_profile ret;
+    for (auto const &emt: input_stack->m_values)
+      ret.push (emt->get_type ());
+    return ret;
+  }
+}
+
+namespace
+{
+  zw_result *
+  execute (zw_query const *query, zw_stack const *input_stack,
+	   std::shared_ptr <profile> prof)
+  {
+    // Overloads were pegged when the query was parsed, but now that
+    // the input is known, more of them may be.
+    tree t = query->m_query;
+    bool unchecked = t.peg_overloads (make_profile (input_stack));
+    t.reduce_strength ();
+    auto upstream = std::make_shared <op_origin>
+      (make_stack (input_stack, unchecked));
+
+    profile::build_scope scope {prof};
+    return new zw_result { t.build_exec (upstream), prof };
+  }
+}
+
 zw_result *
 zw_query_execute (zw_query const *query, zw_stack const *input_stack,
 		  zw_error **out_err)
 {
   return capture_errors ([&] () {
-      auto stk = std::make_unique <stack> ();
-      for (auto const &emt: input_stack->m_values)
-	stk->push (emt->clone ());
-      auto upstream = std::make_shared <op_origin> (std::move (stk));
-      return new zw_result { query->m_query.build_exec (upstream) };
+      return execute (query, input_stack, nullptr);
+    }, nullptr, out_err);
+}
+
+zw_result *
+zw_query_execute_profiled (zw_query const *query,
+			   zw_stack const *input_stack, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      return execute (query, input_stack, std::make_shared <profile> ());
+    }, nullptr, out_err);
+}
+
+zw_prepared_query *
+zw_query_prepare (zw_query const *query, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      return new zw_prepared_query { query->m_query, {}, false,
+				     nullptr, nullptr, nullptr };
+    }, nullptr, out_err);
+}
+
+zw_prepared_query *
+zw_query_prepare_profiled (zw_query const *query, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      return new zw_prepared_query { query->m_query, {}, false,
+				     nullptr, nullptr,
+				     std::make_shared <profile> () };
+    }, nullptr, out_err);
+}
+
+void
+zw_prepared_query_destroy (zw_prepared_query *prepared)
+{
+  delete prepared;
+}
+
+zw_result *
+zw_prepared_query_execute (zw_prepared_query *prepared,
+			   zw_stack const *input_stack, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      auto profile = make_profile (input_stack);
+      if (prepared->m_op == nullptr || prepared->m_profile != profile)
+	{
+	  tree t = prepared->m_query;
+	  prepared->m_unchecked = t.peg_overloads (profile);
+	  t.reduce_strength ();
+	  prepared->m_profile = profile;
+	  prepared->m_origin = std::make_shared <op_origin> (nullptr);
+
+	  if (prepared->m_prof != nullptr)
+	    prepared->m_prof = std::make_shared <class profile> ();
+	  profile::build_scope scope {prepared->m_prof};
+	  prepared->m_op = t.build_exec (prepared->m_origin);
+	}
+
+      // Resetting the graph percolates all the way to its origin,
+      // which can then be seeded with the new input.
+      prepared->m_op->reset ();
+      prepared->m_origin->set_next (make_stack (input_stack,
+						prepared->m_unchecked));
+      return new zw_result { prepared->m_op, prepared->m_prof };
     }, nullptr, out_err);
 }
 
@@ -216,12 +334,73 @@ zw_result_next (zw_result *result, zw_stack **out_stack, zw_error **out_err)
     }, false, out_err);
 }
 
+bool
+zw_result_next_view (zw_result *result, zw_stack_view const **out_view,
+		     zw_error **out_err)
+{
+  size_t count;
+  if (! zw_result_next_n (result, out_view, 1, &count, out_err))
+    return false;
+
+  if (count == 0)
+    *out_view = nullptr;
+  return true;
+}
+
+bool
+zw_result_next_n (zw_result *result, zw_stack_view const **out_views,
+		  size_t n, size_t *out_count, zw_error **out_err)
+{
+  *out_count = 0;
+  return capture_errors ([&] () {
+      // Views lent out last time are released here.  Room for all N
+      // is made up front, so that views handed out stay put even if
+      // a later stack fails.
+      auto &views = result->m_views;
+      views.clear ();
+      views.reserve (n);
+      while (views.size () < n)
+	if (auto stk = result->m_op->next ())
+	  {
+	    views.push_back ({std::move (stk)});
+	    out_views[(*out_count)++] = &views.back ();
+	  }
+	else
+	  break;
+      return true;
+    }, false, out_err);
+}
+
+bool
+zw_result_count (zw_result *result, uint64_t limit, uint64_t *out_count,
+		 zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      *out_count = result->m_op->count (limit);
+      return true;
+    }, false, out_err);
+}
+
 void
 zw_result_destroy (zw_result *result)
 {
   delete result;
 }
 
+zw_profile_entry const *
+zw_result_profile (zw_result const *result, size_t *out_count)
+{
+  assert (out_count != nullptr);
+  if (result->m_prof == nullptr || result->m_prof->entries ().empty ())
+    {
+      *out_count = 0;
+      return nullptr;
+    }
+
+  *out_count = result->m_prof->entries ().size ();
+  return result->m_prof->entries ().data ();
+}
+
 bool
 zw_value_is_const (zw_value const *val)
 {
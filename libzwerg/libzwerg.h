@@ -100,10 +100,78 @@ extern "C" {
   // consist of values.
   typedef struct zw_stack zw_stack;
 
+  // A stack view shows an output stack that a zw_result owns, and
+  // lends out for a while.  Values are read from it in the same way
+  // as from a zw_stack.
+  typedef struct zw_stack_view zw_stack_view;
+
+  // Objects of type zw_prepared_query are queries compiled into an
+  // executable form.  A prepared query can be executed repeatedly,
+  // on different input stacks, without being recompiled each time.
+  typedef struct zw_prepared_query zw_prepared_query;
+
   // zw_result represents a result set of query execution.  It can
   // produce individual stacks of values that the query yielded.
   typedef struct zw_result zw_result;
 
+  // Queries can be executed with profiling enabled, in which case
+  // activity of the individual operations of the query is recorded.
+  // zw_profile_entry describes one such operation, and how it fared.
+  typedef struct zw_profile_entry
+  {
+    // Name of the word or construct that the entry is for.
+    char const *name;
+
+    // Entries form a tree, listed in pre-order.  DEPTH is how deep
+    // in that tree this entry is.
+    size_t depth;
+
+    // Whether this is a predicate, as opposed to an operation that
+    // yields stacks.
+    bool is_pred;
+
+    // Number of times the operation was asked for a stack, or the
+    // predicate evaluated.
+    uint64_t calls;
+
+    // Number of stacks that the operation yielded, or number of
+    // times that the predicate held.
+    uint64_t yields;
+
+    // Number of stacks that the operation copied.
+    uint64_t copies;
+
+    // Time spent in the operation, in nanoseconds.  The inclusive
+    // time also covers operations that this one called, which
+    // includes those that it takes its input from.
+    uint64_t ns_inclusive;
+    uint64_t ns_exclusive;
+  } zw_profile_entry;
+
+  // Threads.
+  //
+  // A vocabulary, once it has been filled, and a parsed query don't
+  // change anymore.  They can be shared by any number of threads,
+  // which may parse queries against the one vocabulary and execute
+  // the one query at the same time.  All state of an execution lives
+  // in the zw_result that it returns.
+  //
+  // Other objects may be used from several threads, but only by one
+  // thread at a time.  That includes zw_prepared_query, which keeps
+  // the compiled query around between executions, and zw_result.
+  // Functions that take a const pointer, e.g. the zw_value accessors
+  // or zw_query_execute itself with its input stack, can be called
+  // on one object from several threads at once, within the limits
+  // described below for Dwarf values.
+  //
+  // Dwarf values refer to a libdw handle, which is not safe to use
+  // from several threads at once.  When a query is executed, values
+  // on the input stack that refer to a Dwarf opened from a file are
+  // rebound to a handle of the executing thread, which is opened the
+  // first time that thread needs it.  Values that the query yields
+  // refer to that handle, and should only be inspected on the thread
+  // that executed the query, or passed to another query.
+
 
   // Free the resources associated with ERR.
   void zw_error_destroy (zw_error *err);
@@ -181,6 +249,14 @@ extern "C" {
   // 0.  DEPTH shall be smaller than stack depth.
   zw_value const *zw_stack_at (zw_stack const *stack, size_t depth);
 
+  // Return number of values that VIEW holds.
+  size_t zw_stack_view_depth (zw_stack_view const *view);
+
+  // Return a pointer to value in given DEPTH of stack that VIEW
+  // shows.  TOS has depth 0.  DEPTH shall be smaller than stack depth.
+  // Values deeper in the stack take longer to reach.
+  zw_value const *zw_stack_view_at (zw_stack_view const *view, size_t depth);
+
 
   // Parse a QUERY, given vocabulary VOC.  Returns a zw_query object
   // that represents the parsed query.  Returns NULL on error, in
@@ -205,6 +281,55 @@ extern "C" {
 			       zw_stack const *input_stack,
 			       zw_error **out_err);
 
+  // Compile QUERY into an executable form.  The executable form is
+  // specialized for types of values on the input stack, and rebuilt
+  // when the prepared query is executed on a stack whose values are
+  // typed differently than before.  Returns NULL on error, in which
+  // case it sets *OUT_ERR.  OUT_ERR shall be non-NULL.
+  zw_prepared_query *zw_query_prepare (zw_query const *query,
+				       zw_error **out_err);
+
+  // Release resources associated with PREPARED.
+  void zw_prepared_query_destroy (zw_prepared_query *prepared);
+
+  // Like zw_query_execute, but runs a PREPARED query.  The prepared
+  // query is reset and reused, so at most one result set obtained
+  // from a given prepared query can be in use at a time.  Executing
+  // PREPARED again invalidates any result set obtained from it
+  // earlier.  Returns NULL on error, in which case it sets *OUT_ERR.
+  // OUT_ERR shall be non-NULL.
+  //
+  // Example:
+  // {
+  //   zw_prepared_query *prep = zw_query_prepare (query, &err);
+  //   // handle error
+  //
+  //   for (each input file)
+  //     {
+  //       zw_result *result
+  //         = zw_prepared_query_execute (prep, stack, &err);
+  //       // handle error, pull stacks, destroy result
+  //     }
+  //
+  //   zw_prepared_query_destroy (prep);
+  // }
+  zw_result *zw_prepared_query_execute (zw_prepared_query *prepared,
+					zw_stack const *input_stack,
+					zw_error **out_err);
+
+  // Like zw_query_execute, but record a profile of the execution
+  // (see zw_result_profile).
+  zw_result *zw_query_execute_profiled (zw_query const *query,
+					zw_stack const *input_stack,
+					zw_error **out_err);
+
+  // Like zw_query_prepare, but results of executing the prepared
+  // query record a profile (see zw_result_profile).  The counts
+  // accumulate over all executions that share the executable form of
+  // the query.
+  zw_prepared_query *zw_query_prepare_profiled (zw_query const *query,
+						zw_error **out_err);
+
   // Pull next output stack from RESULT.  Returns true and sets
   // *OUT_STACK to the stack with output values, or to NULL, if there
   // are no more results.  Returns false on error, in which case it
@@ -212,9 +337,45 @@ extern "C" {
   bool zw_result_next (zw_result *result,
 		       zw_stack **out_stack, zw_error **out_err);
 
+  // Like zw_result_next, but instead of a new stack, sets *OUT_VIEW
+  // to a view of a stack that RESULT keeps, or to NULL if there are
+  // no more results.  No values are copied or moved.  The view, and
+  // values reached through it, stay valid until the next call that
+  // pulls from RESULT, or until RESULT is destroyed.  Returns false on
+  // error, in which case it sets *OUT_ERR.  OUT_ERR shall be
+  // non-NULL.
+  bool zw_result_next_view (zw_result *result,
+			    zw_stack_view const **out_view,
+			    zw_error **out_err);
+
+  // Pull up to N output stacks from RESULT at once.  Views of them
+  // are stored to OUT_VIEWS, which shall have room for N pointers,
+  // and their number to *OUT_COUNT.  A count smaller than N means
+  // there are no more results.  The views are valid as described at
+  // zw_result_next_view.  Returns false on error, in which case it
+  // sets *OUT_ERR.  Views of stacks pulled before the error are
+  // stored as usual.  OUT_ERR shall be non-NULL.
+  bool zw_result_next_n (zw_result *result, zw_stack_view const **out_views,
+			 size_t n, size_t *out_count, zw_error **out_err);
+
+  // Pull at most LIMIT further output stacks from RESULT, and store
+  // their number to *OUT_COUNT.  The stacks themselves are dropped,
+  // and where possible, they are not even built.  Pass UINT64_MAX as
+  // LIMIT to count all remaining results.  Returns false on error, in
+  // which case it sets *OUT_ERR.  OUT_ERR shall be non-NULL.
+  bool zw_result_count (zw_result *result, uint64_t limit,
+			uint64_t *out_count, zw_error **out_err);
+
   // Release resources associated with RESULT.
   void zw_result_destroy (zw_result *result);
 
+  // If RESULT comes from a profiled execution, return the profile
+  // entries, and store their number to *OUT_COUNT.  Otherwise return
+  // NULL and store 0.  The entries remain valid, and keep being
+  // updated as stacks are pulled, until RESULT is destroyed.
+  zw_profile_entry const *zw_result_profile (zw_result const *result,
+					     size_t *out_count);
+
 
   /**
    * Values.
@@ -223,6 +384,10 @@ extern "C" {
   // Get position of value.  Each Zwerg operator numbers elements that
   // it produces, and stores number of each element along with the
   // element.  That number can be recalled by zw_value_pos.
+  //
+  // Where a query doesn't use the word pos itself, some of its
+  // operators may look values up directly instead of enumerating
+  // them, and number them differently than enumeration would.
   size_t zw_value_pos (zw_value const *val);
 
   // Release any resources associated with VAL.
@@ -51,6 +51,12 @@ struct zw_deleter
     zw_query_destroy (q);
   }
 
+  void
+  operator() (zw_prepared_query *prep)
+  {
+    zw_prepared_query_destroy (prep);
+  }
+
   void
   operator() (zw_stack *stk)
   {
@@ -96,4 +102,12 @@ zw_result_next (zw_result &result)
   return std::unique_ptr <zw_stack, zw_deleter> {stk};
 }
 
+inline zw_stack_view const *
+zw_result_next_view (zw_result &result)
+{
+  zw_stack_view const *view;
+  zw_result_next_view (&result, &view, zw_throw_on_error {});
+  return view;
+}
+
 #endif
@@ -35,6 +35,7 @@
 #include "tree.hh"
 
 struct vocabulary;
+class op_origin;
 
 struct zw_error
 {
@@ -51,9 +52,37 @@ struct zw_query
   tree m_query;
 };
 
+class profile;
+
+struct zw_prepared_query
+{
+  tree m_query;
+
+  // The op graph is built for inputs with a particular profile, and
+  // rebuilt when a differently-typed input comes along.
+  static_profile m_profile;
+  bool m_unchecked;
+  std::shared_ptr <op_origin> m_origin;
+  std::shared_ptr <op> m_op;
+
+  // Non-nullptr if the graph should be instrumented.  Replaced when
+  // the graph is rebuilt.
+  std::shared_ptr <profile> m_prof;
+};
+
+struct zw_stack_view
+{
+  stack::uptr m_stack;
+};
+
 struct zw_result
 {
   std::shared_ptr <op> m_op;
+  std::shared_ptr <profile> m_prof;
+
+  // Stacks most recently lent out by zw_result_next_view and
+  // zw_result_next_n.  The vector is reused between calls.
+  std::vector <zw_stack_view> m_views;
 };
 
 struct zw_stack
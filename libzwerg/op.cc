@@ -29,7 +29,6 @@
 #include <iostream>
 #include <sstream>
 #include <memory>
-#include <set>
 #include <algorithm>
 
 #include "op.hh"
@@ -76,6 +75,15 @@ namespace
   }
 }
 
+uint64_t
+op::count (uint64_t limit)
+{
+  uint64_t n = 0;
+  while (n < limit && next () != nullptr)
+    ++n;
+  return n;
+}
+
 stack::uptr
 op_origin::next ()
 {
@@ -331,8 +339,13 @@ op_tine::next ()
 		   [] (stack::uptr const &ptr) { return ptr == nullptr; }))
     {
       if (auto stk = m_upstream->next ())
-	for (auto &ptr: *m_file)
-	  ptr = std::make_unique <stack> (*stk);
+	{
+	  // Forking a stack is cheap, but the last branch can just
+	  // as well take the original.
+	  for (auto it = m_file->begin (); it + 1 != m_file->end (); ++it)
+	    *it = std::make_unique <stack> (*stk);
+	  m_file->back () = std::move (stk);
+	}
       else
 	{
 	  *m_done = true;
@@ -486,13 +499,204 @@ op_capture::name () const
 
 namespace
 {
-  struct deref_less
+  // An open-addressing hash set of stacks.  Slots remember hashes of
+  // the stacks that they hold, so that probing seldom needs to look
+  // at the stacks themselves.
+  class stack_hash_set
+  {
+    struct slot
+    {
+      size_t m_hash;
+      std::shared_ptr <stack> m_stk;
+    };
+
+    // The number of slots is zero or a power of two.  M_USED are
+    // indices of slots that hold a stack.
+    std::vector <slot> m_slots;
+    std::vector <size_t> m_used;
+    unsigned m_shift;
+
+    size_t
+    index (size_t hash) const
+    {
+      // Fibonacci hashing spreads hashes of adjacent values.
+      return ((uint64_t) hash * 0x9e3779b97f4a7c15ULL) >> m_shift;
+    }
+
+    bool
+    insert (size_t hash, std::shared_ptr <stack> &stk)
+    {
+      size_t mask = m_slots.size () - 1;
+      for (size_t i = index (hash); ; i = (i + 1) & mask)
+	{
+	  slot &s = m_slots[i];
+	  if (s.m_stk == nullptr)
+	    {
+	      s.m_hash = hash;
+	      s.m_stk = std::move (stk);
+	      m_used.push_back (i);
+	      return true;
+	    }
+	  if (s.m_hash == hash && *s.m_stk == *stk)
+	    return false;
+	}
+    }
+
+    void
+    grow ()
+    {
+      std::vector <slot> slots (std::max (m_slots.size () * 2, (size_t) 16));
+      std::swap (slots, m_slots);
+      m_shift = 64;
+      for (size_t n = m_slots.size (); n > 1; n >>= 1)
+	--m_shift;
+
+      std::vector <size_t> used;
+      std::swap (used, m_used);
+      for (auto i: used)
+	insert (slots[i].m_hash, slots[i].m_stk);
+    }
+
+  public:
+    stack_hash_set ()
+      : m_shift {64}
+    {}
+
+    // Return whether STK was not in the set yet.
+    bool
+    insert (std::shared_ptr <stack> stk)
+    {
+      if (2 * (m_used.size () + 1) > m_slots.size ())
+	grow ();
+      return insert (stk->hash (), stk);
+    }
+
+    void
+    clear ()
+    {
+      for (auto i: m_used)
+	m_slots[i].m_stk = nullptr;
+      m_used.clear ();
+    }
+  };
+
+  // A set of stacks that a transitive closure has seen.  Stacks are
+  // kept in a hash set, but as long as all of them share everything
+  // below TOS, and their TOS's have offset keys in the same space
+  // (which is the case when child* or parent* walk DIE's), the keys
+  // are recorded in a bitmap instead.  That avoids hashing and
+  // comparing whole stacks.
+  class seen_set
   {
-    template <class T>
+    stack_hash_set m_set;
+
+    // Stacks recorded in the bitmap.  These are moved over to M_SET
+    // if a stack comes that the bitmap can't represent.
+    std::vector <std::shared_ptr <stack> > m_keyed;
+    void const *m_space;
+    bool m_use_bits;
+
+    // The bitmap only spans the offsets seen so far.  M_BASE is the
+    // offset of its first word, in words.  M_TOUCHED are words that
+    // need zeroing when the set is cleared.
+    std::vector <uint64_t> m_bits;
+    uint64_t m_base;
+    std::vector <uint64_t> m_touched;
+
+    bool
+    keyable (stack const &stk, void const *&space, uint64_t &offset) const
+    {
+      if (stk.size () == 0 || ! stk.get (0).offset_key (space, offset))
+	return false;
+
+      return m_keyed.empty ()
+	|| (space == m_space && stk.shares_below (*m_keyed.front (), 1));
+    }
+
+    // Set the bit for OFFSET.  Return whether it was clear.
+    bool
+    set_bit (uint64_t offset)
+    {
+      uint64_t word = offset / 64;
+      if (word < m_base)
+	{
+	  uint64_t grow = std::min (m_base, std::max (m_base - word,
+						      (uint64_t) m_bits.size ()));
+	  m_bits.insert (m_bits.begin (), grow, 0);
+	  m_base -= grow;
+	}
+      else if (word - m_base >= m_bits.size ())
+	m_bits.resize (std::max (word - m_base + 1,
+				 (uint64_t) m_bits.size () * 2), 0);
+
+      uint64_t &w = m_bits[word - m_base];
+      uint64_t mask = (uint64_t) 1 << (offset % 64);
+      if ((w & mask) != 0)
+	return false;
+
+      if (w == 0)
+	m_touched.push_back (word);
+      w |= mask;
+      return true;
+    }
+
+    void
+    clear_bits ()
+    {
+      for (auto word: m_touched)
+	m_bits[word - m_base] = 0;
+      m_touched.clear ();
+      m_keyed.clear ();
+    }
+
+  public:
+    seen_set ()
+      : m_space {nullptr}
+      , m_use_bits {true}
+      , m_base {0}
+    {}
+
+    // Return whether STK was not in the set yet.
     bool
-    operator() (T const &a, T const &b)
+    insert (std::shared_ptr <stack> stk)
     {
-      return *a < *b;
+      if (m_use_bits)
+	{
+	  void const *space;
+	  uint64_t offset;
+	  if (keyable (*stk, space, offset))
+	    {
+	      if (m_keyed.empty ())
+		{
+		  // Walks may go either way from the first offset, so
+		  // place it in the middle of the bitmap.
+		  m_space = space;
+		  m_base = offset / 64 - std::min (offset / 64,
+						   (uint64_t) m_bits.size () / 2);
+		}
+
+	      if (! set_bit (offset))
+		return false;
+
+	      m_keyed.push_back (std::move (stk));
+	      return true;
+	    }
+
+	  for (auto &kstk: m_keyed)
+	    m_set.insert (std::move (kstk));
+	  clear_bits ();
+	  m_use_bits = false;
+	}
+
+      return m_set.insert (std::move (stk));
+    }
+
+    void
+    clear ()
+    {
+      clear_bits ();
+      m_use_bits = true;
+      m_set.clear ();
     }
   };
 }
@@ -503,7 +707,7 @@ struct op_tr_closure::pimpl
   std::shared_ptr <op_origin> m_origin;
   std::shared_ptr <op> m_op;
 
-  std::set <std::shared_ptr <stack>, deref_less> m_seen;
+  seen_set m_seen;
   std::vector <std::shared_ptr <stack> > m_stks;
 
   bool m_is_plus;
@@ -537,7 +741,7 @@ struct op_tr_closure::pimpl
   std::unique_ptr <stack>
   yield_and_cache (std::shared_ptr <stack> stk)
   {
-    if (m_seen.insert (stk).second)
+    if (m_seen.insert (stk))
       {
 	m_stks.push_back (stk);
 	return std::make_unique <stack> (*stk);
@@ -688,6 +892,12 @@ struct op_subx::pimpl
 
 	if (auto stk = m_op->next ())
 	  {
+	    // If the sub-expression left the incoming stack alone and
+	    // only pushed the values to keep, STK already is the
+	    // result.  That's typical for "let X := entry ?TAG_x;".
+	    if (stk->extends (*m_stk, m_keep))
+	      return stk;
+
 	    auto ret = std::make_unique <stack> (*m_stk);
 	    std::vector <std::unique_ptr <value>> kept;
 	    for (size_t i = 0; i < m_keep; ++i)
@@ -798,8 +1008,7 @@ struct op_scope::pimpl
 	  if (auto stk = m_upstream->next ())
 	    {
 	      // Push new stack frame.
-	      stk->set_frame (std::make_shared <frame> (stk->nth_frame (0),
-							m_num_vars));
+	      stk->push_frame (m_num_vars);
 	      m_op->reset ();
 	      m_origin->set_next (std::move (stk));
 	      m_primed = true;
@@ -872,7 +1081,9 @@ op_bind::next ()
 {
   if (auto stk = m_upstream->next ())
     {
-      auto frame = stk->nth_frame (m_depth);
+      // Frames further up are shared between forks of a stack, and
+      // bindings written there are seen by all of them.
+      auto frame = m_depth == 0 ? stk->own_frame () : stk->nth_frame (m_depth);
       frame->bind_value (m_index, stk->pop ());
       return stk;
     }
@@ -890,20 +1101,28 @@ op_bind::name () const
 struct op_read::pimpl
 {
   std::shared_ptr <op> m_upstream;
-  std::shared_ptr <op> m_apply;
   size_t m_depth;
   var_id m_index;
 
+  // Closures are applied through this op_apply, which is kept around
+  // so that it can reuse what it built for the previous closure.
+  std::shared_ptr <op_origin> m_origin;
+  std::shared_ptr <op> m_apply;
+  bool m_applying;
+
   pimpl (std::shared_ptr <op> upstream, size_t depth, var_id index)
     : m_upstream {upstream}
     , m_depth {depth}
     , m_index {index}
+    , m_applying {false}
   {}
 
   void
   reset_me ()
   {
-    m_apply = nullptr;
+    if (m_applying)
+      m_apply->reset ();
+    m_applying = false;
   }
 
   stack::uptr
@@ -911,7 +1130,7 @@ struct op_read::pimpl
   {
     while (true)
       {
-	if (m_apply == nullptr)
+	if (! m_applying)
 	  {
 	    if (auto stk = m_upstream->next ())
 	      {
@@ -928,15 +1147,20 @@ struct op_read::pimpl
 		// If it's a closure, then this is a function
 		// reference.  We need to execute it and fetch all the
 		// values.
+		if (m_apply == nullptr)
+		  {
+		    m_origin = std::make_shared <op_origin> (nullptr);
+		    m_apply = std::make_shared <op_apply> (m_origin);
+		  }
 
-		auto origin = std::make_shared <op_origin> (std::move (stk));
-		m_apply = std::make_shared <op_apply> (origin);
+		m_apply->reset ();
+		m_origin->set_next (std::move (stk));
+		m_applying = true;
 	      }
 	    else
 	      return nullptr;
 	  }
 
-	assert (m_apply != nullptr);
 	if (auto stk = m_apply->next ())
 	  return stk;
 
@@ -990,7 +1214,10 @@ op_lex_closure::next ()
 {
   if (auto stk = m_upstream->next ())
     {
-      stk->push (std::make_unique <value_closure> (m_t, stk->nth_frame (0), 0));
+      // The closure needs to see bindings that this stack makes later,
+      // such as that of the closure itself.
+      auto frame = stk->own_frame ();
+      stk->push (std::make_unique <value_closure> (m_t, frame, 0));
       return stk;
     }
   return nullptr;
@@ -31,6 +31,8 @@
 
 #include <memory>
 #include <cassert>
+#include <cstdint>
+#include <functional>
 
 #include "stack.hh"
 #include "pred_result.hh"
@@ -48,6 +50,12 @@ public:
   virtual stack::uptr next () = 0;
   virtual void reset () = 0;
   virtual std::string name () const = 0;
+
+  // Skip over at most LIMIT stacks that next would produce, and
+  // return how many were skipped.  The default implementation calls
+  // next and drops what it yields.  Ops that can tell how many stacks
+  // they would yield without building them override this.
+  virtual uint64_t count (uint64_t limit);
 };
 
 template <class RT>
@@ -88,6 +96,49 @@ struct value_producer_cat
   }
 };
 
+// Yield a given value, if any, once.
+template <class RT>
+struct value_producer_single
+  : public value_producer <RT>
+{
+  std::unique_ptr <RT> m_value;
+
+  explicit value_producer_single (std::unique_ptr <RT> value)
+    : m_value {std::move (value)}
+  {}
+
+  std::unique_ptr <RT>
+  next () override
+  {
+    return std::move (m_value);
+  }
+};
+
+// Yield those values from an underlying producer for which a
+// predicate holds.
+template <class RT>
+struct value_producer_filter
+  : public value_producer <RT>
+{
+  std::unique_ptr <value_producer <RT>> m_vpr;
+  std::function <bool (RT &)> m_keep;
+
+  value_producer_filter (std::unique_ptr <value_producer <RT>> vpr,
+			 std::function <bool (RT &)> keep)
+    : m_vpr {std::move (vpr)}
+    , m_keep {keep}
+  {}
+
+  std::unique_ptr <RT>
+  next () override
+  {
+    while (auto v = m_vpr->next ())
+      if (m_keep (*v))
+	return v;
+    return nullptr;
+  }
+};
+
 // An op that's not an origin has an upstream.
 class inner_op
   : public op
@@ -562,12 +613,12 @@ class op_lex_closure
   : public op
 {
   std::shared_ptr <op> m_upstream;
-  tree m_t;
+  std::shared_ptr <tree const> m_t;
 
 public:
   op_lex_closure (std::shared_ptr <op> upstream, tree t)
     : m_upstream {upstream}
-    , m_t {t}
+    , m_t {std::make_shared <tree const> (t)}
   {}
 
   void reset () override;
@@ -145,6 +145,52 @@ overload_tab::instantiate ()
   return overload_instance {m_overloads};
 }
 
+namespace
+{
+  enum class static_match
+    {
+      no,
+      maybe,
+      yes,
+    };
+
+  static_match
+  match_static (selector const &sel, static_profile const &profile)
+  {
+    auto ret = static_match::yes;
+    auto types = sel.get_types ();
+    size_t depth = 0;
+    for (auto it = types.rbegin (); it != types.rend (); ++it)
+      {
+	value_type vt = profile.get (depth++);
+	if (vt.code () == 0)
+	  ret = static_match::maybe;
+	else if (vt != *it)
+	  return static_match::no;
+      }
+    return ret;
+  }
+}
+
+std::pair <overload_tab::overload_vec, bool>
+overload_tab::find_static (static_profile const &profile) const
+{
+  overload_vec ret;
+  for (auto const &ovl: m_overloads)
+    switch (match_static (std::get <0> (ovl), profile))
+      {
+      case static_match::no:
+	continue;
+      case static_match::maybe:
+	ret.push_back (ovl);
+	continue;
+      case static_match::yes:
+	ret.push_back (ovl);
+	return std::make_pair (ret, true);
+      }
+  return std::make_pair (ret, false);
+}
+
 
 struct overload_op::pimpl
 {
@@ -289,6 +335,63 @@ overloaded_op_builtin::create_merged (std::shared_ptr <overload_tab> tab) const
   return std::make_shared <overloaded_op_builtin> (name (), tab);
 }
 
+namespace
+{
+  struct pegged_op_builtin
+    : public builtin
+  {
+    char const *m_name;
+    std::shared_ptr <builtin const> m_ovl;
+
+    pegged_op_builtin (char const *name, std::shared_ptr <builtin const> ovl)
+      : m_name {name}
+      , m_ovl {ovl}
+    {}
+
+    std::shared_ptr <op>
+    build_exec (std::shared_ptr <op> upstream) const override final
+    {
+      auto op = m_ovl->build_exec (upstream);
+      assert (op != nullptr);
+      return op;
+    }
+
+    char const *
+    name () const override final
+    {
+      return m_name;
+    }
+
+    builtin_protomap
+    protomap () const override
+    {
+      return m_ovl->protomap ();
+    }
+
+    std::shared_ptr <builtin const>
+    reduce (reduction const &red) const override
+    {
+      if (auto reduced = m_ovl->reduce (red))
+	return std::make_shared <pegged_op_builtin> (m_name, reduced);
+      return nullptr;
+    }
+
+    std::shared_ptr <builtin const>
+    reduce_star (reduction const &red) const override
+    {
+      if (auto reduced = m_ovl->reduce_star (red))
+	return std::make_shared <pegged_op_builtin> (m_name, reduced);
+      return nullptr;
+    }
+  };
+}
+
+std::shared_ptr <builtin const>
+overloaded_op_builtin::create_pegged (std::shared_ptr <builtin> ovl) const
+{
+  return std::make_shared <pegged_op_builtin> (name (), ovl);
+}
+
 namespace
 {
   struct named_overload_pred
@@ -323,3 +426,64 @@ overloaded_pred_builtin::create_merged
 {
   return std::make_shared <overloaded_pred_builtin> (name (), tab, m_positive);
 }
+
+namespace
+{
+  struct pegged_pred_builtin
+    : public pred_builtin
+  {
+    char const *m_name;
+    std::shared_ptr <builtin> m_ovl;
+
+    // What describe_filter of the overloaded builtin said.
+    bool m_is_filter;
+    reduction m_filter;
+
+    pegged_pred_builtin (char const *name, std::shared_ptr <builtin> ovl,
+			 bool positive)
+      : pred_builtin {positive}
+      , m_name {name}
+      , m_ovl {ovl}
+      , m_is_filter {false}
+      , m_filter {reduction_key::root, {}, false}
+    {}
+
+    std::unique_ptr <pred>
+    build_pred () const override final
+    {
+      auto pred = m_ovl->build_pred ();
+      assert (pred != nullptr);
+      return maybe_invert (std::move (pred), m_positive);
+    }
+
+    char const *
+    name () const override final
+    {
+      return m_name;
+    }
+
+    builtin_protomap
+    protomap () const override
+    {
+      return m_ovl->protomap ();
+    }
+
+    bool
+    describe_filter (reduction &red) const override
+    {
+      if (! m_is_filter)
+	return false;
+      red.m_key = m_filter.m_key;
+      red.m_cst = m_filter.m_cst;
+      return true;
+    }
+  };
+}
+
+std::shared_ptr <builtin const>
+overloaded_pred_builtin::create_pegged (std::shared_ptr <builtin> ovl) const
+{
+  auto ret = std::make_shared <pegged_pred_builtin> (name (), ovl, m_positive);
+  ret->m_is_filter = describe_filter (ret->m_filter);
+  return ret;
+}
@@ -31,6 +31,7 @@
 
 #include <vector>
 #include <tuple>
+#include <functional>
 #include "std-memory.hh"
 #include "std-utility.hh"
 #include <iostream>
@@ -64,6 +65,11 @@
 // sub-classes of these templates.  See below for comments on these.
 //
 // For example of this in action, see e.g. operator length.
+//
+// When types of values near TOS are known at the time that the query
+// is built (see static_profile in builtin.hh), the dispatch can be
+// done statically, and the overload that would be selected is wired
+// directly into the op graph ("pegged").
 
 class overload_instance
 {
@@ -105,6 +111,14 @@ public:
 
   overload_instance instantiate ();
   overload_vec const &get_overloads () const { return m_overloads; }
+
+  // Return overloads that might be selected for a stack whose
+  // profile is PROFILE, in order in which they are considered.  The
+  // boolean is true if the last returned overload is certain to
+  // match.  In particular, when a single overload is returned
+  // together with true, that overload can be pegged.
+  std::pair <overload_vec, bool>
+  find_static (static_profile const &profile) const;
 };
 
 class overload_op
@@ -165,6 +179,11 @@ public:
 
   virtual std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const = 0;
+
+  // Create a builtin that builds overload OVL directly, without the
+  // dispatch.  OVL shall be one of the overloads in the table.
+  virtual std::shared_ptr <builtin const>
+  create_pegged (std::shared_ptr <builtin> ovl) const = 0;
 };
 
 // Base class for overloaded operation builtins.
@@ -178,6 +197,9 @@ struct overloaded_op_builtin
 
   std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const override final;
+
+  std::shared_ptr <builtin const>
+  create_pegged (std::shared_ptr <builtin> ovl) const override final;
 };
 
 // Base class for overloaded predicate builtins.
@@ -196,6 +218,9 @@ struct overloaded_pred_builtin
 
   std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const override final;
+
+  std::shared_ptr <builtin const>
+  create_pegged (std::shared_ptr <builtin> ovl) const override final;
 };
 
 
@@ -253,6 +278,18 @@ overload_tab::add_op_overload (Args &&... args)
     {
       return Op::protomap ();
     }
+
+    std::shared_ptr <builtin const>
+    reduce (reduction const &red) const override
+    {
+      return Op::reduce (red);
+    }
+
+    std::shared_ptr <builtin const>
+    reduce_star (reduction const &red) const override
+    {
+      return Op::reduce_star (red);
+    }
   };
 
   add_overload (Op::get_selector (),
@@ -382,6 +419,14 @@ public:
   // the docstring () static itself.
   static std::string docstring ()
   { return ""; }
+
+  // Likewise for the reduction point, see builtin::reduce.  Overloads
+  // that know how to look up values directly shadow this.
+  static std::shared_ptr <builtin const> reduce (reduction const &red)
+  { return nullptr; }
+
+  static std::shared_ptr <builtin const> reduce_star (reduction const &red)
+  { return nullptr; }
 };
 
 template <class RT, class... VT>
@@ -527,6 +572,33 @@ public:
       }
   }
 
+  // Count the values that producers yield, without building a stack
+  // for each of them.
+  uint64_t
+  count (uint64_t limit) override final
+  {
+    uint64_t n = 0;
+    while (n < limit)
+      {
+	while (m_prod == nullptr)
+	  if (auto stk = this->m_upstream->next ())
+	    {
+	      m_prod = call_operate
+		(std::index_sequence_for <VT...> {},
+		 op_overload_impl <VT...>::template collect <0, VT...> (*stk));
+	      m_stk = std::move (stk);
+	    }
+	  else
+	    return n;
+
+	if (m_prod->next () != nullptr)
+	  ++n;
+	else
+	  reset_me ();
+      }
+    return n;
+  }
+
   void
   reset () override
   {
@@ -546,6 +618,68 @@ public:
   }
 };
 
+// Reduction points of yielding overloads typically yield the same
+// kind of values as the overload itself, just fewer of them.  This
+// creates a builtin that pops a value of type VT and yields whatever
+// OPERATE produces for that value.
+
+template <class RT, class VT>
+using reduced_operate_t = std::function <std::unique_ptr <value_producer <RT>>
+					  (std::unique_ptr <VT>)>;
+
+template <class RT, class VT>
+std::shared_ptr <builtin const>
+make_reduced_builtin (reduced_operate_t <RT, VT> operate)
+{
+  struct reduced_op
+    : public op_yielding_overload <RT, VT>
+  {
+    reduced_operate_t <RT, VT> m_operate;
+
+    reduced_op (std::shared_ptr <op> upstream,
+		reduced_operate_t <RT, VT> operate)
+      : op_yielding_overload <RT, VT> {upstream}
+      , m_operate {operate}
+    {}
+
+    std::unique_ptr <value_producer <RT>>
+    operate (std::unique_ptr <VT> a) override
+    {
+      return m_operate (std::move (a));
+    }
+  };
+
+  struct reduced_builtin
+    : public builtin
+  {
+    reduced_operate_t <RT, VT> m_operate;
+
+    explicit reduced_builtin (reduced_operate_t <RT, VT> operate)
+      : m_operate {operate}
+    {}
+
+    std::shared_ptr <op>
+    build_exec (std::shared_ptr <op> upstream) const override final
+    {
+      return std::make_shared <reduced_op> (upstream, m_operate);
+    }
+
+    char const *
+    name () const override final
+    {
+      return "reduced";
+    }
+
+    builtin_protomap
+    protomap () const override
+    {
+      return reduced_op::protomap ();
+    }
+  };
+
+  return std::make_shared <reduced_builtin> (operate);
+}
+
 template <class... VT>
 struct pred_overload
   : public stub_pred
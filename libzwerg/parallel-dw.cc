@@ -0,0 +1,202 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cstring>
+#include <mutex>
+
+#include "builtin-dw.hh"
+#include "dwit.hh"
+#include "dwmods.hh"
+#include "dwpp.hh"
+#include "parallel-dw.hh"
+#include "value-cst.hh"
+#include "value-dw.hh"
+#include "value-str.hh"
+
+namespace
+{
+  struct unit_ref
+  {
+    // Index into all_dwarfs.
+    size_t m_dw;
+    Dwarf_Off m_cudie_off;
+    size_t m_pos;
+  };
+
+  class dwarf_units_job
+    : public par_job
+  {
+    std::shared_ptr <dwfl_context> m_dwctx;
+    doneness m_doneness;
+    bool m_entry;
+    tree m_rest;
+
+    // Values below the Dwarf.
+    std::vector <std::unique_ptr <value>> m_below;
+
+    std::vector <unit_ref> m_units;
+
+    std::mutex m_mutex;
+    std::vector <std::shared_ptr <dwfl_context>> m_pool;
+
+    // Return a Dwarf handle that no other thread uses.
+    std::shared_ptr <dwfl_context>
+    lease ()
+    {
+      {
+	std::lock_guard <std::mutex> lock {m_mutex};
+	for (auto const &dwctx: m_pool)
+	  // Nothing refers to this handle except for the pool, and
+	  // nothing can start referring to it but by way of the pool.
+	  if (dwctx.use_count () == 1)
+	    return dwctx;
+      }
+
+      auto dwctx = m_dwctx->reopen ();
+      assert (dwctx != nullptr);
+
+      std::lock_guard <std::mutex> lock {m_mutex};
+      m_pool.push_back (dwctx);
+      return dwctx;
+    }
+
+  public:
+    dwarf_units_job (value_dwarf const &dw, bool entry, tree rest,
+		     std::vector <std::unique_ptr <value>> below)
+      : m_dwctx {dw.get_dwctx ()}
+      , m_doneness {dw.get_doneness ()}
+      , m_entry {entry}
+      , m_rest {rest}
+      , m_below {std::move (below)}
+    {
+      // This enumerates units the same way that unit does.
+      auto dwarfs = all_dwarfs (*m_dwctx);
+      size_t pos = 0;
+      for (size_t i = 0; i < dwarfs.size (); ++i)
+	for (cu_iterator it {dwarfs[i]}; it != cu_iterator::end (); ++it)
+	  // In cooked mode, we reject partial units.
+	  if (m_doneness == doneness::raw
+	      || dwarf_tag (*it) != DW_TAG_partial_unit)
+	    m_units.push_back ({i, dwarf_dieoffset (*it), pos++});
+    }
+
+    size_t
+    size () const override
+    {
+      return m_units.size ();
+    }
+
+    void
+    run (size_t i, std::function <void (stack::uptr)> yield) override
+    {
+      auto dwctx = lease ();
+      unit_ref const &unit = m_units[i];
+
+      Dwarf *dw = all_dwarfs (*dwctx)[unit.m_dw];
+      Dwarf_Die cudie;
+      if (dwarf_offdie (dw, unit.m_cudie_off, &cudie) == nullptr)
+	throw_libdw ();
+
+      auto stk = std::make_unique <stack> ();
+      for (auto const &v: m_below)
+	stk->push (v->clone ());
+      stk->push (std::make_unique <value_cu>
+		 (dwctx, *cudie.cu,
+		  dwarf_dieoffset (&cudie) - dwarf_cuoffset (&cudie),
+		  unit.m_pos, m_doneness));
+
+      std::shared_ptr <op> upstream
+	= std::make_shared <op_origin> (std::move (stk));
+      if (m_entry)
+	upstream = std::make_shared <op_entry_cu> (upstream);
+
+      auto op = m_rest.build_exec (upstream);
+      while (auto r = op->next ())
+	yield (std::move (r));
+    }
+  };
+}
+
+std::shared_ptr <par_job>
+split_dwarf_units (tree const &t,
+		   std::vector <std::unique_ptr <value>> const &input)
+{
+  if (input.empty ())
+    return nullptr;
+
+  auto dw = value::as <value_dwarf> (input.back ().get ());
+  if (dw == nullptr || ! dw->get_dwctx ()->can_reopen ())
+    return nullptr;
+
+  // Values below the Dwarf are copied to each task.  Only let through
+  // those that don't refer to the Dwarf handle.
+  std::vector <std::unique_ptr <value>> below;
+  for (auto it = input.begin (); it != input.end () - 1; ++it)
+    if ((*it)->is <value_cst> () || (*it)->is <value_str> ())
+      below.push_back ((*it)->clone ());
+    else
+      return nullptr;
+
+  // The query may be wrapped in a scope that holds its variables.
+  tree rest = t;
+  tree *body = rest.tt () == tree_type::SCOPE ? &rest.child (0) : &rest;
+  tree const &first
+    = body->tt () == tree_type::CAT ? body->child (0) : *body;
+  if (first.tt () != tree_type::F_BUILTIN)
+    return nullptr;
+
+  char const *name = first.m_builtin->name ();
+  bool entry = strcmp (name, "entry") == 0;
+  if (! entry && strcmp (name, "unit") != 0)
+    return nullptr;
+
+  if (entry && t.uses_pos ())
+    return nullptr;
+
+  // Units are run separately, so a limit would apply to each of them
+  // instead of to the whole query.
+  if (t.mentions ("limit"))
+    return nullptr;
+
+  // Drop the unit or entry, tasks take care of that.
+  if (body->tt () == tree_type::CAT)
+    {
+      body->m_children.erase (body->m_children.begin ());
+      if (body->m_children.size () == 1)
+	{
+	  tree tmp = body->child (0);
+	  body->swap (tmp);
+	}
+    }
+  else
+    *body = tree {tree_type::NOP};
+
+  rest.reduce_strength ();
+  return std::make_shared <dwarf_units_job>
+    (*dw, entry, rest, std::move (below));
+}
@@ -0,0 +1,62 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _PARALLEL_DW_H_
+#define _PARALLEL_DW_H_
+
+#include <memory>
+#include <vector>
+
+#include "parallel.hh"
+#include "tree.hh"
+#include "value.hh"
+
+// If query T starts with unit or entry, and would be run on a stack
+// with a Dwarf on TOS (INPUT describes that stack, TOS last), return
+// a job that runs T over each unit of that Dwarf separately.
+// Otherwise return nullptr.
+//
+// T shall have its overloads pegged, but not be strength-reduced
+// yet: reduced builtins keep the names of the builtins that they
+// replace, but also evaluate the filters that followed them.  The
+// rest of T is reduced once the unit or entry is split off.
+//
+// Each task opens the Dwarf anew, or reuses a Dwarf handle that no
+// longer holds values that the consumer could be looking at, so that
+// no two threads ever share a handle.  Consequently, values yielded
+// for different units may come from different handles.
+//
+// Positions of DIE's that entry yields can't be known without going
+// through all the preceding units, so queries that start with entry
+// and observe positions are not split.  Neither are queries that
+// mention limit.
+std::shared_ptr <par_job>
+split_dwarf_units (tree const &t,
+		   std::vector <std::unique_ptr <value>> const &input);
+
+#endif /* _PARALLEL_DW_H_ */
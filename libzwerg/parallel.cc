@@ -0,0 +1,360 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hh"
+#include "std-memory.hh"
+
+namespace
+{
+  // Thrown from the yield callback to abort a task when the op is
+  // being shut down.
+  struct cancelled {};
+
+  struct task_slot
+  {
+    std::vector <stack::uptr> m_stacks;
+    std::exception_ptr m_exc;
+    bool m_done;
+
+    task_slot ()
+      : m_done {false}
+    {}
+  };
+}
+
+class op_parallel::pimpl
+{
+  std::shared_ptr <par_job> m_job;
+  unsigned m_nthreads;
+  bool m_ordered;
+
+  // How many tasks the workers can run ahead of the consumer.
+  size_t m_window;
+
+  // Everything below is guarded by m_mutex, except for m_stop, which
+  // running tasks poll without taking the lock.  Tasks themselves are
+  // coarse, so a single lock for all the queues is enough.
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+
+  std::vector <std::deque <size_t>> m_queues;
+  std::vector <task_slot> m_slots;
+
+  // Tasks that finished but whose stacks were not yielded yet, in
+  // order of completion.  Only used if not m_ordered.
+  std::deque <size_t> m_finished;
+
+  // Index of the next task whose stacks should be yielded.  Only
+  // used if m_ordered.
+  size_t m_next;
+
+  // Number of tasks that were started, and whose stacks were not
+  // taken over by the consumer yet.
+  size_t m_in_flight;
+
+  // Number of tasks whose stacks were taken over by the consumer.
+  size_t m_consumed;
+
+  std::atomic <bool> m_stop;
+  std::vector <std::thread> m_threads;
+  bool m_started;
+
+  // Stacks of the task that is currently being yielded, and the
+  // exception that the task ended with, if any.
+  std::vector <stack::uptr> m_current;
+  size_t m_current_pos;
+  std::exception_ptr m_current_exc;
+
+  bool
+  may_start (size_t i) const
+  {
+    // In ordered mode, the task that the consumer waits for always
+    // gets to run, so this can't deadlock.
+    return m_ordered ? i < m_next + m_window : m_in_flight < m_window;
+  }
+
+  // Pick a task for worker W to run.  Returns false if there's no
+  // task that the worker may start right now.
+  bool
+  take (unsigned w, size_t &ret)
+  {
+    auto &own = m_queues[w];
+    if (! own.empty () && may_start (own.front ()))
+      {
+	ret = own.front ();
+	own.pop_front ();
+	return true;
+      }
+
+    // When the consumer waits for tasks in order, the most useful
+    // task to steal is the earliest one.  Otherwise take work from
+    // the far end of the longest queue.
+    std::deque <size_t> *victim = nullptr;
+    for (auto &q: m_queues)
+      if (&q != &own && ! q.empty ()
+	  && (victim == nullptr
+	      || (m_ordered ? q.front () < victim->front ()
+			    : q.size () > victim->size ())))
+	victim = &q;
+
+    if (victim == nullptr)
+      return false;
+
+    size_t i = m_ordered ? victim->front () : victim->back ();
+    if (! may_start (i))
+      return false;
+
+    if (m_ordered)
+      victim->pop_front ();
+    else
+      victim->pop_back ();
+
+    ret = i;
+    return true;
+  }
+
+  bool
+  all_taken () const
+  {
+    return std::all_of (m_queues.begin (), m_queues.end (),
+			[] (std::deque <size_t> const &q) { return q.empty (); });
+  }
+
+  void
+  work (unsigned w)
+  {
+    std::unique_lock <std::mutex> lock {m_mutex};
+    while (! m_stop)
+      {
+	size_t i;
+	if (! take (w, i))
+	  {
+	    if (all_taken ())
+	      return;
+	    m_work_cv.wait (lock);
+	    continue;
+	  }
+
+	++m_in_flight;
+	lock.unlock ();
+
+	std::vector <stack::uptr> stacks;
+	std::exception_ptr exc;
+	try
+	  {
+	    m_job->run (i, [this, &stacks] (stack::uptr stk)
+			{
+			  if (m_stop)
+			    throw cancelled {};
+			  stacks.push_back (std::move (stk));
+			});
+	  }
+	catch (cancelled)
+	  {
+	    return;
+	  }
+	catch (...)
+	  {
+	    exc = std::current_exception ();
+	  }
+
+	lock.lock ();
+	auto &slot = m_slots[i];
+	slot.m_stacks = std::move (stacks);
+	slot.m_exc = exc;
+	slot.m_done = true;
+	if (! m_ordered)
+	  m_finished.push_back (i);
+	m_done_cv.notify_one ();
+      }
+  }
+
+  void
+  start ()
+  {
+    size_t n = m_job->size ();
+
+    m_queues.assign (std::max (1u, m_nthreads), std::deque <size_t> {});
+    for (size_t i = 0; i < n; ++i)
+      m_queues[i % m_queues.size ()].push_back (i);
+
+    m_slots.clear ();
+    m_slots.resize (n);
+    m_finished.clear ();
+    m_next = 0;
+    m_in_flight = 0;
+    m_consumed = 0;
+    m_stop = false;
+
+    for (unsigned w = 0; w < m_queues.size () && w < n; ++w)
+      m_threads.emplace_back ([this, w] () { work (w); });
+
+    m_started = true;
+  }
+
+  void
+  stop ()
+  {
+    {
+      std::lock_guard <std::mutex> lock {m_mutex};
+      m_stop = true;
+    }
+    m_work_cv.notify_all ();
+
+    for (auto &thread: m_threads)
+      thread.join ();
+    m_threads.clear ();
+
+    m_slots.clear ();
+    m_current.clear ();
+    m_current_pos = 0;
+    m_current_exc = nullptr;
+    m_started = false;
+  }
+
+  // Take over stacks of the next task.  Returns false when there are
+  // no more tasks.
+  bool
+  take_next ()
+  {
+    {
+      std::unique_lock <std::mutex> lock {m_mutex};
+      if (m_consumed == m_slots.size ())
+	return false;
+
+      size_t i;
+      if (m_ordered)
+	{
+	  i = m_next++;
+	  m_done_cv.wait (lock, [&] () { return m_slots[i].m_done; });
+	}
+      else
+	{
+	  m_done_cv.wait (lock, [&] () { return ! m_finished.empty (); });
+	  i = m_finished.front ();
+	  m_finished.pop_front ();
+	}
+
+      ++m_consumed;
+      --m_in_flight;
+
+      m_current = std::move (m_slots[i].m_stacks);
+      m_current_pos = 0;
+      m_current_exc = m_slots[i].m_exc;
+    }
+
+    // Either m_next moved, or a place in the window freed up.
+    m_work_cv.notify_all ();
+    return true;
+  }
+
+public:
+  pimpl (std::shared_ptr <par_job> job, unsigned nthreads, bool ordered)
+    : m_job {job}
+    , m_nthreads {nthreads}
+    , m_ordered {ordered}
+    , m_window {4 * std::max (1u, nthreads)}
+    , m_next {0}
+    , m_in_flight {0}
+    , m_consumed {0}
+    , m_stop {false}
+    , m_started {false}
+    , m_current_pos {0}
+  {}
+
+  ~pimpl ()
+  {
+    stop ();
+  }
+
+  stack::uptr
+  next ()
+  {
+    if (! m_started)
+      start ();
+
+    while (m_current_pos == m_current.size ())
+      {
+	// Stacks that a failing task yielded before the failure come
+	// first, like they would if the query ran sequentially.
+	if (m_current_exc != nullptr)
+	  {
+	    auto exc = m_current_exc;
+	    m_current_exc = nullptr;
+	    std::rethrow_exception (exc);
+	  }
+
+	if (! take_next ())
+	  return nullptr;
+      }
+
+    return std::move (m_current[m_current_pos++]);
+  }
+
+  void
+  reset ()
+  {
+    stop ();
+  }
+};
+
+op_parallel::op_parallel (std::shared_ptr <par_job> job, unsigned nthreads,
+			  bool ordered)
+  : m_pimpl {std::make_unique <pimpl> (job, nthreads, ordered)}
+{}
+
+op_parallel::~op_parallel ()
+{}
+
+stack::uptr
+op_parallel::next ()
+{
+  return m_pimpl->next ();
+}
+
+void
+op_parallel::reset ()
+{
+  m_pimpl->reset ();
+}
+
+std::string
+op_parallel::name () const
+{
+  return "parallel";
+}
@@ -0,0 +1,84 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <functional>
+#include <memory>
+
+#include "op.hh"
+
+// A computation that is split into tasks that don't depend on each
+// other, and can thus be run concurrently.
+class par_job
+{
+public:
+  virtual ~par_job () {}
+
+  // Number of tasks.
+  virtual size_t size () const = 0;
+
+  // Run task I on the calling thread, and pass each stack that it
+  // yields to YIELD.  This is called from several threads at once,
+  // but for different tasks.  Stacks that a task yields are only
+  // handed over to other threads after the task finishes, and the
+  // job has to make sure that they can be used from those threads
+  // then.  YIELD may throw to abort the task.
+  virtual void run (size_t i, std::function <void (stack::uptr)> yield) = 0;
+};
+
+// An op that runs tasks of a job on a pool of worker threads, and
+// yields stacks that the tasks produced.  If ORDERED, stacks come in
+// the order of tasks that produced them, otherwise in the order in
+// which the tasks finish.  Either way, stacks of one task are
+// yielded together, in the order that the task produced them.
+//
+// Tasks are dealt out to per-thread queues round-robin.  A thread
+// that runs out of work, or that is held back from running ahead of
+// the consumer, steals tasks from the other queues.
+//
+// An exception that a task throws is rethrown from next once the
+// stacks that the task yielded before it failed are yielded.
+class op_parallel
+  : public op
+{
+  class pimpl;
+  std::unique_ptr <pimpl> m_pimpl;
+
+public:
+  op_parallel (std::shared_ptr <par_job> job, unsigned nthreads,
+	       bool ordered);
+  ~op_parallel ();
+
+  stack::uptr next () override;
+  void reset () override;
+  std::string name () const override;
+};
+
+#endif /* _PARALLEL_H_ */
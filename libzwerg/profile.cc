@@ -0,0 +1,283 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <sstream>
+
+#include "profile.hh"
+#include "builtin.hh"
+#include "std-memory.hh"
+
+namespace
+{
+  thread_local std::shared_ptr <profile> t_building;
+
+  // Instrumented ops and preds that are currently running on this
+  // thread.  Whatever the inner ones spend is subtracted from
+  // exclusive counts of the outer ones.
+  struct activation
+  {
+    uint64_t m_child_ns;
+    uint64_t m_child_copies;
+    activation *m_parent;
+  };
+
+  thread_local activation *t_active = nullptr;
+
+  class measurement
+  {
+    zw_profile_entry &m_entry;
+    activation m_act;
+    std::chrono::steady_clock::time_point m_start;
+    bool m_counting;
+    uint64_t m_copies;
+
+  public:
+    explicit measurement (zw_profile_entry &entry)
+      : m_entry (entry)
+      , m_act {0, 0, t_active}
+      , m_start {std::chrono::steady_clock::now ()}
+      , m_counting {stack::count_copies (true)}
+      , m_copies {stack::copies ()}
+    {
+      t_active = &m_act;
+      ++m_entry.calls;
+    }
+
+    ~measurement ()
+    {
+      uint64_t ns = std::chrono::duration_cast <std::chrono::nanoseconds>
+	(std::chrono::steady_clock::now () - m_start).count ();
+      uint64_t copies = stack::copies () - m_copies;
+      stack::count_copies (m_counting);
+
+      m_entry.ns_inclusive += ns;
+      m_entry.ns_exclusive += ns - std::min (ns, m_act.m_child_ns);
+      m_entry.copies += copies - m_act.m_child_copies;
+
+      t_active = m_act.m_parent;
+      if (t_active != nullptr)
+	{
+	  t_active->m_child_ns += ns;
+	  t_active->m_child_copies += copies;
+	}
+    }
+  };
+
+  class op_profiled
+    : public op
+  {
+    std::shared_ptr <op> m_op;
+    std::shared_ptr <profile> m_prof;
+    size_t m_idx;
+
+  public:
+    op_profiled (std::shared_ptr <op> op,
+		 std::shared_ptr <profile> prof, size_t idx)
+      : m_op {op}
+      , m_prof {prof}
+      , m_idx {idx}
+    {}
+
+    stack::uptr
+    next () override
+    {
+      auto &entry = m_prof->at (m_idx);
+      measurement m {entry};
+      auto ret = m_op->next ();
+      if (ret != nullptr)
+	++entry.yields;
+      return ret;
+    }
+
+    uint64_t
+    count (uint64_t limit) override
+    {
+      auto &entry = m_prof->at (m_idx);
+      measurement m {entry};
+      uint64_t ret = m_op->count (limit);
+      entry.yields += ret;
+      return ret;
+    }
+
+    void
+    reset () override
+    {
+      m_op->reset ();
+    }
+
+    std::string
+    name () const override
+    {
+      return m_op->name ();
+    }
+  };
+
+  class pred_profiled
+    : public pred
+  {
+    std::unique_ptr <pred> m_pred;
+    std::shared_ptr <profile> m_prof;
+    size_t m_idx;
+
+  public:
+    pred_profiled (std::unique_ptr <pred> pred,
+		   std::shared_ptr <profile> prof, size_t idx)
+      : m_pred {std::move (pred)}
+      , m_prof {prof}
+      , m_idx {idx}
+    {}
+
+    pred_result
+    result (stack &stk) override
+    {
+      auto &entry = m_prof->at (m_idx);
+      measurement m {entry};
+      auto ret = m_pred->result (stk);
+      if (ret == pred_result::yes)
+	++entry.yields;
+      return ret;
+    }
+
+    void
+    reset () override
+    {
+      m_pred->reset ();
+    }
+
+    std::string
+    name () const override
+    {
+      return m_pred->name ();
+    }
+  };
+
+  std::string
+  entry_name (tree const &t)
+  {
+    std::stringstream ss;
+    switch (t.tt ())
+      {
+      case tree_type::F_BUILTIN:
+	return t.m_builtin->name ();
+
+      case tree_type::CONST:
+	ss << t.cst ();
+	return ss.str ();
+
+      case tree_type::STR:
+	return "\"" + t.str () + "\"";
+
+      case tree_type::READ:
+	return t.str ();
+
+      case tree_type::BIND:
+	return "->" + t.str ();
+
+      default:
+	break;
+      }
+
+    static char const *const names[] = {
+#define TREE_TYPE(ENUM, ARITY) #ENUM,
+      TREE_TYPES
+#undef TREE_TYPE
+    };
+
+    std::string ret = names[(int) t.tt ()];
+    std::transform (ret.begin (), ret.end (), ret.begin (), ::tolower);
+    return ret;
+  }
+}
+
+profile::profile ()
+  : m_depth {0}
+{}
+
+size_t
+profile::enter (tree const &t, bool pred)
+{
+  m_names.push_back (entry_name (t));
+  m_entries.push_back (zw_profile_entry {m_names.back ().c_str (), m_depth,
+					  pred, 0, 0, 0, 0, 0});
+  ++m_depth;
+  return m_entries.size () - 1;
+}
+
+void
+profile::leave (size_t idx, bool keep)
+{
+  assert (m_depth > 0);
+  --m_depth;
+
+  // Entries of children that were kept are referred to by index, so
+  // only drop the entry if it is the last one.
+  if (! keep && idx == m_entries.size () - 1)
+    m_entries.pop_back ();
+}
+
+void
+profile::rename (size_t idx, std::string name)
+{
+  m_names.push_back (std::move (name));
+  m_entries[idx].name = m_names.back ().c_str ();
+}
+
+std::shared_ptr <op>
+profile::instrument (std::shared_ptr <profile> prof, size_t idx,
+		     std::shared_ptr <op> op)
+{
+  return std::make_shared <op_profiled> (op, prof, idx);
+}
+
+std::unique_ptr <pred>
+profile::instrument (std::shared_ptr <profile> prof, size_t idx,
+		     std::unique_ptr <pred> pred)
+{
+  return std::make_unique <pred_profiled> (std::move (pred), prof, idx);
+}
+
+profile::build_scope::build_scope (std::shared_ptr <profile> prof)
+  : m_prof {prof}
+  , m_prev {t_building}
+{
+  t_building = m_prof;
+}
+
+profile::build_scope::~build_scope ()
+{
+  t_building = m_prev;
+}
+
+std::shared_ptr <profile>
+profile::building ()
+{
+  return t_building;
+}
@@ -0,0 +1,111 @@
+/*
+   Copyright (C) 2015 Red Hat, Inc.
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libzwerg.h"
+#include "op.hh"
+
+// A runtime profile of an op graph.  While a profile is being built
+// (see profile::build_scope), tree::build_exec and tree::build_pred
+// register an entry for each tree node that they build an op or a
+// pred for, and wrap that op or pred in an instrumenting one that
+// records its activity into the entry.  Entries are kept in pre-order
+// of the tree.
+//
+// Time spent in an op is recorded both inclusive and exclusive of
+// other instrumented ops that it calls.  Since ops pull their input,
+// inclusive time of an op covers also what the ops upstream of it
+// do.
+//
+// Graphs that closures build when they are applied are not
+// instrumented.  Their cost is attributed to the op that applies the
+// closure.
+class profile
+{
+  std::vector <zw_profile_entry> m_entries;
+  std::deque <std::string> m_names;
+  size_t m_depth;
+
+public:
+  profile ();
+
+  std::vector <zw_profile_entry> const &
+  entries () const
+  {
+    return m_entries;
+  }
+
+  zw_profile_entry &
+  at (size_t idx)
+  {
+    return m_entries[idx];
+  }
+
+  // Called by tree::build_exec and tree::build_pred around building
+  // an op (if PRED is false) or a pred for T.  If nothing ends up
+  // being built, leave should be called with KEEP of false, and the
+  // entry is dropped, unless entries were kept for children of T.
+  size_t enter (tree const &t, bool pred);
+  void leave (size_t idx, bool keep);
+
+  // Rename entry IDX.
+  void rename (size_t idx, std::string name);
+
+  static std::shared_ptr <op> instrument (std::shared_ptr <profile> prof,
+					  size_t idx,
+					  std::shared_ptr <op> op);
+  static std::unique_ptr <pred> instrument (std::shared_ptr <profile> prof,
+					    size_t idx,
+					    std::unique_ptr <pred> pred);
+
+  // While an instance of build_scope is alive, op graphs built on
+  // this thread are instrumented to record to PROF.
+  class build_scope
+  {
+    std::shared_ptr <profile> m_prof;
+    std::shared_ptr <profile> m_prev;
+
+  public:
+    explicit build_scope (std::shared_ptr <profile> prof);
+    ~build_scope ();
+    build_scope (build_scope const &) = delete;
+  };
+
+  // The profile that op graphs are currently instrumented for, or
+  // nullptr.
+  static std::shared_ptr <profile> building ();
+};
+
+#endif /* _PROFILE_H_ */
@@ -63,8 +63,18 @@ std::shared_ptr <frame>
 frame::clone () const
 {
   auto ret = std::make_shared <frame> (m_parent, 0);
+  ret->m_values.reserve (m_values.size ());
+
+  // Closures are cloned, so that each clone holds a reference of its
+  // own to the frame that the closure captured.
+  // value_closure::maybe_unlink_frame counts those references to tell
+  // whether only closures bound in that frame keep it alive.
   for (auto const &val: m_values)
-    ret->m_values.push_back (val != nullptr ? val->clone () : nullptr);
+    if (val != nullptr && value::as <value_closure> (val.get ()) != nullptr)
+      ret->m_values.push_back (val->clone ());
+    else
+      ret->m_values.push_back (val);
+
   return ret;
 }
 
@@ -74,70 +84,85 @@ frame::~frame ()
 }
 
 stack::stack (stack const &that)
-  : m_frame {that.m_frame != nullptr ? that.m_frame->clone () : nullptr}
+  : m_top {that.m_top}
+  , m_size {that.m_size}
+  , m_frame {that.m_frame}
+  , m_frame_shared {that.m_frame != nullptr}
   , m_profile {that.m_profile}
+  , m_checked {that.m_checked}
 {
-  for (auto const &v: that.m_values)
-    m_values.push_back (v->clone ());
+  if (m_frame_shared)
+    that.m_frame_shared = true;
+  if (s_counting)
+    ++s_copies;
 }
 
+std::shared_ptr <frame>
+stack::own_frame ()
+{
+  if (m_frame_shared)
+    {
+      std::shared_ptr <frame> of = m_frame;
+      m_frame = of->clone ();
+      m_frame_shared = false;
+      value_closure::maybe_unlink_frame (of);
+    }
+  return m_frame;
+}
+
+thread_local bool stack::s_counting = false;
+thread_local uint64_t stack::s_copies = 0;
+
 namespace
 {
+  // Slots are compared TOS first.  Once both walks reach the same
+  // cell, the rest of the two stacks is shared and thus equal.
+  template <class Cell>
   int
-  compare_stack (std::vector <std::unique_ptr <value> > const &a,
-	       std::vector <std::unique_ptr <value> > const &b)
+  compare_stack (Cell const *a, size_t a_size, Cell const *b, size_t b_size)
   {
-    if (a.size () < b.size ())
+    if (a_size < b_size)
       return -1;
-    else if (a.size () > b.size ())
+    else if (a_size > b_size)
       return 1;
 
     // The stack that has nullptr where the other has non-nullptr is
     // smaller.
-    {
-      auto it = a.begin ();
-      auto jt = b.begin ();
-      for (; it != a.end (); ++it, ++jt)
-	if (*it == nullptr && *jt != nullptr)
-	  return -1;
-	else if (*it != nullptr && *jt == nullptr)
-	  return 1;
-    }
+    for (auto it = a, jt = b; it != jt;
+	 it = it->m_next.get (), jt = jt->m_next.get ())
+      if (it->m_value == nullptr && jt->m_value != nullptr)
+	return -1;
+      else if (it->m_value != nullptr && jt->m_value == nullptr)
+	return 1;
 
     // The stack with "smaller" types is smaller.
-    {
-      auto it = a.begin ();
-      auto jt = b.begin ();
-      for (; it != a.end (); ++it, ++jt)
-	if (*it != nullptr && *jt != nullptr)
-	  {
-	    if ((*it)->get_type () < (*jt)->get_type ())
-	      return -1;
-	    else if ((*jt)->get_type () < (*it)->get_type ())
-	      return 1;
-	  }
-    }
+    for (auto it = a, jt = b; it != jt;
+	 it = it->m_next.get (), jt = jt->m_next.get ())
+      if (it->m_value != nullptr && jt->m_value != nullptr)
+	{
+	  if (it->m_value->get_type () < jt->m_value->get_type ())
+	    return -1;
+	  else if (jt->m_value->get_type () < it->m_value->get_type ())
+	    return 1;
+	}
 
     // We have the same number of slots with values of the same type.
     // Now compare the values directly.
-    {
-      auto it = a.begin ();
-      auto jt = b.begin ();
-      for (; it != a.end (); ++it, ++jt)
-	if (*it != nullptr && *jt != nullptr)
-	  switch ((*it)->cmp (**jt))
-	    {
-	    case cmp_result::fail:
-	      assert (! "Comparison of same-typed slots shouldn't fail!");
-	      abort ();
-	    case cmp_result::less:
-	      return -1;
-	    case cmp_result::greater:
-	      return 1;
-	    case cmp_result::equal:
-	      break;
-	    }
-    }
+    for (auto it = a, jt = b; it != jt;
+	 it = it->m_next.get (), jt = jt->m_next.get ())
+      if (it->m_value != nullptr && jt->m_value != nullptr)
+	switch (it->m_value->cmp (*jt->m_value))
+	  {
+	  case cmp_result::fail:
+	    assert (! "Comparison of same-typed slots shouldn't fail!");
+	    abort ();
+	  case cmp_result::less:
+	    return -1;
+	  case cmp_result::greater:
+	    return 1;
+	  case cmp_result::equal:
+	    break;
+	  }
 
     // The stacks are the same!
     return 0;
@@ -147,16 +172,40 @@ namespace
 bool
 stack::operator< (stack const &that) const
 {
-  return compare_stack (m_values, that.m_values) < 0;
+  return compare_stack (m_top.get (), m_size,
+			that.m_top.get (), that.m_size) < 0;
 }
 
 bool
 stack::operator== (stack const &that) const
 {
-  return compare_stack (m_values, that.m_values) == 0;
+  return compare_stack (m_top.get (), m_size,
+			that.m_top.get (), that.m_size) == 0;
+}
+
+size_t
+stack::hash () const
+{
+  size_t ret = m_size;
+  for (cell const *c = m_top.get (); c != nullptr; c = c->m_next.get ())
+    if (c->m_value == nullptr)
+      ret = hash_combine (ret, 0);
+    else
+      ret = hash_combine (ret, hash_combine (c->m_value->get_type ().code (),
+					     c->m_value->hash ()));
+  return ret;
 }
 
 stack::~stack ()
 {
   value_closure::maybe_unlink_frame (m_frame);
+
+  // Release the cells that only this stack references iteratively,
+  // so that tearing down a deep stack doesn't recurse through the
+  // whole list.
+  while (m_top != nullptr && m_top.use_count () == 1)
+    {
+      auto next = std::move (m_top->m_next);
+      m_top = std::move (next);
+    }
 }
@@ -39,10 +39,14 @@ enum var_id: unsigned {};
 
 // Stack frame, or activation record, of a running procedure (or other
 // sort of context).
+//
+// Bound values are immutable and are shared between a frame and its
+// clones, so cloning a frame mostly only copies the slot pointers.
+// Closures are the exception, see frame::clone.
 struct frame
 {
   std::shared_ptr <frame> m_parent;
-  std::vector <std::unique_ptr <value>> m_values;
+  std::vector <std::shared_ptr <value>> m_values;
 
   frame (std::shared_ptr <frame> parent, size_t vars)
     : m_parent {parent}
@@ -60,23 +64,94 @@ struct frame
 
 // Value file is a container type that's used for maintaining stacks
 // of dwgrep values.
+//
+// Slots are kept in a persistent singly-linked list, TOS first.
+// Copying a stack only copies the pointer to the top cell, so stacks
+// forked off a common ancestor share the common part of their
+// contents.  Shared cells are never modified: pop steals the value
+// from a cell that only this stack references, and clones it
+// otherwise.  Values obtained through top and get may thus be shared
+// with other stacks and must not be modified in place.
+//
+// The top frame is likewise shared by stacks copied off one another.
+// It is cloned when one of them needs a frame of its own, i.e. before
+// a binding is written to it or a closure captures it (see
+// own_frame).
+//
+// A stack maintains a profile of types of values near TOS, which is
+// used for dynamic dispatch of overloaded words, and checks that it
+// is not underrun.  Unchecked stacks do neither.  They are used for
+// queries that were proven to not need either (see
+// tree::peg_overloads).  Stacks copied off an unchecked stack are
+// unchecked as well.
 class stack
 {
-  std::vector <std::unique_ptr <value>> m_values;
+  struct cell
+  {
+    std::unique_ptr <value> m_value;
+    std::shared_ptr <cell> m_next;
+
+    cell (std::unique_ptr <value> val, std::shared_ptr <cell> next)
+      : m_value {std::move (val)}
+      , m_next {std::move (next)}
+    {}
+  };
+
+  std::shared_ptr <cell> m_top;
+  size_t m_size;
   std::shared_ptr <frame> m_frame;
+  // Whether m_frame may be reachable from other stacks as well.
+  // Copying a stack sets this at both the copy and the original.
+  mutable bool m_frame_shared;
   selector::sel_t m_profile;
+  bool m_checked;
+
+  static thread_local bool s_counting;
+  static thread_local uint64_t s_copies;
+
+  cell const &
+  nth_cell (unsigned depth) const
+  {
+    need (depth + 1);
+    cell const *c = m_top.get ();
+    for (unsigned i = 0; i < depth; ++i)
+      c = c->m_next.get ();
+    return *c;
+  }
 
 public:
   typedef std::unique_ptr <stack> uptr;
 
   stack ()
-    : m_profile {0}
+    : m_size {0}
+    , m_frame_shared {false}
+    , m_profile {0}
+    , m_checked {true}
   {}
 
   stack (stack const &other);
   stack (stack &&other) = default;
   ~stack ();
 
+  // Number of stacks copied on this thread so far, while counting
+  // was enabled.  Query profiles (see profile.hh) enable counting
+  // while instrumented ops run, to tell which ops copy stacks.
+  static uint64_t
+  copies ()
+  {
+    return s_copies;
+  }
+
+  // Enable or disable counting of copies on this thread.  Returns
+  // whether counting was enabled before.
+  static bool
+  count_copies (bool enable)
+  {
+    bool ret = s_counting;
+    s_counting = enable;
+    return ret;
+  }
+
   std::shared_ptr <frame>
   nth_frame (size_t depth) const
   {
@@ -86,52 +161,94 @@ public:
     return ret;
   }
 
+  // FRAME may be held elsewhere, so it is treated as shared.
   void
   set_frame (std::shared_ptr <frame> frame)
   {
     m_frame = frame;
+    m_frame_shared = true;
   }
 
+  // Push a new frame with VARS unbound variables on top of the
+  // current one.
+  void
+  push_frame (size_t vars)
+  {
+    m_frame = std::make_shared <frame> (m_frame, vars);
+    m_frame_shared = false;
+  }
+
+  // The top frame, cloned first if other stacks may reach it, so
+  // that bindings written to it are only seen by this stack.
+  std::shared_ptr <frame> own_frame ();
+
   size_t
   size () const
   {
-    return m_values.size ();
+    return m_size;
+  }
+
+  bool
+  checked () const
+  {
+    return m_checked;
+  }
+
+  void
+  set_unchecked ()
+  {
+    m_checked = false;
   }
 
   selector::sel_t
   profile () const
   {
+    assert (m_checked);
     return m_profile;
   }
 
   void
   push (std::unique_ptr <value> vp)
   {
-    m_profile <<= 8;
-    m_profile |= vp->get_type ().code ();
-    m_values.push_back (std::move (vp));
+    if (m_checked)
+      {
+	m_profile <<= 8;
+	m_profile |= vp->get_type ().code ();
+      }
+    m_top = std::make_shared <cell> (std::move (vp), std::move (m_top));
+    ++m_size;
   }
 
   void
   need (unsigned depth) const
   {
-    if (depth > m_values.size ())
+    if (m_checked && depth > m_size)
       throw std::runtime_error ("stack overflow");
+    assert (depth <= m_size);
   }
 
   std::unique_ptr <value>
   pop ()
   {
     need (1);
-    auto ret = std::move (m_values.back ());
-    m_values.pop_back ();
-    m_profile >>= 8;
-    if (m_values.size () >= selector::W)
+    std::shared_ptr <cell> c = std::move (m_top);
+    m_top = c->m_next;
+    --m_size;
+
+    if (m_checked)
       {
-	auto code = get (selector::W - 1).get_type ().code ();
-	m_profile |= ((selector::sel_t) code) << 24;
+	m_profile >>= 8;
+	if (m_size >= selector::W)
+	  {
+	    auto code = get (selector::W - 1).get_type ().code ();
+	    m_profile |= ((selector::sel_t) code) << 24;
+	  }
       }
-    return ret;
+
+    if (c.use_count () == 1)
+      return std::move (c->m_value);
+    else
+      return c->m_value->clone ();
   }
 
   template <class T>
@@ -146,22 +263,19 @@ public:
   value &
   top ()
   {
-    need (1);
-    return *m_values.back ().get ();
+    return get (0);
   }
 
   value &
   get (unsigned depth)
   {
-    need (depth + 1);
-    return *(m_values.rbegin () + depth)->get ();
+    return *nth_cell (depth).m_value;
   }
 
   value const &
   get (unsigned depth) const
   {
-    need (depth + 1);
-    return *(m_values.rbegin () + depth)->get ();
+    return *nth_cell (depth).m_value;
   }
 
   template <class T>
@@ -180,8 +294,45 @@ public:
     return value::as <T> (const_cast <value *> (&ret));
   }
 
+  // Whether this stack is OTHER with N more values pushed, i.e.
+  // whether it shares everything below its top N slots with OTHER,
+  // and has the same frame.  Such stacks can be told apart cheaply
+  // from ones that merely hold equal values.
+  bool
+  extends (stack const &other, size_t n) const
+  {
+    if (m_size != other.m_size + n || m_frame != other.m_frame)
+      return false;
+
+    cell const *c = m_top.get ();
+    for (size_t i = 0; i < n; ++i)
+      c = c->m_next.get ();
+    return c == other.m_top.get ();
+  }
+
+  // Whether this stack and OTHER are of the same size and share
+  // everything below their top N slots.
+  bool
+  shares_below (stack const &other, size_t n) const
+  {
+    if (m_size != other.m_size || m_size < n)
+      return false;
+
+    cell const *c = m_top.get ();
+    cell const *d = other.m_top.get ();
+    for (size_t i = 0; i < n; ++i)
+      {
+	c = c->m_next.get ();
+	d = d->m_next.get ();
+      }
+    return c == d;
+  }
+
   bool operator< (stack const &that) const;
   bool operator== (stack const &that) const;
+
+  // Stacks that compare equal hash equal.
+  size_t hash () const;
 };
 
 #endif /* _STK_H_ */
@@ -26,22 +26,29 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <atomic>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <thread>
 
 #include "atval.hh"
 #include "builtin-dw-abbrev.hh"
 #include "builtin-dw.hh"
 #include "builtin-symbol.hh"
 #include "builtin.hh"
+#include "cache.hh"
 #include "dwit.hh"
 #include "init.hh"
+#include "libzwerg-dw.h"
+#include "libzwerg.hh"
 #include "op.hh"
 #include "parser.hh"
 #include "stack.hh"
 #include "test-zw-aux.hh"
 #include "value-dw.hh"
+#include "value-seq.hh"
 
 std::string
 test_file (std::string name)
@@ -892,3 +899,382 @@ TEST_F (ZwTest, symbol_cmp)
        auto val = prod->next (); )
     EXPECT_EQ (cmp_result::equal, val->cmp (*val));
 }
+
+TEST_F (ZwTest, dwfl_context_for_this_thread)
+{
+  std::unique_ptr <value_dwarf> vdw;
+  Dwarf *dw;
+  get_sole_dwarf ("twocus", vdw, dw);
+  ASSERT_TRUE (vdw != nullptr);
+
+  auto ctx = vdw->get_dwctx ();
+  EXPECT_EQ (ctx, ctx->for_this_thread ());
+
+  value_die vd (ctx, dwpp_offdie (dw, 0xa3), 0, doneness::raw);
+  EXPECT_EQ (0x80, ctx->find_parent (vd.get_die ()));
+
+  std::shared_ptr <dwfl_context> ctx2, ctx3;
+  std::unique_ptr <value> v2;
+  std::thread thr {[&] ()
+    {
+      ctx2 = ctx->for_this_thread ();
+      ctx3 = ctx->for_this_thread ();
+      v2 = vd.clone_for_this_thread ();
+    }};
+  thr.join ();
+
+  // The other thread gets a handle of its own, and keeps it.
+  ASSERT_TRUE (ctx2 != nullptr);
+  EXPECT_NE (ctx->get_dwfl (), ctx2->get_dwfl ());
+  EXPECT_EQ (ctx2->get_dwfl (), ctx3->get_dwfl ());
+
+  // The DIE is translated to that handle by offset, and the parent
+  // cache is shared.
+  auto vd2 = value::as <value_die> (v2.get ());
+  ASSERT_TRUE (vd2 != nullptr);
+  EXPECT_EQ (ctx2->get_dwfl (), vd2->get_dwctx ()->get_dwfl ());
+  EXPECT_NE (dwarf_cu_getdwarf (vd.get_die ().cu),
+	     dwarf_cu_getdwarf (vd2->get_die ().cu));
+  EXPECT_EQ (dwarf_dieoffset (&vd.get_die ()),
+	     dwarf_dieoffset (&vd2->get_die ()));
+  EXPECT_EQ (0x80, vd2->get_dwctx ()->find_parent (vd2->get_die ()));
+}
+
+TEST_F (ZwTest, find_parent_agrees_with_all_dies_iterator)
+{
+  // nullptr.o has a unit of more DIE's than fit in one block of the
+  // parent index.
+  for (auto fn: {"twocus", "nullptr.o"})
+    {
+      std::unique_ptr <value_dwarf> vdw;
+      Dwarf *dw;
+      get_sole_dwarf (fn, vdw, dw);
+      ASSERT_TRUE (vdw != nullptr);
+
+      auto ctx = vdw->get_dwctx ();
+      size_t n = 0;
+      for (all_dies_iterator it (dw); it != all_dies_iterator::end ();
+	   ++it, ++n)
+	{
+	  auto stk = it.stack ();
+	  Dwarf_Off expect = stk.size () > 1
+	    ? dwarf_dieoffset (&stk[stk.size () - 2]) : parent_cache::no_off;
+	  EXPECT_EQ (expect, ctx->find_parent (**it)) << fn;
+	  EXPECT_EQ (stk.size () - 1, ctx->die_depth (**it)) << fn;
+
+	  // The other DIE's on the stack are the ancestors.
+	  for (size_t i = 0; i + 1 < stk.size (); ++i)
+	    EXPECT_TRUE (ctx->is_ancestor (stk[i], **it)) << fn;
+	  EXPECT_FALSE (ctx->is_ancestor (**it, **it)) << fn;
+	  if (stk.size () > 1)
+	    EXPECT_FALSE (ctx->is_ancestor (**it, stk[stk.size () - 2]))
+	      << fn;
+	}
+      EXPECT_LT (2u, n) << fn;
+    }
+}
+
+namespace
+{
+  std::vector <Dwarf_Off>
+  tos_offsets (std::vector <std::unique_ptr <stack>> const &yielded)
+  {
+    std::vector <Dwarf_Off> ret;
+    for (auto const &stk: yielded)
+      {
+	auto vd = value::as <value_die> (&stk->get (0));
+	EXPECT_TRUE (vd != nullptr);
+	if (vd != nullptr)
+	  ret.push_back (dwarf_dieoffset (&vd->get_die ()));
+      }
+    return ret;
+  }
+
+  // Run Q on a Dwarf, with overloads pegged and strength reduced.
+  // LEN is set to the number of words that the reduced query has.
+  std::vector <std::unique_ptr <stack>>
+  run_reduced_dwquery (vocabulary &voc, std::string fn, std::string q,
+		       size_t &len)
+  {
+    tree t = parse_query (voc, q);
+    t.simplify ();
+    static_profile profile;
+    profile.push (value_dwarf::vtype);
+    t.peg_overloads (profile);
+    t.reduce_strength ();
+    len = t.tt () == tree_type::CAT ? t.m_children.size () : 1;
+
+    std::shared_ptr <op> op = t.build_exec
+      (std::make_shared <op_origin>
+	(stack_with_value (dw (fn, doneness::cooked))));
+
+    std::vector <std::unique_ptr <stack>> yielded;
+    while (auto r = op->next ())
+      yielded.push_back (std::move (r));
+    return yielded;
+  }
+}
+
+TEST_F (ZwTest, ancestor_depth_agree_with_parent)
+{
+  for (auto fn: {"twocus", "dwz-partial"})
+    for (auto pfx: {"", "raw "})
+      {
+	std::string p = pfx;
+	size_t n = run_dwquery (*builtins, fn, p + "entry").size ();
+	ASSERT_LT (0u, n);
+
+	EXPECT_EQ (tos_offsets (run_dwquery (*builtins, fn,
+					     p + "entry parent+")),
+		   tos_offsets (run_dwquery (*builtins, fn,
+					     p + "entry ancestor")));
+
+	EXPECT_EQ (n, run_dwquery (*builtins, fn,
+				   p + "entry (depth == [parent+] length)")
+			.size ());
+
+	EXPECT_EQ (run_dwquery (*builtins, fn, p + "entry parent+").size (),
+		   run_dwquery (*builtins, fn,
+				p + "entry (|A| A parent+ A ?ancestor_of)")
+			.size ());
+
+	EXPECT_EQ (n, run_dwquery (*builtins, fn,
+				   p + "entry (|A| A A !ancestor_of)").size ());
+      }
+}
+
+TEST_F (ZwTest, parent_star_tag_reduced)
+{
+  for (auto fn: {"twocus", "dwz-partial"})
+    for (auto q: {"entry parent* ?TAG_subprogram",
+		  "entry parent* ?TAG_compile_unit",
+		  "entry ancestor ?TAG_compile_unit",
+		  "raw entry parent* ?TAG_partial_unit"})
+      {
+	size_t len;
+	auto got = run_reduced_dwquery (*builtins, fn, q, len);
+	auto want = run_dwquery (*builtins, fn, q);
+
+	// The closure, or ancestor, and the tag assertion are replaced
+	// by a single reduced builtin.
+	EXPECT_EQ (strncmp (q, "raw", 3) == 0 ? 3 : 2, len) << q;
+	EXPECT_EQ (tos_offsets (want), tos_offsets (got)) << fn << ": " << q;
+      }
+}
+
+TEST_F (ZwTest, entry_tag_reduced)
+{
+  std::vector <std::pair <char const *, size_t>> queries = {
+    {"entry ?TAG_subprogram", 1},
+    {"entry ?TAG_pointer_type root", 2},
+    {"entry ?TAG_imported_unit", 1},
+    {"raw entry ?TAG_imported_unit", 2},
+    {"raw entry ?TAG_partial_unit", 2},
+    {"entry (?TAG_base_type || ?TAG_pointer_type)", 1},
+    {"entry (?TAG_base_type || ?TAG_pointer_type || ?TAG_base_type)", 1},
+    {"entry (?TAG_subprogram, ?TAG_compile_unit)", 1},
+    // Duplicate branches of an alternation yield DIE's twice.
+    {"entry (?TAG_subprogram, ?TAG_subprogram)", 2},
+    // Positions of skipped DIE's would be missing.
+    {"entry ?TAG_subprogram pos", 3},
+  };
+
+  for (auto fn: {"twocus", "dwz-partial"})
+    for (auto const &q: queries)
+      {
+	size_t len;
+	auto got = run_reduced_dwquery (*builtins, fn, q.first, len);
+	auto want = run_dwquery (*builtins, fn, q.first);
+
+	EXPECT_EQ (q.second, len) << q.first;
+	if (strstr (q.first, "pos") == nullptr)
+	  EXPECT_EQ (tos_offsets (want), tos_offsets (got))
+	    << fn << ": " << q.first;
+      }
+}
+
+TEST_F (ZwTest, die_attrs_agree_with_libdw)
+{
+  for (auto fn: {"twocus", "nullptr.o", "bitcount.o", "a1.out"})
+    {
+      std::unique_ptr <value_dwarf> vdw;
+      Dwarf *dw;
+      get_sole_dwarf (fn, vdw, dw);
+      ASSERT_TRUE (vdw != nullptr);
+
+      for (all_dies_iterator it (dw); it != all_dies_iterator::end (); ++it)
+	{
+	  Dwarf_Die die = **it;
+	  die_attrs attrs {die};
+
+	  size_t n = 0;
+	  for (auto const &at: attrs)
+	    {
+	      Dwarf_Attribute ref;
+	      ASSERT_TRUE (dwarf_attr (&die, at.code, &ref) != nullptr);
+	      EXPECT_EQ (ref.form, at.form);
+	      EXPECT_EQ (ref.valp, at.valp);
+	      ++n;
+	    }
+
+	  size_t cnt = 0;
+	  if (die.abbrev == nullptr)
+	    dwarf_haschildren (&die);
+	  ASSERT_EQ (0, dwarf_getattrcnt (die.abbrev, &cnt));
+	  EXPECT_EQ (cnt, attrs.size ());
+	  EXPECT_EQ (cnt, n);
+	}
+    }
+}
+
+TEST_F (ZwTest, abbrev_summary_agrees_with_libdw)
+{
+  for (auto fn: {"twocus", "nullptr.o", "bitcount.o", "a1.out"})
+    {
+      std::unique_ptr <value_dwarf> vdw;
+      Dwarf *dw;
+      get_sole_dwarf (fn, vdw, dw);
+      ASSERT_TRUE (vdw != nullptr);
+
+      abbrev_cache &abbrevs = vdw->get_dwctx ()->get_abbrev_cache ();
+      for (all_dies_iterator it (dw); it != all_dies_iterator::end (); ++it)
+	{
+	  Dwarf_Die die = **it;
+	  abbrev_summary const &summary = abbrevs.get (die);
+
+	  for (unsigned atname: {DW_AT_name, DW_AT_type, DW_AT_location,
+				 DW_AT_byte_size, DW_AT_external,
+				 DW_AT_GNU_all_call_sites})
+	    EXPECT_EQ (dwarf_hasattr (&die, atname) != 0,
+		       summary.has (atname));
+
+	  size_t n = 0;
+	  for (auto const &at: die_attrs {die})
+	    {
+	      Dwarf_Attribute fixed;
+	      if (summary.find_fixed (die, at.code, fixed))
+		{
+		  EXPECT_EQ (at.form, fixed.form);
+		  EXPECT_EQ (at.valp, fixed.valp);
+		  ++n;
+		}
+	    }
+	  EXPECT_EQ (summary.m_fixed.size (), n);
+	}
+    }
+}
+
+TEST_F (ZwTest, die_attributes_and_attr_values_match_queries)
+{
+  auto die_yielded = run_dwquery (*builtins, "nullptr.o",
+				  "entry (offset == 0x6e)");
+  auto die = SOLE_YIELDED_VALUE (value_die, die_yielded);
+
+  auto attrs_yielded = run_dwquery (*builtins, "nullptr.o",
+				    "entry (offset == 0x6e) [raw attribute]");
+  auto attrs = SOLE_YIELDED_VALUE (value_seq, attrs_yielded);
+
+  std::unique_ptr <zw_value, zw_deleter> attrs2
+	{zw_value_die_attributes_raw (&die, zw_throw_on_error {})};
+  EXPECT_EQ (cmp_result::equal, attrs.cmp (*attrs2));
+
+  for (auto const &at: *attrs.get_seq ())
+    {
+      auto values_yielded
+	= run_query (*builtins, stack_with_value (at->clone ()), "[value]");
+      auto values = SOLE_YIELDED_VALUE (value_seq, values_yielded);
+
+      std::unique_ptr <zw_value, zw_deleter> values2
+	{zw_value_attr_values (at.get (), zw_throw_on_error {})};
+      EXPECT_EQ (cmp_result::equal, values.cmp (*values2));
+    }
+}
+
+TEST_F (ZwTest, c_api_dwarf_shared_between_threads)
+{
+  // One Dwarf value, opened once, is queried by several threads at
+  // once, as are a DIE and a CU of it.  Each thread gets a Dwarf
+  // handle of its own, to which the DIE and the CU are translated,
+  // while the parent and tag caches behind those handles are shared.
+  // This is meant to be run under ThreadSanitizer as well.
+  std::unique_ptr <zw_vocabulary, zw_deleter> voc
+	{zw_vocabulary_init (zw_throw_on_error {})};
+  zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+  zw_vocabulary_add (voc.get (), zw_vocabulary_dwarf (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+
+  std::unique_ptr <zw_value, zw_deleter> dwarf
+	{zw_value_init_dwarf (test_file ("dwz-partial").c_str (), 0,
+			      zw_throw_on_error {})};
+  std::unique_ptr <zw_stack, zw_deleter> input
+	{zw_stack_init (zw_throw_on_error {})};
+  zw_stack_push (input.get (), dwarf.get (), zw_throw_on_error {});
+
+  // Push a DIE and its unit on top of the Dwarf.
+  {
+    std::unique_ptr <zw_query, zw_deleter> q
+	{zw_query_parse (voc.get (), "entry (offset == 0x14) dup unit",
+			 zw_throw_on_error {})};
+    std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (q.get (), input.get (), zw_throw_on_error {})};
+    auto out = zw_result_next (*result);
+    ASSERT_TRUE (out != nullptr);
+    for (size_t i = 2; i-- > 0; )
+      zw_stack_push (input.get (), zw_stack_at (out.get (), i),
+		     zw_throw_on_error {});
+  }
+
+  std::vector <std::unique_ptr <zw_query, zw_deleter>> queries;
+  for (auto text: {"|D E U| D entry ?(@AT_name)",
+		   "|D E U| D entry ?TAG_pointer_type ancestor",
+		   "|D E U| E root",
+		   "|D E U| E parent",
+		   "|D E U| U entry ?(@AT_name)"})
+    queries.emplace_back (zw_query_parse (voc.get (), text,
+					  zw_throw_on_error {}));
+
+  // Run query Q on STK, and collect offsets of the yielded DIE's.
+  auto run = [&] (zw_query const &q, zw_stack const &stk)
+    {
+      std::vector <Dwarf_Off> ret;
+      std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (&q, &stk, zw_throw_on_error {})};
+      while (auto out = zw_result_next (*result))
+	{
+	  Dwarf_Die die = zw_value_die_die (zw_stack_at (out.get (), 0));
+	  ret.push_back (dwarf_dieoffset (&die));
+	}
+      return ret;
+    };
+
+  std::vector <std::vector <Dwarf_Off>> want;
+  for (auto const &q: queries)
+    {
+      want.push_back (run (*q, *input));
+      ASSERT_FALSE (want.back ().empty ());
+    }
+
+  std::atomic <unsigned> mismatches {0};
+  std::vector <std::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.emplace_back ([&] ()
+      {
+	// Every other run pushes the shared values anew.
+	std::unique_ptr <zw_stack, zw_deleter> own
+	  {zw_stack_init (zw_throw_on_error {})};
+	for (size_t d = zw_stack_depth (input.get ()); d-- > 0; )
+	  zw_stack_push (own.get (), zw_stack_at (input.get (), d),
+			 zw_throw_on_error {});
+	for (int j = 0; j < 60; ++j)
+	  {
+	    size_t k = j % queries.size ();
+	    if (run (*queries[k], j % 2 == 0 ? *input : *own) != want[k])
+	      ++mismatches;
+	  }
+      });
+  for (auto &thr: threads)
+    thr.join ();
+
+  EXPECT_EQ (0, mismatches);
+}
@@ -27,11 +27,20 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
 #include "std-memory.hh"
 
 #include "op.hh"
 #include "init.hh"
+#include "libzwerg.hh"
+#include "overload.hh"
+#include "parallel.hh"
+#include "parser.hh"
+#include "profile.hh"
+#include "value-closure.hh"
 #include "value-cst.hh"
+#include "value-str.hh"
 #include "test-zw-aux.hh"
 
 struct ZwTest
@@ -173,3 +182,691 @@ TEST_F (ZwTest, frame_with_value_referencing_it_doesnt_leak_3)
   run_query (*builtins, std::move (stk), "{{} apply}->F G; ?(G)");
   ASSERT_EQ (1, counter.use_count ());
 }
+
+TEST_F (ZwTest, stack_copy_shares_values)
+{
+  auto counter = std::make_shared <empty> ();
+  auto stk = stack_with_value (std::make_unique <value_canary> (counter));
+  ASSERT_EQ (2, counter.use_count ());
+
+  // Forking a stack doesn't clone its values.
+  auto stk2 = std::make_unique <stack> (*stk);
+  ASSERT_EQ (2, counter.use_count ());
+
+  // Popping a shared slot clones the value and leaves the original
+  // stack intact.
+  auto v = stk2->pop ();
+  ASSERT_EQ (3, counter.use_count ());
+  ASSERT_EQ (0, stk2->size ());
+  ASSERT_EQ (1, stk->size ());
+
+  // Popping a slot that isn't shared hands out the value itself.
+  v = nullptr;
+  stk2 = nullptr;
+  v = stk->pop ();
+  ASSERT_EQ (2, counter.use_count ());
+  ASSERT_TRUE (v->is <value_canary> ());
+}
+
+TEST_F (ZwTest, stack_copy_shares_frame)
+{
+  stack stk;
+  stk.push_frame (1);
+
+  // Forking a stack doesn't clone its frame.
+  stack stk2 {stk};
+  ASSERT_EQ (stk.nth_frame (0), stk2.nth_frame (0));
+
+  // Binding a variable does, and the binding isn't seen by the
+  // original stack.
+  auto val = std::make_unique <value_str> ("foo", 0);
+  stk2.own_frame ()->bind_value (var_id (0), std::move (val));
+  ASSERT_NE (stk.nth_frame (0), stk2.nth_frame (0));
+  ASSERT_TRUE (stk2.nth_frame (0)->read_value (var_id (0)).is <value_str> ());
+  ASSERT_THROW (stk.nth_frame (0)->read_value (var_id (0)),
+		std::runtime_error);
+
+  // The clone is now the fork's own.
+  auto f = stk2.nth_frame (0);
+  ASSERT_EQ (f, stk2.own_frame ());
+}
+
+TEST_F (ZwTest, forked_frame_keeps_closure_bindings)
+{
+  auto counter = std::make_shared <empty> ();
+  auto t = std::make_shared <tree> (tree_type::NOP);
+
+  // Frame F holds a closure over itself, and a canary.
+  auto f = std::make_shared <frame> (nullptr, 2);
+  f->bind_value (var_id (0), std::make_unique <value_closure> (t, f, 0));
+  f->bind_value (var_id (1), std::make_unique <value_canary> (counter));
+  auto other = std::make_unique <value_closure> (t, f, 0);
+
+  auto stk = std::make_unique <stack> ();
+  stk->set_frame (f);
+  f = nullptr;
+  auto fork = std::make_unique <stack> (*stk);
+  fork->own_frame ();
+
+  // Once the original stack is gone, destroying another closure over F
+  // must not unbind F, because the fork still reaches it through the
+  // closure bound in the fork's frame.
+  stk = nullptr;
+  other = nullptr;
+
+  auto cl = value::as <value_closure>
+    (&fork->nth_frame (0)->read_value (var_id (0)));
+  ASSERT_TRUE (cl != nullptr);
+  EXPECT_TRUE (cl->get_frame ()->read_value (var_id (1))
+		 .is <value_canary> ());
+
+  // And the whole cycle is freed with the fork.
+  fork = nullptr;
+  ASSERT_EQ (1, counter.use_count ());
+}
+
+TEST_F (ZwTest, stack_extends)
+{
+  auto cst = [] (int i)
+    {
+      return std::make_unique <value_cst> (constant {i, &dec_constant_dom}, 0);
+    };
+
+  stack stk;
+  stk.push (cst (1));
+
+  stack stk2 {stk};
+  ASSERT_TRUE (stk2.extends (stk, 0));
+  stk2.push (cst (2));
+  ASSERT_TRUE (stk2.extends (stk, 1));
+  ASSERT_FALSE (stk2.extends (stk, 0));
+
+  // Same values, but the bottom slot was replaced.
+  stack stk3 {stk};
+  stk3.push (stk3.pop ());
+  stk3.push (cst (2));
+  ASSERT_TRUE (stk3 == stk2);
+  ASSERT_FALSE (stk3.extends (stk, 1));
+
+  // Different frame.
+  stack stk4 {stk2};
+  stk4.set_frame (std::make_shared <frame> (nullptr, 0));
+  ASSERT_FALSE (stk4.extends (stk, 1));
+}
+
+TEST_F (ZwTest, let_hands_over_stack_with_frame)
+{
+  auto prof = std::make_shared <profile> ();
+  std::shared_ptr <op> op;
+  {
+    profile::build_scope scope {prof};
+    op = parse_query (*builtins, "1 |A| let X := A 2 add; X")
+      .build_exec (std::make_shared <op_origin> (std::make_unique <stack> ()));
+  }
+
+  auto stk = op->next ();
+  ASSERT_TRUE (stk != nullptr);
+  ASSERT_EQ (nullptr, op->next ());
+
+  // The let seeds its sub-expression with a copy of the incoming
+  // stack, which shares that stack's frame.  The sub-expression only
+  // pushes X, so its stack is handed over as is, instead of being
+  // copied once more.
+  for (auto const &e: prof->entries ())
+    if (std::string (e.name) == "subx_eval")
+      {
+	EXPECT_EQ (1, e.yields);
+	EXPECT_EQ (1, e.copies);
+	return;
+      }
+  FAIL () << "no profile entry for subx_eval";
+}
+
+TEST_F (ZwTest, stack_hash_agrees_with_equality)
+{
+  auto fill = [] (stack &stk, constant_dom const *dom)
+    {
+      stk.push (std::make_unique <value_str> ("foo", 0));
+      stk.push (std::make_unique <value_cst> (constant {17, dom}, 0));
+    };
+
+  // Constants of arithmetic domains compare by value.
+  stack stk, stk2;
+  fill (stk, &dec_constant_dom);
+  fill (stk2, &hex_constant_dom);
+  ASSERT_TRUE (stk == stk2);
+  ASSERT_EQ (stk.hash (), stk2.hash ());
+
+  ASSERT_TRUE (stk.shares_below (stack {stk}, 1));
+  ASSERT_FALSE (stk.shares_below (stk2, 1));
+  ASSERT_TRUE (stk.shares_below (stk2, 2));
+}
+
+namespace
+{
+  bool
+  is_pegged (tree const &t)
+  {
+    EXPECT_TRUE (t.tt () == tree_type::F_BUILTIN);
+    return std::dynamic_pointer_cast <overloaded_builtin const>
+      (t.m_builtin) == nullptr;
+  }
+}
+
+TEST_F (ZwTest, overloads_pegged_when_types_known)
+{
+  tree t = parse_query (*builtins, "1 2 add");
+  t.simplify ();
+  t.peg_overloads ();
+  ASSERT_TRUE (t.tt () == tree_type::CAT);
+  ASSERT_TRUE (is_pegged (t.m_children.back ()));
+
+  tree t2 = parse_query (*builtins, "2 add");
+  t2.simplify ();
+  t2.peg_overloads ();
+  ASSERT_TRUE (t2.tt () == tree_type::CAT);
+  ASSERT_FALSE (is_pegged (t2.m_children.back ()));
+
+  // Types of both branches agree.
+  tree t3 = parse_query (*builtins, "(1, 2) (3, 4) add");
+  t3.simplify ();
+  t3.peg_overloads ();
+  ASSERT_TRUE (t3.tt () == tree_type::CAT);
+  ASSERT_TRUE (is_pegged (t3.m_children.back ()));
+
+  // Here they disagree.
+  tree t4 = parse_query (*builtins, "(1, \"x\") 2 add");
+  t4.simplify ();
+  t4.peg_overloads ();
+  ASSERT_TRUE (t4.tt () == tree_type::CAT);
+  ASSERT_FALSE (is_pegged (t4.m_children.back ()));
+}
+
+namespace
+{
+  bool
+  proven (vocabulary const &voc, std::string q)
+  {
+    tree t = parse_query (voc, q);
+    t.simplify ();
+    return t.peg_overloads ();
+  }
+}
+
+TEST_F (ZwTest, stack_effect_verified)
+{
+  ASSERT_TRUE (proven (*builtins, "1 2 add"));
+  ASSERT_TRUE (proven (*builtins, "1 dup add 2 swap sub"));
+  ASSERT_TRUE (proven (*builtins, "[1, 2] (elem, length)"));
+  ASSERT_TRUE (proven (*builtins, "1 (dup \\dbg)* drop"));
+
+  // Underruns.
+  ASSERT_FALSE (proven (*builtins, "drop"));
+  ASSERT_FALSE (proven (*builtins, "1 swap"));
+  ASSERT_FALSE (proven (*builtins, "1 (drop, 2) add"));
+
+  // Dynamic dispatch is needed.
+  ASSERT_FALSE (proven (*builtins, "(1, \"x\") 2 add"));
+
+  // Closures may do anything.
+  ASSERT_FALSE (proven (*builtins, "{1} apply"));
+  ASSERT_FALSE (proven (*builtins, "1 ->A; A"));
+}
+
+TEST_F (ZwTest, unchecked_stack_doesnt_track_profile)
+{
+  stack stk;
+  stk.set_unchecked ();
+  stk.push (std::make_unique <value_cst> (constant {0, &dec_constant_dom}, 0));
+
+  auto stk2 = std::make_unique <stack> (stk);
+  ASSERT_FALSE (stk2->checked ());
+  ASSERT_EQ (1, stk2->size ());
+  ASSERT_TRUE (stk2->pop ()->is <value_cst> ());
+}
+
+namespace
+{
+  std::vector <std::unique_ptr <stack>>
+  run_reduced (vocabulary &voc, std::string q, size_t &len)
+  {
+    tree t = parse_query (voc, q);
+    t.simplify ();
+    t.peg_overloads ();
+    t.reduce_strength ();
+    len = t.tt () == tree_type::CAT ? t.m_children.size () : 1;
+
+    std::shared_ptr <op> op = t.build_exec
+      (std::make_shared <op_origin> (std::make_unique <stack> ()));
+
+    std::vector <std::unique_ptr <stack>> yielded;
+    while (auto r = op->next ())
+      yielded.push_back (std::move (r));
+    return yielded;
+  }
+}
+
+TEST_F (ZwTest, elem_pos_filter_reduced)
+{
+  for (auto q: {"[1, 2, 3] elem (pos == 1)",
+		"[1, 2, 3] relem (1 == pos)",
+		"[1, 2, 3] elem (pos == 7)",
+		"[1, 2, 3] elem (pos == T_CONST)"})
+    {
+      size_t len;
+      auto got = run_reduced (*builtins, q, len);
+      auto want = run_query (*builtins, std::make_unique <stack> (), q);
+
+      // [...] and the reduced elem.
+      ASSERT_EQ (2, len);
+      ASSERT_EQ (want.size (), got.size ());
+      for (size_t i = 0; i < want.size (); ++i)
+	{
+	  ASSERT_TRUE (want[i]->get (0).cmp (got[i]->get (0))
+		       == cmp_result::equal);
+	  ASSERT_EQ (want[i]->get (0).get_pos (), got[i]->get (0).get_pos ());
+	}
+    }
+}
+
+TEST_F (ZwTest, profile_counts_yields)
+{
+  auto prof = std::make_shared <profile> ();
+  std::shared_ptr <op> op;
+  {
+    profile::build_scope scope {prof};
+    op = parse_query (*builtins, "[1, 2, 3] elem 2 ?ne")
+      .build_exec (std::make_shared <op_origin> (std::make_unique <stack> ()));
+  }
+
+  size_t n = 0;
+  while (op->next () != nullptr)
+    ++n;
+  ASSERT_EQ (2, n);
+
+  auto const &entries = prof->entries ();
+  auto find = [&] (std::string name) -> zw_profile_entry const & {
+    for (auto const &e: entries)
+      if (e.name == name)
+	return e;
+    throw std::runtime_error ("no profile entry for " + name);
+  };
+
+  zw_profile_entry const &elem = find ("elem");
+  EXPECT_FALSE (elem.is_pred);
+  EXPECT_EQ (3, elem.yields);
+  EXPECT_LE (elem.ns_exclusive, elem.ns_inclusive);
+
+  zw_profile_entry const &ne = find ("?ne");
+  EXPECT_TRUE (ne.is_pred);
+  EXPECT_EQ (3, ne.calls);
+  EXPECT_EQ (2, ne.yields);
+}
+
+TEST_F (ZwTest, profile_forwards_count)
+{
+  auto prof = std::make_shared <profile> ();
+  std::shared_ptr <op> op;
+  {
+    profile::build_scope scope {prof};
+    op = parse_query (*builtins, "[1, 2, 3] elem")
+      .build_exec (std::make_shared <op_origin> (std::make_unique <stack> ()));
+  }
+
+  ASSERT_EQ (3, op->count (10));
+
+  // Counting is one call of the instrumented op, and what it counted
+  // is recorded as its yields.
+  for (auto const &e: prof->entries ())
+    if (std::string (e.name) == "elem")
+      {
+	EXPECT_EQ (1, e.calls);
+	EXPECT_EQ (3, e.yields);
+	return;
+      }
+  FAIL () << "no profile entry for elem";
+}
+
+namespace
+{
+  // Task I yields I % 4 stacks, and task 13 fails after yielding.
+  struct test_job
+    : public par_job
+  {
+    size_t
+    size () const override
+    {
+      return 50;
+    }
+
+    void
+    run (size_t i, std::function <void (stack::uptr)> yield) override
+    {
+      for (size_t j = 0; j < i % 4; ++j)
+	yield (stack_with_value
+	       (std::make_unique <value_cst>
+		(constant {i * 10 + j, &dec_constant_dom}, 0)));
+      if (i == 13)
+	throw std::runtime_error ("task failed");
+    }
+  };
+
+  std::vector <uint64_t>
+  run_parallel (bool ordered, size_t &errors)
+  {
+    op_parallel op {std::make_shared <test_job> (), 4, ordered};
+    std::vector <uint64_t> ret;
+    errors = 0;
+    while (true)
+      try
+	{
+	  auto stk = op.next ();
+	  if (stk == nullptr)
+	    return ret;
+	  auto v = stk->pop_as <value_cst> ();
+	  ret.push_back (v->get_constant ().value ().uval ());
+	}
+      catch (std::runtime_error const &e)
+	{
+	  ++errors;
+	}
+  }
+}
+
+TEST_F (ZwTest, parallel_ordered)
+{
+  size_t errors;
+  auto got = run_parallel (true, errors);
+
+  std::vector <uint64_t> want;
+  for (size_t i = 0; i < 50; ++i)
+    for (size_t j = 0; j < i % 4; ++j)
+      want.push_back (i * 10 + j);
+
+  ASSERT_EQ (want, got);
+  ASSERT_EQ (1, errors);
+}
+
+TEST_F (ZwTest, parallel_unordered)
+{
+  size_t errors;
+  auto got = run_parallel (false, errors);
+  std::sort (got.begin (), got.end ());
+
+  std::vector <uint64_t> want;
+  for (size_t i = 0; i < 50; ++i)
+    for (size_t j = 0; j < i % 4; ++j)
+      want.push_back (i * 10 + j);
+
+  ASSERT_EQ (want, got);
+  ASSERT_EQ (1, errors);
+}
+
+TEST_F (ZwTest, c_api_shared_between_threads)
+{
+  // One vocabulary, one query and one input stack are shared by
+  // threads that parse and execute queries concurrently.  This is
+  // meant to be run under ThreadSanitizer as well.
+  std::unique_ptr <zw_vocabulary, zw_deleter> voc
+	{zw_vocabulary_init (zw_throw_on_error {})};
+  zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+
+  char const *text = "let double := {dup add}; let N := [(1, 2, 3) double]; "
+		     "N elem \"a%sb\" (=~ \"a[24]b\")";
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), text, zw_throw_on_error {})};
+  std::unique_ptr <zw_stack, zw_deleter> input
+	{zw_stack_init (zw_throw_on_error {})};
+
+  auto run = [&] (zw_query const &q)
+    {
+      std::vector <std::string> ret;
+      std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (&q, input.get (), zw_throw_on_error {})};
+      while (auto out = zw_result_next (*result))
+	{
+	  size_t len;
+	  char const *str = zw_value_str_str (zw_stack_at (out.get (), 0),
+					      &len);
+	  ret.push_back ({str, len});
+	}
+      return ret;
+    };
+
+  std::vector <std::string> const want = {"a2b", "a4b"};
+  ASSERT_EQ (want, run (*query));
+
+  std::atomic <unsigned> mismatches {0};
+  std::vector <std::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.emplace_back ([&] ()
+      {
+	std::unique_ptr <zw_query, zw_deleter> own
+	  {zw_query_parse (voc.get (), text, zw_throw_on_error {})};
+	for (int j = 0; j < 200; ++j)
+	  if (run (j % 2 == 0 ? *query : *own) != want)
+	    ++mismatches;
+      });
+  for (auto &thr: threads)
+    thr.join ();
+
+  EXPECT_EQ (0, mismatches);
+}
+
+TEST_F (ZwTest, c_api_result_count)
+{
+  std::unique_ptr <zw_vocabulary, zw_deleter> voc
+	{zw_vocabulary_init (zw_throw_on_error {})};
+  zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+
+  std::unique_ptr <zw_stack, zw_deleter> input
+	{zw_stack_init (zw_throw_on_error {})};
+
+  // The query ends in a producer, which counts its values directly.
+  // Counting can be interleaved with pulling stacks.
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), "\"abcd\" elem", zw_throw_on_error {})};
+  std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (query.get (), input.get (), zw_throw_on_error {})};
+
+  uint64_t count;
+  ASSERT_TRUE (zw_result_count (result.get (), 2, &count,
+				zw_throw_on_error {}));
+  EXPECT_EQ (2, count);
+
+  auto out = zw_result_next (*result);
+  ASSERT_TRUE (out != nullptr);
+  size_t len;
+  char const *str = zw_value_str_str (zw_stack_at (out.get (), 0), &len);
+  EXPECT_EQ ("c", std::string (str, len));
+
+  ASSERT_TRUE (zw_result_count (result.get (), UINT64_MAX, &count,
+				zw_throw_on_error {}));
+  EXPECT_EQ (1, count);
+
+  // Other queries are counted by dropping stacks.
+  std::unique_ptr <zw_query, zw_deleter> query2
+	{zw_query_parse (voc.get (), "(1, 2, 3) (> 1)",
+			 zw_throw_on_error {})};
+  std::unique_ptr <zw_result, zw_deleter> result2
+	{zw_query_execute (query2.get (), input.get (), zw_throw_on_error {})};
+  ASSERT_TRUE (zw_result_count (result2.get (), UINT64_MAX, &count,
+				zw_throw_on_error {}));
+  EXPECT_EQ (2, count);
+}
+
+TEST_F (ZwTest, c_api_result_views)
+{
+  std::unique_ptr <zw_vocabulary, zw_deleter> voc
+	{zw_vocabulary_init (zw_throw_on_error {})};
+  zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+
+  std::unique_ptr <zw_stack, zw_deleter> input
+	{zw_stack_init (zw_throw_on_error {})};
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), "\"x\" (1, 2, 3, 4, 5)",
+			 zw_throw_on_error {})};
+  std::unique_ptr <zw_result, zw_deleter> result
+	{zw_query_execute (query.get (), input.get (), zw_throw_on_error {})};
+
+  auto u64_at = [] (zw_stack_view const *view, size_t depth)
+    {
+      return zw_value_const_u64 (zw_stack_view_at (view, depth));
+    };
+
+  zw_stack_view const *view = zw_result_next_view (*result);
+  ASSERT_TRUE (view != nullptr);
+  ASSERT_EQ (2, zw_stack_view_depth (view));
+  EXPECT_EQ (1, u64_at (view, 0));
+  EXPECT_TRUE (zw_value_is_str (zw_stack_view_at (view, 1)));
+
+  zw_stack_view const *views[3];
+  size_t count;
+  ASSERT_TRUE (zw_result_next_n (result.get (), views, 3, &count,
+				 zw_throw_on_error {}));
+  ASSERT_EQ (3, count);
+  for (size_t i = 0; i < 3; ++i)
+    EXPECT_EQ (2 + i, u64_at (views[i], 0));
+
+  ASSERT_TRUE (zw_result_next_n (result.get (), views, 3, &count,
+				 zw_throw_on_error {}));
+  ASSERT_EQ (1, count);
+  EXPECT_EQ (5, u64_at (views[0], 0));
+
+  EXPECT_TRUE (zw_result_next_view (*result) == nullptr);
+}
+
+namespace
+{
+  std::unique_ptr <zw_stack, zw_deleter>
+  stack_with_u64 (uint64_t i)
+  {
+    std::unique_ptr <zw_stack, zw_deleter> ret
+	{zw_stack_init (zw_throw_on_error {})};
+    zw_stack_push_take (ret.get (),
+			zw_value_init_const_u64 (i, zw_cdom_dec (), 0,
+						 zw_throw_on_error {}),
+			zw_throw_on_error {});
+    return ret;
+  }
+
+  std::unique_ptr <zw_stack, zw_deleter>
+  stack_with_str (char const *str)
+  {
+    std::unique_ptr <zw_stack, zw_deleter> ret
+	{zw_stack_init (zw_throw_on_error {})};
+    zw_stack_push_take (ret.get (),
+			zw_value_init_str (str, 0, zw_throw_on_error {}),
+			zw_throw_on_error {});
+    return ret;
+  }
+
+  std::unique_ptr <zw_vocabulary, zw_deleter>
+  core_vocabulary ()
+  {
+    std::unique_ptr <zw_vocabulary, zw_deleter> ret
+	{zw_vocabulary_init (zw_throw_on_error {})};
+    zw_vocabulary_add (ret.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		       zw_throw_on_error {});
+    return ret;
+  }
+}
+
+TEST_F (ZwTest, c_api_prepared_query_reexecuted)
+{
+  auto voc = core_vocabulary ();
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), "|X| (1, 2, 3) X add",
+			 zw_throw_on_error {})};
+  std::unique_ptr <zw_prepared_query, zw_deleter> prep
+	{zw_query_prepare (query.get (), zw_throw_on_error {})};
+
+  // Only take the first result.
+  {
+    auto input = stack_with_u64 (10);
+    std::unique_ptr <zw_result, zw_deleter> result
+	{zw_prepared_query_execute (prep.get (), input.get (),
+				    zw_throw_on_error {})};
+    auto out = zw_result_next (*result);
+    ASSERT_TRUE (out != nullptr);
+    EXPECT_EQ (11, zw_value_const_u64 (zw_stack_at (out.get (), 0)));
+  }
+
+  // The rest of the first run must not leak into the second one.
+  auto input = stack_with_u64 (20);
+  std::unique_ptr <zw_result, zw_deleter> result
+	{zw_prepared_query_execute (prep.get (), input.get (),
+				    zw_throw_on_error {})};
+  std::vector <uint64_t> got;
+  while (auto out = zw_result_next (*result))
+    got.push_back (zw_value_const_u64 (zw_stack_at (out.get (), 0)));
+  EXPECT_EQ ((std::vector <uint64_t> {21, 22, 23}), got);
+}
+
+TEST_F (ZwTest, c_api_prepared_query_input_types_change)
+{
+  auto voc = core_vocabulary ();
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), "dup add", zw_throw_on_error {})};
+  std::unique_ptr <zw_prepared_query, zw_deleter> prep
+	{zw_query_prepare (query.get (), zw_throw_on_error {})};
+
+  // The graph is specialized for the input, so for each change of
+  // input types, it has to be built anew.
+  auto run = [&] (zw_stack const *input)
+    {
+      std::unique_ptr <zw_result, zw_deleter> result
+	{zw_prepared_query_execute (prep.get (), input,
+				    zw_throw_on_error {})};
+      auto out = zw_result_next (*result);
+      EXPECT_TRUE (zw_result_next (*result) == nullptr);
+      return out;
+    };
+
+  auto out = run (stack_with_u64 (5).get ());
+  ASSERT_TRUE (out != nullptr);
+  EXPECT_EQ (10, zw_value_const_u64 (zw_stack_at (out.get (), 0)));
+
+  out = run (stack_with_str ("ab").get ());
+  ASSERT_TRUE (out != nullptr);
+  size_t len;
+  char const *str = zw_value_str_str (zw_stack_at (out.get (), 0), &len);
+  EXPECT_EQ ("abab", std::string (str, len));
+
+  out = run (stack_with_u64 (7).get ());
+  ASSERT_TRUE (out != nullptr);
+  EXPECT_EQ (14, zw_value_const_u64 (zw_stack_at (out.get (), 0)));
+}
+
+TEST_F (ZwTest, c_api_prepared_query_profile_accumulates)
+{
+  auto voc = core_vocabulary ();
+  std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), "|X| (1, 2, 3) X add",
+			 zw_throw_on_error {})};
+  std::unique_ptr <zw_prepared_query, zw_deleter> prep
+	{zw_query_prepare_profiled (query.get (), zw_throw_on_error {})};
+
+  // Inputs of the same type share the graph, and with it the profile.
+  uint64_t yields = 0;
+  for (uint64_t i: {10, 20})
+    {
+      auto input = stack_with_u64 (i);
+      std::unique_ptr <zw_result, zw_deleter> result
+	{zw_prepared_query_execute (prep.get (), input.get (),
+				    zw_throw_on_error {})};
+      while (zw_result_next (*result) != nullptr)
+	;
+
+      size_t n;
+      zw_profile_entry const *entries = zw_result_profile (result.get (), &n);
+      yields = 0;
+      for (size_t j = 0; j < n; ++j)
+	if (std::string (entries[j].name) == "add")
+	  yields = entries[j].yields;
+    }
+  EXPECT_EQ (6, yields);
+}
@@ -186,6 +186,32 @@ public:
   // XXX this should actually be hidden behind build_exec or what not.
   void simplify ();
 
+  // Wire overloaded builtins directly to the overload that they would
+  // dispatch to, where that can be determined from types of values
+  // that the preceding expression leaves on stack.  PROFILE describes
+  // stacks that the query will be run on.  Overloads whose operand
+  // types are not known statically keep dispatching at run time.
+  //
+  // Returns true if the analysis has additionally proven that the
+  // query never underruns the stack, and that no dispatch is left for
+  // run time.  Such queries can be run on unchecked stacks.
+  bool peg_overloads (static_profile const &profile = {});
+
+  // Let pegged builtins that are immediately followed by a filter
+  // that they can evaluate on their own do so.  E.g. in "entry
+  // (offset == 0x123)", entry can look up the DIE directly instead of
+  // enumerating all DIE's and evaluating the filter on each.  This
+  // is meant to be called after peg_overloads, on a tree that is
+  // about to be built.
+  void reduce_strength ();
+
+  // Whether the query mentions a builtin called NAME.
+  bool mentions (char const *name) const;
+
+  // Whether the query may observe positions of values, i.e. whether
+  // it mentions the word pos.
+  bool uses_pos () const;
+
   // This should build an op node corresponding to this expression.
   //
   // Not every expression node needs to have an associated op, some
@@ -199,6 +225,13 @@ public:
   // Produce program suitable for interpretation.
   std::unique_ptr <pred> build_pred () const;
 
+  // The above two do the actual building through these.  They
+  // themselves only instrument what's built when a profile is being
+  // collected (see profile.hh).
+  std::shared_ptr <op>
+  do_build_exec (std::shared_ptr <op> upstream) const;
+  std::unique_ptr <pred> do_build_pred () const;
+
   // === Parser interface ===
   //
   // The following methods are implemented in tree_cr.hh and
@@ -36,21 +36,21 @@
 value_type const value_closure::vtype
 	= value_type::alloc ("T_CLOSURE", "@hide");
 
-value_closure::value_closure (tree const &t,
+value_closure::value_closure (std::shared_ptr <tree const> t,
 			      std::shared_ptr <frame> frame, size_t pos)
   : value {vtype, pos}
-  , m_t {std::make_unique <tree> (t)}
+  , m_t {t}
   , m_frame {frame}
 {}
 
 value_closure::value_closure (value_closure const &that)
-  : value_closure {*that.m_t, that.m_frame, that.get_pos ()}
+  : value_closure {that.m_t, that.m_frame, that.get_pos ()}
 {}
 
 void
 value_closure::maybe_unlink_frame (std::shared_ptr <frame> &f)
 {
-  auto points_back = [&f] (std::unique_ptr <value> const &v)
+  auto points_back = [&f] (std::shared_ptr <value> const &v)
     {
       if (v != nullptr)
 	if (auto vcl = value::as <value_closure> (v.get ()))
@@ -87,9 +87,8 @@ value_closure::cmp (value const &v) const
 {
   if (auto that = value::as <value_closure> (&v))
     {
-      auto a = std::make_tuple (static_cast <tree &> (*m_t), m_frame);
-      auto b = std::make_tuple (static_cast <tree &> (*that->m_t),
-				that->m_frame);
+      auto a = std::tie (*m_t, m_frame);
+      auto b = std::tie (*that->m_t, that->m_frame);
       return compare (a, b);
     }
   else
@@ -38,18 +38,22 @@ class scope;
 class value_closure
   : public value
 {
-  std::unique_ptr <tree> m_t;
+  // The tree is shared among copies of the closure, which lets
+  // applications of the closure recognize that they can reuse an op
+  // graph that they have built for it before.
+  std::shared_ptr <tree const> m_t;
   std::shared_ptr <frame> m_frame;
 
 public:
   static value_type const vtype;
 
-  value_closure (tree const &t, std::shared_ptr <frame> frame, size_t pos);
+  value_closure (std::shared_ptr <tree const> t,
+		 std::shared_ptr <frame> frame, size_t pos);
   value_closure (value_closure const &that);
   ~value_closure();
 
-  tree const &get_tree () const
-  { return *m_t; }
+  std::shared_ptr <tree const> get_tree () const
+  { return m_t; }
 
   std::shared_ptr <frame> get_frame () const
   { return m_frame; }
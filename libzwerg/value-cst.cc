@@ -26,6 +26,7 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <functional>
 #include <iostream>
 #include <memory>
 
@@ -78,6 +79,14 @@ value_cst::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_cst::hash () const
+{
+  // Constants of arithmetic domains compare equal when their values
+  // are the same, so the domain can't partake.
+  return std::hash <uint64_t> {} (m_cst.value ().m_u);
+}
+
 
 // value
 
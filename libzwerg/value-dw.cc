@@ -26,15 +26,9 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
-#include <unistd.h>
-
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <system_error>
-#include <cerrno>
 
 #include "atval.hh"
 #include "dwcst.hh"
@@ -73,86 +67,12 @@ Two words are used for switching Dwarf back and forth: ``raw`` and
 
 )docstring");
 
-namespace
-{
-  int
-  prime_dwflmod (Dwfl_Module *dwflmod, void **userdata, const char *name,
-		 Dwarf_Addr base, void *arg)
-  {
-    // Prime the ELF file associated with a Dwfl module.  This is
-    // necessary when later we request a Dwarf.  For dwz files, that
-    // would fail with a message about missing symbol table, but it
-    // doesn't if we first prime the ELF file.
-    GElf_Addr bias;
-    if (dwfl_module_getelf (dwflmod, &bias) == nullptr)
-      throw_libdwfl ();
-
-    return DWARF_CB_OK;
-  }
-
-  struct fd_handle
-  {
-    int fd;
-    operator int () { return fd; }
-
-    fd_handle () : fd {-1} {}
-    fd_handle (int fd) : fd {fd} {}
-
-    int release ()
-    {
-      int ret = fd;
-      fd = -1;
-      return ret;
-    }
-
-    ~fd_handle ()
-    {
-      if (fd != -1)
-	close (fd);
-    }
-  };
-
-  std::shared_ptr <Dwfl>
-  open_dwfl (std::string const &fn)
-  {
-    fd_handle fd = open (fn.c_str (), O_RDONLY);
-    if (fd == -1)
-      throw std::runtime_error
-	(std::error_code (errno, std::system_category ()).message ());
-
-    const static Dwfl_Callbacks callbacks =
-      {
-	.find_elf = dwfl_build_id_find_elf,
-	.find_debuginfo = dwfl_standard_find_debuginfo,
-	.section_address = dwfl_offline_section_address,
-      };
-
-    elf_version (EV_CURRENT);
-
-    auto dwfl = std::shared_ptr <Dwfl> (dwfl_begin (&callbacks), dwfl_end);
-    if (dwfl == nullptr)
-      throw_libdwfl ();
-
-    if (dwfl_report_offline (&*dwfl, fn.c_str (), fn.c_str (), fd) == nullptr)
-      throw_libdwfl ();
-
-    // At this point the handle was consumed by dwfl_report_offline.
-    fd.release ();
-
-    if (dwfl_report_end (&*dwfl, nullptr, nullptr) != 0)
-      throw_libdwfl ();
-
-    dwfl_getmodules (&*dwfl, &prime_dwflmod, nullptr, 0);
-
-    return dwfl;
-  }
-}
 
 value_dwarf::value_dwarf (std::string const &fn, size_t pos, doneness d)
   : value {vtype, pos}
   , doneness_aspect {d}
   , m_fn {fn}
-  , m_dwctx {std::make_shared <dwfl_context> (open_dwfl (fn))}
+  , m_dwctx {std::make_shared <dwfl_context> (fn)}
 {}
 
 value_dwarf::value_dwarf (std::string const &fn,
@@ -176,6 +96,16 @@ value_dwarf::clone () const
   return std::make_unique <value_dwarf> (*this);
 }
 
+std::unique_ptr <value>
+value_dwarf::clone_for_this_thread () const
+{
+  auto dwctx = m_dwctx->for_this_thread ();
+  if (dwctx == m_dwctx)
+    return clone ();
+  return std::make_unique <value_dwarf> (m_fn, dwctx, get_pos (),
+					 get_doneness ());
+}
+
 cmp_result
 value_dwarf::cmp (value const &that) const
 {
@@ -212,6 +142,23 @@ value_cu::clone () const
   return std::make_unique <value_cu> (*this);
 }
 
+std::unique_ptr <value>
+value_cu::clone_for_this_thread () const
+{
+  auto dwctx = m_dwctx->for_this_thread ();
+  if (dwctx == m_dwctx)
+    return clone ();
+
+  Dwarf_Die cudie;
+  if (dwarf_cu_die (&m_cu, &cudie, nullptr, nullptr,
+		    nullptr, nullptr, nullptr, nullptr) == nullptr)
+    throw_libdw ();
+
+  cudie = dwctx->translate (*m_dwctx, cudie);
+  return std::make_unique <value_cu> (dwctx, *cudie.cu, m_offset,
+				      get_pos (), get_doneness ());
+}
+
 cmp_result
 value_cu::cmp (value const &that) const
 {
@@ -298,6 +245,27 @@ value_die::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_die::hash () const
+{
+  // Import paths only sometimes partake in comparison, so leave them
+  // out.
+  return hash_combine (std::hash <Dwarf *> {} (dwarf_cu_getdwarf (m_die.cu)),
+		       dwarf_dieoffset ((Dwarf_Die *) &m_die));
+}
+
+bool
+value_die::offset_key (void const *&space, uint64_t &offset) const
+{
+  // DIE's with differing import paths may have the same offset.
+  if (! is_raw () && m_import != nullptr)
+    return false;
+
+  space = dwarf_cu_getdwarf (m_die.cu);
+  offset = dwarf_dieoffset ((Dwarf_Die *) &m_die);
+  return true;
+}
+
 namespace
 {
   bool
@@ -339,6 +307,21 @@ namespace
   }
 }
 
+std::unique_ptr <value_die>
+value_die::rebind (std::shared_ptr <dwfl_context> dwctx) const
+{
+  if (dwctx == m_dwctx)
+    return std::make_unique <value_die> (*this);
+
+  std::shared_ptr <value_die> import;
+  if (m_import != nullptr)
+    import = m_import->rebind (dwctx);
+
+  return std::make_unique <value_die>
+    (dwctx, import, dwctx->translate (*m_dwctx, m_die), get_pos (),
+     get_doneness ());
+}
+
 std::unique_ptr <value_die>
 value_die::get_parent () const
 {
@@ -383,6 +366,25 @@ value_attr::clone () const
   return std::make_unique <value_attr> (*this);
 }
 
+std::unique_ptr <value>
+value_attr::clone_for_this_thread () const
+{
+  auto dwctx = get_dwctx ()->for_this_thread ();
+  if (dwctx == get_dwctx ())
+    return clone ();
+
+  // Look the attribute up anew the same way that attribute does.
+  auto die = m_die.rebind (dwctx);
+  Dwarf_Attribute attr;
+  unsigned name = dwarf_whatattr ((Dwarf_Attribute *) &m_attr);
+  if ((is_raw () ? dwarf_attr (&die->get_die (), name, &attr)
+       : dwarf_attr_integrate (&die->get_die (), name, &attr)) == nullptr)
+    throw_libdw ();
+
+  return std::make_unique <value_attr> (*die, attr, get_pos (),
+					get_doneness ());
+}
+
 cmp_result
 value_attr::cmp (value const &that) const
 {
@@ -400,6 +402,14 @@ value_attr::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_attr::hash () const
+{
+  return hash_combine
+    (dwarf_dieoffset (const_cast <Dwarf_Die *> (&get_die ())),
+     dwarf_whatattr ((Dwarf_Attribute *) &m_attr));
+}
+
 
 value_type const value_abbrev_unit::vtype = value_type::alloc ("T_ABBREV_UNIT",
 R"docstring(
@@ -30,6 +30,7 @@
 #define _VALUE_DW_H_
 
 #include <elfutils/libdwfl.h>
+#include <mutex>
 #include "std-memory.hh"
 #include "value.hh"
 #include "dwfl_context.hh"
@@ -88,6 +89,7 @@ public:
   void show (std::ostream &o) const override;
   cmp_result cmp (value const &that) const override;
   std::unique_ptr <value> clone () const override;
+  std::unique_ptr <value> clone_for_this_thread () const override;
 };
 
 // -------------------------------------------------------------------
@@ -128,6 +130,7 @@ public:
   void show (std::ostream &o) const override;
   cmp_result cmp (value const &that) const override;
   std::unique_ptr <value> clone () const override;
+  std::unique_ptr <value> clone_for_this_thread () const override;
 };
 
 // -------------------------------------------------------------------
@@ -137,7 +140,9 @@ public:
 class dwarf_value_cache
 {
   // A cache for storing a value_dwarf value generated by
-  // zw_value_die_dwarf API call.
+  // zw_value_die_dwarf API call.  That takes a const value, which
+  // several threads may be asking at once, hence the once_flag.
+  std::once_flag m_once;
   std::unique_ptr <value_dwarf> m_dwcache;
 
 public:
@@ -153,8 +158,9 @@ public:
   get_dwarf (std::shared_ptr <dwfl_context> dwctx, size_t pos,
 	     doneness d)
   {
-    if (m_dwcache == nullptr)
-      m_dwcache = std::make_unique <value_dwarf> ("???", dwctx, pos, d);
+    std::call_once (m_once, [&] () {
+	m_dwcache = std::make_unique <value_dwarf> ("???", dwctx, pos, d);
+      });
 
     assert (m_dwcache != nullptr);
     return *m_dwcache;
@@ -213,10 +219,20 @@ public:
   std::unique_ptr <value> clone () const override
   { return std::make_unique <value_die> (*this); }
 
+  std::unique_ptr <value> clone_for_this_thread () const override
+  { return rebind (m_dwctx->for_this_thread ()); }
+
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
+  bool offset_key (void const *&space, uint64_t &offset) const override;
 
   std::unique_ptr <value_die> get_parent () const;
 
+  // Return this DIE, translated to the handle DWCTX, which is for
+  // the same file as this DIE's handle.
+  std::unique_ptr <value_die> rebind (std::shared_ptr <dwfl_context> dwctx)
+    const;
+
   value_dwarf &
   get_dwarf ()
   {
@@ -272,7 +288,9 @@ public:
 
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
+  std::unique_ptr <value> clone_for_this_thread () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 
   value_dwarf &
   get_dwarf ()
@@ -26,6 +26,7 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <functional>
 #include <memory>
 #include <iostream>
 #include <algorithm>
@@ -33,6 +34,7 @@
 #include "value-seq.hh"
 #include "overload.hh"
 #include "value-cst.hh"
+#include "builtin-cst.hh"
 
 value_type const value_seq::vtype = value_type::alloc ("T_SEQ",
 R"docstring(
@@ -141,6 +143,16 @@ value_seq::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_seq::hash () const
+{
+  size_t ret = m_seq->size ();
+  for (auto const &v: *m_seq)
+    ret = hash_combine (ret, hash_combine (v->get_type ().code (),
+					   v->hash ()));
+  return ret;
+}
+
 value_seq
 op_add_seq::operate (std::unique_ptr <value_seq> a,
 		     std::unique_ptr <value_seq> b)
@@ -300,6 +312,39 @@ op_elem_seq::docstring ()
   return elem_seq_docstring;
 }
 
+namespace
+{
+  // (pos == N) picks at most one element, which can be accessed
+  // directly.
+  std::shared_ptr <builtin const>
+  reduce_elem_seq (reduction const &red, bool forward)
+  {
+    if (red.m_key != reduction_key::pos)
+      return nullptr;
+
+    size_t idx;
+    bool valid = pos_of_constant (red.m_cst, idx);
+    return make_reduced_builtin <value, value_seq>
+      ([valid, idx, forward] (std::unique_ptr <value_seq> a)
+       {
+	 auto seq = a->get_seq ();
+	 std::unique_ptr <value> v;
+	 if (valid && idx < seq->size ())
+	   {
+	     v = (*seq)[forward ? idx : seq->size () - 1 - idx]->clone ();
+	     v->set_pos (idx);
+	   }
+	 return std::make_unique <value_producer_single <value>> (std::move (v));
+       });
+  }
+}
+
+std::shared_ptr <builtin const>
+op_elem_seq::reduce (reduction const &red)
+{
+  return reduce_elem_seq (red, true);
+}
+
 std::unique_ptr <value_producer <value>>
 op_relem_seq::operate (std::unique_ptr <value_seq> a)
 {
@@ -312,6 +357,12 @@ op_relem_seq::docstring ()
   return elem_seq_docstring;
 }
 
+std::shared_ptr <builtin const>
+op_relem_seq::reduce (reduction const &red)
+{
+  return reduce_elem_seq (red, false);
+}
+
 pred_result
 pred_empty_seq::result (value_seq &a)
 {
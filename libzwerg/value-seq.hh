@@ -67,6 +67,7 @@ public:
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 struct op_add_seq
@@ -99,6 +100,7 @@ struct op_elem_seq
   operate (std::unique_ptr <value_seq> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct op_relem_seq
@@ -110,6 +112,7 @@ struct op_relem_seq
   operate (std::unique_ptr <value_seq> a) override;
 
   static std::string docstring ();
+  static std::shared_ptr <builtin const> reduce (reduction const &red);
 };
 
 struct pred_empty_seq
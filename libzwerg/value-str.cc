@@ -26,6 +26,9 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <cctype>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <regex.h>
@@ -68,6 +71,12 @@ value_str::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_str::hash () const
+{
+  return std::hash <std::string> {} (m_str);
+}
+
 
 value_str
 op_add_str::operate (std::unique_ptr <value_str> a,
@@ -305,37 +314,229 @@ pred_ends_str::docstring ()
 
 // ?match
 
-pred_result
-pred_match_str::result (value_str &haystack, value_str &needle)
+namespace
 {
-  regex_t re;
-  if (regcomp (&re, needle.get_string ().c_str(),
-	       REG_EXTENDED | REG_NOSUB) != 0)
-    {
-      std::cerr << "Error: could not compile regular expression: '"
-		<< needle.get_string () << "'\n";
-      return pred_result::fail;
-    }
+  // Return a pointer to the closing bracket of a bracket expression
+  // that starts at P, or to the terminating NUL.
+  char const *
+  skip_bracket (char const *p)
+  {
+    assert (*p == '[');
+    ++p;
+    if (*p == '^')
+      ++p;
+    if (*p == ']')
+      ++p;
+
+    for (; *p != 0 && *p != ']'; ++p)
+      if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+	{
+	  char const *q = strchr (p + 2, p[1]);
+	  while (q != nullptr && q[1] != ']')
+	    q = strchr (q + 1, p[1]);
+	  if (q == nullptr)
+	    return p + strlen (p);
+	  p = q + 1;
+	}
 
-  const int reti = regexec (&re, haystack.get_string ().c_str (),
-			    /* nmatch: size of pmatch array */ 0,
-			    /* pmatch: array of matches */ NULL,
-			    /* no extra flags */ 0);
+    return p;
+  }
 
-  pred_result retval = pred_result::fail;
-  if (reti == 0)
-    retval = pred_result::yes;
-  else if (reti == REG_NOMATCH)
-    retval = pred_result::no;
-  else
+  // Return a pointer to the parenthesis that closes a group that
+  // starts at P, or to the terminating NUL.
+  char const *
+  skip_group (char const *p)
+  {
+    assert (*p == '(');
+    int level = 0;
+    for (; *p != 0; ++p)
+      if (*p == '\\' && p[1] != 0)
+	++p;
+      else if (*p == '[')
+	{
+	  p = skip_bracket (p);
+	  if (*p == 0)
+	    break;
+	}
+      else if (*p == '(')
+	++level;
+      else if (*p == ')' && --level == 0)
+	break;
+    return p;
+  }
+
+  // Look through extended regular expression PAT for literal text.
+  // Return true if PAT is all literal text, which matches wherever
+  // the text occurs.  Otherwise store to REQUIRED the longest piece
+  // of text that every match has to contain, which may be empty.
+  // Only ASCII characters are considered, so that the answer doesn't
+  // depend on locale.
+  bool
+  analyze_pattern (char const *pat, std::string &required)
+  {
+    bool literal = true;
+    std::string run;
+    auto flush = [&] ()
+      {
+	if (run.size () > required.size ())
+	  required = run;
+	run.clear ();
+      };
+
+    for (char const *p = pat; *p != 0; ++p)
+      switch (*p)
+	{
+	case '|':
+	  // Nothing is required of all branches.
+	  required.clear ();
+	  return false;
+
+	case '*':
+	case '?':
+	case '{':
+	  // The preceding character may not be there at all.
+	  if (! run.empty ())
+	    run.pop_back ();
+	  if (*p == '{')
+	    while (p[1] != 0 && p[1] != '}')
+	      ++p;
+	  literal = false;
+	  flush ();
+	  break;
+
+	case '(':
+	  // The group may be quantified.
+	  p = skip_group (p);
+	  literal = false;
+	  flush ();
+	  if (*p == 0)
+	    return false;
+	  break;
+
+	case '[':
+	  p = skip_bracket (p);
+	  literal = false;
+	  flush ();
+	  if (*p == 0)
+	    return false;
+	  break;
+
+	case '\\':
+	  literal = false;
+	  if (p[1] != 0 && std::ispunct ((unsigned char) p[1]))
+	    run += *++p;
+	  else
+	    {
+	      flush ();
+	      if (p[1] != 0)
+		++p;
+	    }
+	  break;
+
+	case '+':
+	case '.':
+	case '^':
+	case '$':
+	case ')':
+	case ']':
+	case '}':
+	  literal = false;
+	  flush ();
+	  break;
+
+	default:
+	  if ((unsigned char) *p >= 0x80)
+	    {
+	      literal = false;
+	      flush ();
+	    }
+	  else
+	    run += *p;
+	}
+
+    flush ();
+    return literal;
+  }
+}
+
+class pred_match_str::regex
+{
+  std::string m_pattern;
+  std::string m_required;
+  bool m_literal;
+  bool m_compiled;
+  regex_t m_re;
+
+public:
+  explicit regex (std::string const &pattern)
+    : m_pattern {pattern}
+    , m_literal {analyze_pattern (pattern.c_str (), m_required)}
+    , m_compiled {false}
+  {
+    if (! m_literal)
+      m_compiled = regcomp (&m_re, pattern.c_str (),
+			    REG_EXTENDED | REG_NOSUB) == 0;
+  }
+
+  ~regex ()
+  {
+    if (m_compiled)
+      regfree (&m_re);
+  }
+
+  regex (regex const &) = delete;
+
+  pred_result
+  match (char const *str) const
+  {
+    if (m_literal)
+      return pred_result (strstr (str, m_pattern.c_str ()) != nullptr);
+
+    if (! m_compiled)
+      {
+	std::cerr << "Error: could not compile regular expression: '"
+		  << m_pattern << "'\n";
+	return pred_result::fail;
+      }
+
+    // Don't bother the regex engine if text that any match would
+    // contain is not there.
+    if (! m_required.empty () && strstr (str, m_required.c_str ()) == nullptr)
+      return pred_result::no;
+
+    const int reti = regexec (&m_re, str,
+			      /* nmatch: size of pmatch array */ 0,
+			      /* pmatch: array of matches */ NULL,
+			      /* no extra flags */ 0);
+
+    if (reti == 0)
+      return pred_result::yes;
+    else if (reti == REG_NOMATCH)
+      return pred_result::no;
+
+    char msgbuf[100];
+    regerror (reti, &m_re, msgbuf, sizeof (msgbuf));
+    std::cerr << "Error: match failed: " << msgbuf << "\n";
+    return pred_result::fail;
+  }
+};
+
+pred_result
+pred_match_str::result (value_str &haystack, value_str &needle)
+{
+  auto const &pattern = needle.get_string ();
+  auto it = m_cache.find (pattern);
+  if (it == m_cache.end ())
     {
-      char msgbuf[100];
-      regerror (reti, &re, msgbuf, sizeof (msgbuf));
-      std::cerr << "Error: match failed: " << msgbuf << "\n";
+      // Patterns computed on the fly could fill the cache
+      // indefinitely.
+      if (m_cache.size () >= 64)
+	m_cache.clear ();
+      it = m_cache.emplace (pattern,
+			    std::make_shared <regex> (pattern)).first;
     }
 
-  regfree (&re);
-  return retval;
+  return it->second->match (haystack.get_string ().c_str ());
 }
 
 std::string
@@ -345,11 +546,11 @@ pred_match_str::docstring ()
 R"docstring(
 
 This asserts that TOS (which is a string with a regular expression)
-matches the string below TOS.  The whole string has to match.  If you
-want to look for matches anywhere in the string, just surround your
-expression with ``.*``'s::
+matches the string below TOS.  The expression is looked for anywhere
+in the string, so ``"oob"`` matches ``"foobar"``.  If you want the
+whole string to match, anchor your expression with ``^`` and ``$``::
 
-	"haystack" ?(".*needle.*" ?match)
+	"haystack" ?("^hay.*$" ?match)
 
 For example::
 
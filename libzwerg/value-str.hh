@@ -29,6 +29,7 @@
 #ifndef _VALUE_STR_H_
 #define _VALUE_STR_H_
 
+#include <map>
 #include <string>
 
 #include "value.hh"
@@ -58,6 +59,7 @@ public:
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 struct op_add_str
@@ -142,6 +144,11 @@ struct pred_ends_str
 struct pred_match_str
   : public pred_overload <value_str, value_str>
 {
+  // Patterns are compiled once for each instance of the predicate
+  // and cached here.
+  class regex;
+  std::map <std::string, std::shared_ptr <regex const>> m_cache;
+
   using pred_overload::pred_overload;
   pred_result result (value_str &haystack, value_str &needle) override;
 
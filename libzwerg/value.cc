@@ -29,6 +29,8 @@
 #include <iostream>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 
 #include "op.hh"
 #include "tree.hh"
@@ -37,20 +39,31 @@
 value_type
 value_type::alloc (char const *name, char const *docstring)
 {
-  static uint8_t last = 0;
-  value_type vt {++last, name, docstring};
-  if (last == 0)
+  static std::atomic <uint8_t> last {0};
+  uint8_t code = ++last;
+  if (code == 0)
     {
       std::cerr << "Ran out of value type identifiers." << std::endl;
       std::terminate ();
     }
-  return vt;
+  return {code, name, docstring};
 }
 
 value_type const value::vtype = value_type::alloc ("T_???");
 
 namespace
 {
+  // Value types are normally registered during static initialization,
+  // but nothing prevents registering one later, while other threads
+  // look names up.  Accesses to the registry are therefore serialized
+  // through this lock.
+  std::mutex &
+  get_vtype_lock ()
+  {
+    static std::mutex lock;
+    return lock;
+  }
+
   std::vector <std::pair <uint8_t, char const *>> &
   get_vtype_names ()
   {
@@ -68,6 +81,7 @@ namespace
   char const *
   find_vtype_name (uint8_t code)
   {
+    std::lock_guard <std::mutex> lock {get_vtype_lock ()};
     auto &vtn = get_vtype_names ();
     auto it = std::find_if (vtn.begin (), vtn.end (),
 			    [code] (std::pair <uint8_t, char const *> const &v)
@@ -83,8 +97,9 @@ void
 value_type::register_type (uint8_t code,
 			   char const *name, char const *docstring)
 {
-  auto &vtn = get_vtype_names ();
   assert (find_vtype_name (code) == nullptr);
+  std::lock_guard <std::mutex> lock {get_vtype_lock ()};
+  auto &vtn = get_vtype_names ();
   vtn.push_back (std::make_pair (code, name));
   get_vtype_docstrings ().push_back (std::make_pair (code, docstring));
 }
@@ -100,12 +115,14 @@ value_type::name () const
 std::vector <std::pair <uint8_t, std::string>>
 value_type::get_docstrings ()
 {
+  std::lock_guard <std::mutex> lock {get_vtype_lock ()};
   return get_vtype_docstrings ();
 }
 
 std::vector <std::pair <uint8_t, char const *>>
 value_type::get_names ()
 {
+  std::lock_guard <std::mutex> lock {get_vtype_lock ()};
   return get_vtype_names ();
 }
 
@@ -153,6 +170,24 @@ value::get_type_const () const
   return {get_type ().code (), &slot_type_dom};
 }
 
+size_t
+value::hash () const
+{
+  return 0;
+}
+
+bool
+value::offset_key (void const *&space, uint64_t &offset) const
+{
+  return false;
+}
+
+std::unique_ptr <value>
+value::clone_for_this_thread () const
+{
+  return clone ();
+}
+
 std::ostream &
 operator<< (std::ostream &o, value const &v)
 {
@@ -29,6 +29,7 @@
 #ifndef _VALUE_H_
 #define _VALUE_H_
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -111,6 +112,13 @@ public:
 
 std::ostream &operator<< (std::ostream &o, value_type const &v);
 
+// Mix hash H into SEED, for hashing of compound values.
+inline size_t
+hash_combine (size_t seed, size_t h)
+{
+  return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 // A domain for slot type constants.
 extern constant_dom const &slot_type_dom;
 
@@ -138,6 +146,21 @@ public:
   virtual std::unique_ptr <zw_value> clone () const = 0;
   virtual cmp_result cmp (zw_value const &that) const = 0;
 
+  // Values that compare equal have to hash equal.  The default hash
+  // is the same for all values, which is correct, but not useful.
+  virtual size_t hash () const;
+
+  // Some values can be told apart by an offset within some space,
+  // e.g. DIE's by their offset within a Dwarf.  If this value can be,
+  // store these to SPACE and OFFSET and return true.  Two values that
+  // both have offset keys compare equal exactly when the keys do.
+  virtual bool offset_key (void const *&space, uint64_t &offset) const;
+
+  // Clone this value for use on the calling thread.  Values that
+  // refer to a Dwfl handle are rebound to the calling thread's handle
+  // for the same file.  Other values are simply cloned.
+  virtual std::unique_ptr <zw_value> clone_for_this_thread () const;
+
   void
   set_pos (size_t pos)
   {
@@ -141,6 +141,16 @@ expect_count 1 -e '
 expect_count 1 ./nontrivial-types.o -e '
 	entry (offset == 0xb8) (pos == 10)'
 
+# Test that DIE's looked up by offset agree with those enumerated.
+expect_count 1 ./nontrivial-types.o -e '
+	[entry (offset == 0xb8) offset] == [0xb8]'
+expect_count 1 ./nontrivial-types.o -e '
+	[entry (offset == 0xb9)] == []'
+expect_count 1 ./nontrivial-types.o -e '
+	[entry ?root offset] == [unit root offset]'
+expect_count 1 ./dwz-partial -e '
+	[raw entry (offset == 0x14) offset] == [0x14]'
+
 # Test that child annotates position.
 expect_count 1 ./nontrivial-types.o -e '
 	entry ?root child (offset == 0xb8) (pos == 6)'
@@ -225,6 +235,14 @@ expect_count 7 ./duplicate-const -e '
 	entry (@AT_decl_file =~ ".*petr.*")'
 expect_count 7 ./duplicate-const -e '
 	entry (@AT_decl_file !~ ".*pavel.*")'
+expect_count 1 -e '
+	[("foobar", "barfoo", "fob") (=~ "oob")] == ["foobar"]'
+expect_count 1 -e '
+	[("foobar", "barfoo", "fob") (=~ "fo+b")] == ["foobar", "fob"]'
+expect_count 1 -e '
+	[("a.c", "abc") (=~ "a\\.c")] == ["a.c"]'
+expect_count 1 -e '
+	[("foo", "bar") ("o", "a|x", "r$", "o") ?match] length == 4'
 
 # Test true/false
 expect_count 1 ./typedef.o -e '
@@ -245,6 +263,37 @@ expect_count 3 ./nontrivial-types.o -e '
 expect_count 3 ./nontrivial-types.o -e '
 	entry ?TAG_subprogram (child,) ?TAG_formal_parameter'
 
+# Check that closures over DIE's see each DIE once, also when the
+# walk goes both ways and when other values mix in.
+expect_count 1 ./a1.out -e '
+	[entry ?root (child, parent)*] length == [entry] length'
+expect_count 1 ./a1.out -e '
+	[unit root ((type == T_DIE) (child, drop 1),
+		    (type == T_CONST) drop 1)*] length == 12'
+
+# Check that ancestor, depth and ?ancestor_of agree with parent, also
+# across import points and when parent* is evaluated on the index.
+expect_count 1 ./nontrivial-types.o -e '
+	[entry ancestor offset] == [entry parent+ offset]'
+expect_count 3 ./nontrivial-types.o -e '
+	entry ?TAG_formal_parameter parent* ?TAG_subprogram'
+expect_count 3 ./nontrivial-types.o -e '
+	entry ?TAG_formal_parameter (|P| P parent* ?TAG_subprogram P ?ancestor_of)'
+expect_count 1 ./dwz-partial -e '
+	[entry (offset == 0x14) ancestor offset] == [0x34, 0xa4, 0xe1, 0x11e]'
+expect_count 1 ./dwz-partial -e '
+	[entry (offset == 0x14) depth] == [1, 1, 1, 1]'
+
+# Check that entry followed by tag assertions, which is evaluated on
+# the tag index, yields the same DIE's in the same contexts as a
+# plain walk over all DIE's.
+expect_count 1 ./dwz-partial -e '
+	[entry ?TAG_pointer_type "%(offset%) %(root offset%)"]
+	== [entry (|A| A ?TAG_pointer_type) "%(offset%) %(root offset%)"]'
+expect_count 1 ./nontrivial-types.o -e '
+	[entry (?TAG_const_type||?TAG_volatile_type) offset]
+	== [entry (|A| A (?TAG_const_type||?TAG_volatile_type)) offset]'
+
 # Check casting.
 expect_count 1 ./enum.o -e '
 	entry (@AT_name == "e") child
@@ -340,6 +389,10 @@ expect_count 1 -e '
 expect_count 1 -e '
 	let adder := {|x| {|y| x y add}};
 	3 adder 2 swap apply (== 5)'
+expect_count 1 -e '
+	[({1 add}, {2 add}, {1 add}) ->F; 10 F] == [11, 12, 11]'
+expect_count 1 -e '
+	[[(1, 2, 3) ->X; {|Y| X Y add}] elem 10 swap apply] == [11, 12, 13]'
 expect_count 1 -e '
 	let map := {|f| [|L| L elem f]};
 	[1, 2, 3] {1 add} map ?([2, 3, 4] ?eq)'
@@ -874,6 +927,96 @@ expect_out '0 breg5 <0>
 	 bitcount.o -e 'entry (offset == 0x91) @AT_location (pos == 1) elem'
 
 
+# Parallel execution over units.
+expect_out '<CU 0>
+<CU 0x53>' --unit-jobs=2 twocus -e unit
+expect_out '<CU 0x53>' --unit-jobs=2 twocus -e 'unit (pos == 1)'
+expect_count 2 --unit-jobs=2 --unordered twocus -e unit
+expect_count 2 --unit-jobs=2 twocus -e 'entry ?TAG_compile_unit'
+expect_count 2 --unit-jobs=2 twocus -e 'entry ?root'
+Q='entry (?TAG_subprogram || ?TAG_base_type) offset'
+expect_out "$($DWGREP twocus -e "$Q")" --unit-jobs=2 twocus -e "$Q"
+expect_out '0x80' --unit-jobs=2 twocus -e 'entry (offset == 0x80) offset'
+expect_out "$($DWGREP twocus -e 'entry name')" \
+	--unit-jobs=3 twocus -e 'entry name'
+expect_error 'invalid number of jobs' --unit-jobs=x twocus -e unit
+
+# Parallel processing of files.
+expect_out "$($DWGREP twocus enum.o twocus -e 'unit')" \
+	-j 2 twocus enum.o twocus -e 'unit'
+expect_out "$($DWGREP -c twocus enum.o bitcount.o -e 'entry')" \
+	-j 3 -c twocus enum.o bitcount.o -e 'entry'
+expect_error 'invalid number of jobs' -j 0 twocus -e unit
+
+FILES=$(mktemp)
+printf 'twocus\n\nenum.o\n' > $FILES
+expect_out "$($DWGREP -H twocus enum.o -e 'unit')" \
+	--files-from=$FILES -e 'unit'
+expect_out "$($DWGREP twocus twocus enum.o -e 'unit')" \
+	-j 2 --files-from=$FILES twocus -e 'unit'
+rm -f $FILES
+expect_error "can't open file list" --files-from=nonexistent -e 'unit'
+
+# Output written by a separate thread.
+expect_out "$($DWGREP twocus -e 'entry')" --writer-thread twocus -e 'entry'
+expect_out "$($DWGREP twocus enum.o -e 'entry')" \
+	--writer-thread -j 2 twocus enum.o -e 'entry'
+expect_count 1 --writer-thread -e '1'
+
+# Output that can't be written is an error, also when it is written
+# by a separate thread or files are processed in parallel.
+if [ -w /dev/full ]; then
+    for opt in --with-filename --writer-thread \
+	       "-j 2" "-j 2 --writer-thread"; do
+	export total=$((total + 1))
+	STATUS=0
+	GOT=$(timeout $ZW_TEST_TIMEOUT $DWGREP $opt twocus -e 'entry' \
+		2>&1 >/dev/full) || STATUS=$?
+	if [ $STATUS -ne 2 -o "${GOT/error writing output//}" == "$GOT" ]; then
+	    fail "$DWGREP" $opt twocus -e 'entry' ">/dev/full"
+	    echo "expected status 2 and a write error" >&2
+	    echo "     got: $STATUS $GOT" >&2
+	fi
+    done
+fi
+
+# Limiting the number of results.
+expect_out '1
+2' -e '(1, 2, 3) 2 limit'
+expect_count 0 -e '(1, 2, 3) 0 limit'
+expect_out '[10]
+[10]' -e '(1, 2) [(10, 20) 1 limit] swap drop'
+expect_count 2 --unit-jobs=2 twocus -e 'entry 2 limit'
+expect_out '1
+2' -m 2 -e '(1, 2, 3)'
+expect_count 2 -m 2 twocus -e 'entry'
+expect_out "$($DWGREP -m 1 twocus enum.o -e 'entry')" \
+	-j 2 -m 1 twocus enum.o -e 'entry'
+expect_error 'invalid maximum count' -m x -e '1'
+expect_out '2' -c -m 2 twocus -e 'entry'
+expect_out '0' -c -e '(1, 2, 3) (> 3)'
+
+# Machine-readable output.
+expect_out '{"values":[{"type":"cst","dom":"dec","value":2},{"type":"cst","dom":"dec","value":1}]}' \
+	--format=jsonl -e '1 2'
+expect_out '{"values":[{"type":"seq","value":[{"type":"str","value":"x"}]}]}' \
+	--format=jsonl -e '["x"]'
+expect_out '{"values":[{"type":"cu","offset":0}]}' \
+	--format=jsonl a1.out -e 'unit'
+expect_out '{"file":"a1.out","count":1}' --format=jsonl -c -H a1.out -e 'unit'
+expect_out "$($DWGREP --format=jsonl twocus enum.o -e 'entry')" \
+	--format=jsonl -j 2 twocus enum.o -e 'entry'
+expect_error 'unknown output format' --format=xml -e '1'
+
+total=$((total + 1))
+GOT=$($DWGREP --format=bin -c -e '1' | od -An -tx1 | tr -s ' \n' ' ')
+EXPECT=' 44 57 47 52 45 50 42 01 0d 00 00 00 02 00 00 00 00 01 00 00 00 00 00 00 00 '
+if [ "$GOT" != "$EXPECT" ]; then
+    fail "$DWGREP --format=bin -c -e 1"
+    echo "expected: $EXPECT" >&2
+    echo "     got: $GOT" >&2
+fi
+
 # =============================================================================
 
 echo "$total tests total, $failures failures."